@@ -12,12 +12,96 @@
 
 #include "ObjectAllocator.h"
 #include <cstring>
+#include <cstdio>
+#include <unordered_map>
+#include <new>
+#include <algorithm>
+#include <numeric>
 #include <assert.h>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define OA_HAS_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#endif
 
 static constexpr size_t ptrSize = sizeof(void*);
 static constexpr uint32_t freedFlag = 0x00u;
 static constexpr uint32_t allocFlag = 0x01u;
 
+// OAHandle bit layout (from the low bits): use counter | block index | page slot | slot epoch
+static constexpr unsigned handleFieldBits = 16u;
+static constexpr uint64_t handleFieldMask = 0xFFFFu;
+
+/**
+ * @brief   Header at the start of a mapped file. Lists are stored as
+ *          offsets from the start of the mapping (0 = null) so the 
+ *          file can be mapped at any address
+ */
+struct RegionHeader
+{
+    uint64_t magic;          //!< regionMagic once the header is initialized
+    uint64_t objectSize;     //!< layout the file was created with
+    uint64_t pageSize;
+    uint64_t pageStride;
+    uint64_t headerSize;
+    uint32_t objectsPerPage;
+    uint32_t maxPages;
+    uint32_t padBytes;
+    uint32_t headerType;
+    uint32_t leftAlignSize;
+    uint32_t interAlignSize;
+    uint64_t baseAddress;    //!< where the file was last mapped
+    uint64_t pageListOffset; //!< head of the page list
+    uint64_t freeListOffset; //!< head of the free list
+    uint64_t rootOffset;     //!< client's root object
+    uint32_t allocations;    //!< stats that can't be recomputed on open
+    uint32_t deallocations;
+    uint32_t mostObjects;
+    uint32_t freeObjects;    //!< live stats of a shared allocator
+    uint32_t objectsInUse;
+    uint64_t inFlightOffset; //!< block a shared Allocate/Free is changing, for recovery
+#ifdef OA_HAS_MMAP
+    pthread_mutex_t lock;    //!< guards a shared allocator across processes
+#endif
+};
+
+static constexpr uint64_t regionMagic = 0x313041504D4D414Full; // "OAMMPA01"
+static constexpr size_t regionHeaderSize = 256;  // header rounded up, keeps what follows aligned
+static constexpr size_t regionFrameAlign = 16;   // page frames are aligned like operator new
+static constexpr uint64_t reservedRangeLimit = 0x100000000ull; // Compressed_ references are 32-bit offsets
+static constexpr size_t cacheLineSize = 64;      // step between page colors (at least)
+static constexpr size_t colorTagSize = 16;       // room before a colored page for its color, keeps new[]'s alignment
+static constexpr size_t colorSlackLimit = 4096;  // colors never span more than a system page
+static constexpr unsigned nearSearchLimit = 32;  // free blocks AllocateNear looks at without PlacementHints_
+static_assert(sizeof(RegionHeader) <= regionHeaderSize, "RegionHeader must fit before the first frame");
+
+/*!
+  State shared by the threads using a Blocking_ allocator and by the
+  background maintenance worker
+*/
+struct ObjectAllocator::Threading
+{
+    std::mutex lock;                   //!< serializes the allocator between threads
+    std::condition_variable wake;      //!< signalled when the free list runs low or on stop
+    std::condition_variable freed;     //!< signalled on Free for AllocateWait callers
+    unsigned waiting = 0;              //!< number of AllocateWait callers asleep on freed
+    std::thread worker;
+    bool maintaining = false;          //!< worker is running
+    unsigned lowWatermark = 0;         //!< free objects to keep ready
+    unsigned highWatermark = 0;        //!< free objects above which empty pages are freed
+    std::chrono::milliseconds interval{ 0 }; //!< time between checks when not woken
+    bool stop = false;
+};
+
 // setters //
 /**
  * @brief   Sets the debug state of the allocator
@@ -26,7 +110,7 @@ static constexpr uint32_t allocFlag = 0x01u;
  *          true    - enable error checking 
  *          false   - disable error checking
  */
-void ObjectAllocator::SetDebugState(bool State) { config.DebugOn_ = State; }
+void ObjectAllocator::SetDebugState(bool State) { config.DebugOn_ = State; UpdatePlain(); }
 
 // getters //
 /**
@@ -34,7 +118,7 @@ void ObjectAllocator::SetDebugState(bool State) { config.DebugOn_ = State; }
  * 
  * @return  The pointer to the internal free list
  */
-const void* ObjectAllocator::GetFreeList() const { return freeList; } 
+const void* ObjectAllocator::GetFreeList() const { return currentTag == 0 ? freeList : tagFreeLists[0]; } 
 
 /**
  * @brief   Getter for the pointer to the internal page list
@@ -55,7 +139,22 @@ OAConfig ObjectAllocator::GetConfig() const { return config; }
  * 
  * @return  OAStats 
  */
-OAStats ObjectAllocator::GetStats() const { return stats; }           // returns the statistics for the allocator
+OAStats ObjectAllocator::GetStats() const 
+{ 
+    std::unique_lock<std::mutex> guard = LockThreads();
+    if (!sharedRegion)
+        return stats;
+
+    //a shared allocator's stats are changed by other processes
+    const RegionHeader* header = reinterpret_cast<const RegionHeader*>(regionBase);
+    OAStats shared = stats;
+    shared.FreeObjects_ = header->freeObjects;
+    shared.ObjectsInUse_ = header->objectsInUse;
+    shared.MostObjects_ = header->mostObjects;
+    shared.Allocations_ = header->allocations;
+    shared.Deallocations_ = header->deallocations;
+    return shared;
+}
 
 
 
@@ -105,6 +204,33 @@ static void WritePatternToBlock(void* object, size_t byteSize, uint8_t pattern)
 
 }
 
+/**
+ * @brief   High 64 bits of a 64x64-bit product. With m = 2^64 / d 
+ *          rounded up, MultiplyHigh(m, n) is n / d for any 32-bit n 
+ *          and d (Lemire, Kaser and Kurz, "Faster Remainder by Direct
+ *          Computation")
+ * 
+ * @param   a 
+ *          A factor
+ * @param   b 
+ *          The other factor
+ * 
+ * @return  (a * b) >> 64
+ */
+static inline uint64_t MultiplyHigh(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    return __umulh(a, b);
+#else
+    const uint64_t aLow = a & 0xFFFFFFFFu, aHigh = a >> 32;
+    const uint64_t bLow = b & 0xFFFFFFFFu, bHigh = b >> 32;
+    const uint64_t middle = aHigh * bLow + ((aLow * bLow) >> 32);
+    return aHigh * bHigh + (middle >> 32) + ((aLow * bHigh + (middle & 0xFFFFFFFFu)) >> 32);
+#endif
+}
+
 /**
  * @brief   Helper function to update allocation stats
  *          for ObjectAllocator::Allocate function
@@ -150,7 +276,96 @@ static void UpdateDeallocationStats(OAStats& stats)
 ObjectAllocator::ObjectAllocator(size_t ObjectSize, const OAConfig& configuration)
     : pageList{ nullptr }, freeList{ nullptr }, config{ configuration }, stats{}
 {
+    InitLayout(ObjectSize);
+
+    if (config.Blocking_)
+        threading.reset(new Threading);
+    UpdatePlain();
+
+    if (config.RealTime_)
+    {
+        CreateRealTimePages();
+        return;
+    }
+
+    if (config.Compressed_)
+        ReserveAddressRange();
+
+    //an allocator that is never used costs no page
+    if (config.LazyFirstPage_)
+        return;
+
+    OA_STATUS status = CreatePage();
+    if (status != S_OK)
+        ThrowStatus(status);
+}
+
+/**
+ * @brief   Construct an Object Allocator whose pages live in a 
+ *          memory mapping. If a file already holds an allocator
+ *          of the same layout, it is checked and resumed with every 
+ *          object intact, else it is created with MaxPages_ page frames
+ * 
+ * @param   ObjectSize
+ *          The allocation's object size in bytes
+ * 
+ * @param   configuration
+ *          A structure of configurations to apply for allocator.
+ *          MaxPages_ must not be 0 and external headers are not supported
+ * 
+ * @param   name
+ *          Path of the file to map, or the name of the shared memory 
+ *          object (e.g. "/my-pool") for mtShared
+ * 
+ * @param   type
+ *          mtFile for a persistent file, mtShared for a pool shared by 
+ *          processes. The first process to open a shared pool creates 
+ *          all MaxPages_ pages, later ones attach to it
+ */
+ObjectAllocator::ObjectAllocator(size_t ObjectSize, const OAConfig& configuration, const char* name, MAPPING_TYPE type)
+    : pageList{ nullptr }, freeList{ nullptr }, config{ configuration }, stats{}
+{
+    InitLayout(ObjectSize);
+    //resumed and shared pages are checked against their bitmaps
+    trackLive.store(true, std::memory_order_relaxed);
+
+    if (config.RealTime_ || config.Compressed_)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to map memory: real-time and compressed allocators use their own pages.");
+    //back links are raw pointers, which don't survive remapping
+    if (config.PlacementHints_ || config.Tags_ > 1)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to map memory: mapped allocators can't use placement hints or tags.");
+    if (config.Blocking_)
+        threading.reset(new Threading);
+
+    if (type == mtShared)
+    {
+        //waiting threads can't be woken by other processes
+        if (config.Blocking_)
+            throw OAException(OAException::E_NO_MEMORY, "Failed to map shared memory: shared allocators can't be Blocking_.");
+        OpenSharedMemory(name);
+        return;
+    }
+
+    if (OpenMappedFile(name) || config.LazyFirstPage_)
+        return;
+
+    OA_STATUS status = CreatePage();
+    if (status != S_OK)
+    {
+        CloseMappedFile();
+        ThrowStatus(status);
+    }
+}
 
+/**
+ * @brief   Computes the alignment bytes and page size for the
+ *          object size and configuration
+ * 
+ * @param   ObjectSize
+ *          The allocation's object size in bytes
+ */
+void ObjectAllocator::InitLayout(size_t ObjectSize)
+{
     //calculate alignments
     if (config.Alignment_ > 0)
     {
@@ -176,7 +391,44 @@ ObjectAllocator::ObjectAllocator(size_t ObjectSize, const OAConfig& configuratio
     stats.MostObjects_ = 0;
     stats.PageSize_ = allocateSize;
 
-    CreatePage();
+    occupancyWords = (config.ObjectsPerPage_ + 63u) / 64u;
+
+    //debug checks and hints read the bitmaps on every call, and other
+    //threads could be allocating while a Blocking_ allocator builds them
+    if (config.TrackLive_ || config.DebugOn_ || config.PlacementHints_ || config.Blocking_)
+        trackLive.store(true, std::memory_order_relaxed);
+
+    //granules no bigger than a page, so a granule is touched by at most two pages
+    granuleShift = 0;
+    while ((size_t(2) << granuleShift) <= stats.PageSize_)
+        ++granuleShift;
+    strideReciprocal = ObjectStride() > 1 ? UINT64_MAX / ObjectStride() + 1 : 0;
+
+    //pages are sized exactly, so the slack colors come from is added: up to
+    //an eighth of a page, in steps that keep blocks aligned
+    if (config.Coloring_ && !config.UseCPPMemManager_)
+    {
+        colorStep = config.Alignment_ > 0 ? std::lcm(cacheLineSize, static_cast<size_t>(config.Alignment_)) : cacheLineSize;
+        colorCount = static_cast<unsigned>(std::min(stats.PageSize_ / 8, colorSlackLimit) / colorStep) + 1;
+    }
+
+    //objects too small for a pointer link by block index (slot * ObjectsPerPage + block + 1)
+    if (ObjectSize < ptrSize && !config.UseCPPMemManager_)
+    {
+        linkBytes = ObjectSize >= sizeof(uint32_t) ? sizeof(uint32_t) : sizeof(uint16_t);
+        slotLimit = (linkBytes == sizeof(uint32_t) ? 0xFFFFFFFFu : 0xFFFFu) / std::max(config.ObjectsPerPage_, 1u);
+
+        if (ObjectSize < sizeof(uint16_t) || slotLimit == 0)
+            throw OAException(OAException::E_NO_MEMORY, "Object size too small: free blocks must be able to hold a link.");
+    }
+    //blocks from operator new have no pages to place near, and may be too small for a back link
+    if (config.UseCPPMemManager_)
+        config.PlacementHints_ = false;
+    if (config.PlacementHints_ && ObjectSize < ptrSize * 2)
+        throw OAException(OAException::E_NO_MEMORY, "Object size too small: placement hints need room for two links.");
+
+    if (config.Tags_ > 1 && !config.UseCPPMemManager_)
+        tagFreeLists.assign(config.Tags_, nullptr);
 }
 
 /**
@@ -185,40 +437,83 @@ ObjectAllocator::ObjectAllocator(size_t ObjectSize, const OAConfig& configuratio
  */
 ObjectAllocator::~ObjectAllocator()
 {
+    StopMaintenance();
+
+    if (realTimeArena)
+    {
+        delete[] realTimeArena;
+        return;
+    }
+
+    if (regionBase)
+    {
+        CloseMappedFile();
+        return;
+    }
+
+#ifdef OA_HAS_MMAP
+    if (reservedBase)
+    {
+        munmap(reservedBase, reservedSize);
+        return;
+    }
+#endif
 
     while (pageList)
     {
         GenericObject* next = pageList->Next;
         uint8_t* rawMem = reinterpret_cast<uint8_t*>(pageList);
-        delete[] rawMem;
+        ReleasePage(rawMem);
         pageList = next;
     }
 }
 
 /**
- * @brief   Creates a new free page in allocator
- *          
+ * @brief   Throws the OAException matching a failed status code.
+ *          The messages are only built here so the non-throwing
+ *          path never pays for string construction
+ * 
+ * @param   status
+ *          The failed status returned by a Try* function
+ * 
+ * @param   allocating 
+ *          The status is from an allocation, where S_BAD_BOUNDARY 
+ *          means a tag out of range
  */
-void ObjectAllocator::CreatePage()
+void ObjectAllocator::ThrowStatus(OA_STATUS status, bool allocating) const
 {
-
-    uint8_t* rawMem = nullptr;
-    try
-    {
-        rawMem = new uint8_t[stats.PageSize_];
-    }
-    catch (const std::bad_alloc&)
+    switch (status)
     {
-        throw OAException(OAException::E_NO_MEMORY, "Failed to allocate new page: No system memory available.");
+    case S_NO_MEMORY:
+        throw OAException(OAException::E_NO_MEMORY, "Failed to allocate memory: No system memory available.");
+    case S_NO_PAGES:
+        throw OAException(OAException::E_NO_PAGES,
+            "Failed to create new page: Max pages of " + std::to_string(config.MaxPages_) + " has already been created.");
+    case S_BAD_BOUNDARY:
+        if (allocating)
+            throw OAException(OAException::E_BAD_BOUNDARY,
+                "Allocating: Tag is out of range of " + std::to_string(config.Tags_) + " tags.");
+        throw OAException(OAException::E_BAD_BOUNDARY, "Freeing: Out of range or misaligned memory\n");
+    case S_MULTIPLE_FREE:
+        throw OAException(OAException::E_MULTIPLE_FREE, "Double Free Detected: Memory is already freed\n");
+    case S_CORRUPTED_BLOCK:
+        throw OAException(OAException::E_CORRUPTED_BLOCK, "MemoryBlock: Corruption detected\n");
+    default:
+        break;
     }
-    //set unallocated pattern for all
-    memset(rawMem, UNALLOCATED_PATTERN, stats.PageSize_);
-
-    GenericObject* pageStart = pageList;
-    pageList = reinterpret_cast<GenericObject*>(rawMem);
-    pageList->Next = pageStart;
+}
 
-    //PrintFreeList("PageList:", pageList);
+/**
+ * @brief   Writes the patterns of every block on a page, leaving
+ *          its page list link alone
+ * 
+ * @param   rawMem 
+ *          Start of the page
+ */
+void ObjectAllocator::InitPageBlocks(uint8_t* rawMem)
+{
+    //set unallocated pattern for all
+    memset(rawMem + ptrSize, UNALLOCATED_PATTERN, stats.PageSize_ - ptrSize);
 
     uint8_t* advancePtr = rawMem; //ptr used for advancement
 
@@ -237,11 +532,6 @@ void ObjectAllocator::CreatePage()
         WritePatternToBlock(advancePtr, config.PadBytes_, PAD_PATTERN);
         advancePtr += config.PadBytes_;
 
-        //link freelist
-        GenericObject* prev = freeList;
-        freeList = reinterpret_cast<GenericObject*>(advancePtr);
-        freeList->Next = prev;
-
         //skip object pattern as its aldy set
         advancePtr += stats.ObjectSize_;
         //end padding 
@@ -254,12 +544,63 @@ void ObjectAllocator::CreatePage()
             advancePtr += config.InterAlignSize_;
         }
     }
+}
+
+/**
+ * @brief   Creates a new free page in allocator
+ * 
+ * @return  S_OK on success, S_NO_MEMORY if the page could not be allocated
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::CreatePage() noexcept
+{
+
+    uint8_t* rawMem = AcquirePage();
+    if (!rawMem)
+        return S_NO_MEMORY;
+    if (!AddPageSlot(reinterpret_cast<GenericObject*>(rawMem)))
+    {
+        ReleasePage(rawMem);
+        return S_NO_MEMORY;
+    }
+
+    //a frame committed fresh from the reserved range is all zero, which are the
+    //right headers when nothing else (patterns, pads) has to be written
+    const bool zeroPage = reservedBase && !config.DebugOn_ && config.PadBytes_ == 0;
+    if (!zeroPage)
+        InitPageBlocks(rawMem);
+
+    GenericObject* newPage = reinterpret_cast<GenericObject*>(rawMem);
+    SetNext(newPage, pageList);
+    SetPageList(newPage);
+
+    //PrintFreeList("PageList:", pageList);
+
+    if (zeroPage)
+    {
+        //its blocks are linked one at a time as they are needed, so
+        //memory no one asked for is never touched
+        const size_t slot = FindPageSlot(rawMem);
+        std::fill_n(&pristine[slot * occupancyWords], occupancyWords, ~uint64_t(0));
+        pendingSlots.push_back(slot);
+        pageSlots[slot].pending = true;
+    }
+    else
+    {
+        //link freelist
+        uint8_t* objBlock = rawMem + PageToDataOffset();
+        for (size_t i = 0; i < config.ObjectsPerPage_; ++i, objBlock += ObjectStride())
+        {
+            GenericObject* block = reinterpret_cast<GenericObject*>(objBlock);
+            SetNextFree(block, freeList);
+            SetFreeList(block);
+        }
+    }
 
     //PrintList("Create freeList:", freeList);
     ++stats.PagesInUse_;
     stats.FreeObjects_ += config.ObjectsPerPage_;
 
-
+    return S_OK;
 }
 
 /**
@@ -274,111 +615,571 @@ void ObjectAllocator::CreatePage()
  */
 void* ObjectAllocator::Allocate(const char* label)
 {
+    void* object = nullptr;
+    OA_STATUS status = TryAllocate(object, label);
+    if (status != S_OK)
+        ThrowStatus(status);
 
-    if (config.UseCPPMemManager_)
+    return object;
+}
+
+/**
+ * @brief   Non-throwing version of ObjectAllocator::Allocate
+ * 
+ * @param   Object
+ *          Receives the ptr to the given memoryblock, nullptr on failure
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @return  S_OK on success, else the reason the object could not be allocated
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::TryAllocate(void*& Object, const char* label) noexcept
+{
+    //nothing optional to do, the links are plain pointers (AllocateBlock refills the list)
+    if (plain && freeList)
     {
-        //update stats
+        uint8_t* freeBlock = reinterpret_cast<uint8_t*>(freeList);
+        freeList = freeList->Next;
+        memset(freeBlock, ALLOCATED_PATTERN, stats.ObjectSize_);
         UpdateAllocationStats(stats);
-        return new uint8_t[stats.ObjectSize_];
+        UpdateHeaderInfo(freeBlock, allocFlag);
+        Object = freeBlock;
+        return S_OK;
     }
+    if (plain)
+        return AllocateBlock(Object, label);
+    return TryAllocateFrom(Object, 0, nullptr, label);
+}
 
-    //PrintFreeList("FreeList:", freeList);
+/**
+ * @brief   Allocate space for a zero-filled object
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @return  A ptr to given memoryblock
+ */
+void* ObjectAllocator::AllocateZeroed(const char* label)
+{
+    void* object = nullptr;
+    OA_STATUS status = TryAllocateZeroed(object, label);
+    if (status != S_OK)
+        ThrowStatus(status);
 
-    // out of blocks for more obj create new pages
-    if (!freeList)
-    {
-        if (config.MaxPages_ == 0 || config.MaxPages_ > stats.PagesInUse_)
-        {
-            //printf("Create new page\n");
-            CreatePage();
-        }
-        else
-        {
-            throw OAException(OAException::E_NO_PAGES,
-                "Failed to create new page: Max pages of " + std::to_string(config.MaxPages_) + " has already been created.");
-        }
-    }
+    return object;
+}
 
-    //PrintList("B FreeList:", freeList);
+/**
+ * @brief   Non-throwing version of ObjectAllocator::AllocateZeroed
+ * 
+ * @param   Object
+ *          Receives the ptr to the given memoryblock, nullptr on failure
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @return  S_OK on success, else the reason the object could not be allocated
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::TryAllocateZeroed(void*& Object, const char* label) noexcept
+{
+    return TryAllocateFrom(Object, 0, nullptr, label, true);
+}
 
-    assert(freeList);
-    uint8_t* freeBlock = reinterpret_cast<uint8_t*>(freeList);
-    freeList = freeList->Next;
+/**
+ * @brief   Allocate space for a object, preferring a block on the 
+ *          same page as an object that will be used with it
+ * 
+ * @param   hint 
+ *          An object of this allocator (nullptr for no preference)
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @return  A ptr to given memoryblock
+ */
+void* ObjectAllocator::AllocateNear(const void* hint, const char* label)
+{
+    void* object = nullptr;
+    OA_STATUS status = TryAllocateNear(object, hint, label);
+    if (status != S_OK)
+        ThrowStatus(status);
 
-    assert(freeBlock);
+    return object;
+}
 
-    uint8_t* headerBlock = freeBlock; // start ptr to headerblock
+/**
+ * @brief   Non-throwing version of ObjectAllocator::AllocateNear
+ * 
+ * @param   Object
+ *          Receives the ptr to the given memoryblock, nullptr on failure
+ * 
+ * @param   hint 
+ *          An object of this allocator (nullptr for no preference)
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @return  S_OK on success, else the reason the object could not be allocated
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::TryAllocateNear(void*& Object, const void* hint, const char* label) noexcept
+{
+    return TryAllocateFrom(Object, 0, hint, label);
+}
 
-    //PrintList("A FreeList:", freeList);
+/**
+ * @brief   Allocate space for a object from the pages of a tag only.
+ *          Objects expected to die together should share a tag, so 
+ *          their pages empty out for FreeEmptyPages
+ * 
+ * @param   tag 
+ *          The allocation tag (less than Tags_)
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @return  A ptr to given memoryblock
+ */
+void* ObjectAllocator::AllocateTagged(unsigned tag, const char* label)
+{
+    void* object = nullptr;
+    OA_STATUS status = TryAllocateTagged(object, tag, label);
+    if (status != S_OK)
+        ThrowStatus(status, true);
 
-    memset(freeBlock, ALLOCATED_PATTERN, stats.ObjectSize_);
+    return object;
+}
 
-    //update stats
-    UpdateAllocationStats(stats);
+/**
+ * @brief   Non-throwing version of ObjectAllocator::AllocateTagged
+ * 
+ * @param   Object
+ *          Receives the ptr to the given memoryblock, nullptr on failure
+ * 
+ * @param   tag 
+ *          The allocation tag (less than Tags_)
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @return  S_OK on success, S_BAD_BOUNDARY if the tag is out of 
+ *          range, else the reason the object could not be allocated
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::TryAllocateTagged(void*& Object, unsigned tag, const char* label) noexcept
+{
+    Object = nullptr;
+    if (tag != 0 && tag >= config.Tags_)
+        return S_BAD_BOUNDARY;
+    //tags mean nothing to the C++ memory manager
+    if (config.UseCPPMemManager_)
+        tag = 0;
 
-    //create external header block
-    if (config.HBlockInfo_.type_ == OAConfig::hbExternal)
+    return TryAllocateFrom(Object, tag, nullptr, label);
+}
+
+/**
+ * @brief   Takes the locks the allocator needs and allocates an object
+ * 
+ * @param   Object
+ *          Receives the ptr to the given memoryblock, nullptr on failure
+ * 
+ * @param   tag 
+ *          The allocation tag, 0 if untagged
+ * 
+ * @param   hint 
+ *          An object to allocate near (may be nullptr)
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @param   zeroed 
+ *          Zero-fill the object
+ * 
+ * @return  S_OK on success, else the reason the object could not be allocated
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::TryAllocateFrom(void*& Object, unsigned tag, const void* hint, const char* label, bool zeroed) noexcept
+{
+    if (threading)
     {
-        AllocateExternalHeader(headerBlock, label);
+        std::unique_lock<std::mutex> guard(threading->lock);
+        if (hint)
+            PreferNear(hint, tag);
+        OA_STATUS status = AllocateBlock(Object, label, tag, zeroed);
+        //running low, have the worker create pages before the free list runs out
+        if (threading->maintaining && stats.FreeObjects_ < threading->lowWatermark)
+            threading->wake.notify_one();
+        return status;
+    }
+    if (!sharedRegion)
+    {
+        if (hint)
+            PreferNear(hint, tag);
+        return AllocateBlock(Object, label, tag, zeroed);
     }
-    //update headers info if any
-    UpdateHeaderInfo(headerBlock, allocFlag);
-
 
-    return freeBlock;
+    LockShared();
+    if (hint)
+        PreferNear(hint, tag);
+    SetInFlight(freeList);
+    OA_STATUS status = AllocateBlock(Object, label, tag, zeroed);
+    UnlockShared();
+    return status;
 }
 
 /**
- * @brief   Free an object memory allocated by the allocator
+ * @brief   Moves a free block on the page of the hint to the head of
+ *          the free list, so AllocateBlock hands it out. With 
+ *          PlacementHints_ the block is found in the occupancy bitmap
+ *          and unlinked through its back link (or refilled, if the 
+ *          page is pending), else the first nearSearchLimit free 
+ *          blocks are searched
  * 
- * @param   Object
- *          The object memory pointer
+ * @param   hint 
+ *          An object of this allocator
+ * 
+ * @param   tag 
+ *          The tag being allocated from, pages of other tags are ignored
  */
-void ObjectAllocator::Free(void* Object)
+void ObjectAllocator::PreferNear(const void* hint, unsigned tag)
 {
-    uint8_t* objBlock = reinterpret_cast<uint8_t*>(Object);
-
     if (config.UseCPPMemManager_)
-    {
-        //update stats
-        UpdateDeallocationStats(stats);
-        delete[] objBlock;
         return;
-    }
-    if (objBlock)
+
+    const uint8_t* hintBlock = static_cast<const uint8_t*>(hint);
+    const size_t slot = FindPageSlot(hintBlock);
+    if (slot == NO_SLOT || pageSlots[slot].tag != tag)
+        return;
+    SwitchTag(tag);
+
+    const uint8_t* page = reinterpret_cast<const uint8_t*>(pageSlots[slot].page);
+
+    if (!config.PlacementHints_)
     {
-        // debug check
-        if (config.DebugOn_)
+        GenericObject* prev = nullptr;
+        GenericObject* block = freeList;
+        for (unsigned i = 0; block && i < nearSearchLimit; ++i)
         {
-            if (IsMemoryFreed(objBlock))
+            const uint8_t* blockMem = reinterpret_cast<const uint8_t*>(block);
+            if (blockMem >= page && blockMem < page + stats.PageSize_)
             {
-                throw OAException(OAException::E_MULTIPLE_FREE, "Double Free Detected: Memory is already freed\n");
+                if (prev)//move to the head
+                {
+                    if (sharedRegion)
+                        SetInFlight(block);
+                    SetNextFree(prev, NextFree(block));
+                    SetNextFree(block, freeList);
+                    SetFreeList(block);
+                }
+                return;
             }
+            prev = block;
+            block = NextFree(block);
+        }
+        return;
+    }
+
+    //a clear bit could be a deferred block, which isn't on the free list
+    if (pageSlots[slot].deferred)
+        return;
+
+    //a pending page's blocks aren't on the free list yet, refill the next one instead
+    if (pageSlots[slot].pending)
+    {
+        if (pendingSlots.back() != slot)
+        {
+            //another page is partly refilled, it must be finished first
+            if (pendingBlock)
+                return;
+            auto pending = std::find(pendingSlots.begin(), pendingSlots.end(), slot);
+            std::rotate(pending, pending + 1, pendingSlots.end());
+        }
+        RefillFromPending();
+        return;
+    }
+
+    //every other block whose bit is clear is on the free list
+
+    const uint64_t* words = OccupancyOf(slot);
+    for (size_t w = 0; w < occupancyWords; ++w)
+    {
+        uint64_t freeBits = ~words[w];
+        if (w == occupancyWords - 1 && config.ObjectsPerPage_ % 64 != 0)
+            freeBits &= (uint64_t(1) << (config.ObjectsPerPage_ % 64)) - 1;
+        if (!freeBits)
+            continue;
+
+        GenericObject* block = reinterpret_cast<GenericObject*>(const_cast<uint8_t*>(page) + PageToDataOffset() + (w * 64 + LowestSetBit(freeBits)) * ObjectStride());
+        if (block != freeList)
+        {
+            if (sharedRegion)
+                SetInFlight(block);
+            SetNextFree(PrevFree(block), NextFree(block));
+            SetNextFree(block, freeList);
+            SetFreeList(block);
+        }
+        return;
+    }
+}
+
+/**
+ * @brief   Takes an object from the free list, creating a page if needed.
+ *          Shared by all the allocation entry points
+ * 
+ * @param   Object
+ *          Receives the ptr to the given memoryblock, nullptr on failure
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @param   tag 
+ *          The allocation tag whose pages the object comes from
+ * 
+ * @param   zeroed 
+ *          Zero-fill the object instead of writing the allocated pattern
+ * 
+ * @return  S_OK on success, else the reason the object could not be allocated
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::AllocateBlock(void*& Object, const char* label, unsigned tag, bool zeroed) noexcept
+{
+    Object = nullptr;
+
+    if (config.UseCPPMemManager_)
+    {
+        uint8_t* mem = zeroed ? new (std::nothrow) uint8_t[stats.ObjectSize_]() : new (std::nothrow) uint8_t[stats.ObjectSize_];
+        if (!mem)
+            return S_NO_MEMORY;
+        //update stats
+        UpdateAllocationStats(stats);
+        Object = mem;
+        return S_OK;
+    }
+
+    //PrintFreeList("FreeList:", freeList);
+
+    SwitchTag(tag);
+
+    // out of blocks for more obj, take one left behind by Reset else create new pages
+    //(pending pages may belong to other tags)
+    while (!freeList && RefillFromPending())
+        ;
+    if (!freeList)
+    {
+        if (config.MaxPages_ != 0 && config.MaxPages_ <= stats.PagesInUse_)
+            return S_NO_PAGES;
+        //index links and the reserved range can only reach so many pages
+        if (slotLimit != 0 && slotLimit <= stats.PagesInUse_)
+            return S_NO_PAGES;
+
+        //printf("Create new page\n");
+        OA_STATUS status = CreatePage();
+        if (status != S_OK)
+            return status;
+        //a zero page is handed out through the pending pages
+        if (!freeList)
+            RefillFromPending();
+    }
+
+    //PrintList("B FreeList:", freeList);
+
+    assert(freeList);
+    uint8_t* freeBlock = reinterpret_cast<uint8_t*>(freeList);
+
+    uint8_t* headerBlock = freeBlock; // start ptr to headerblock
+
+    //create external header block before unlinking so a failure leaves the free list intact
+    if (config.HBlockInfo_.type_ == OAConfig::hbExternal)
+    {
+        OA_STATUS status = AllocateExternalHeader(headerBlock, label);
+        if (status != S_OK)
+            return status;
+    }
+
+    SetFreeList(NextFree(freeList));
+
+    //PrintList("A FreeList:", freeList);
+
+    //a pristine block is zero except for its links
+    bool pristineBlock = false;
+    if (!pristine.empty())
+    {
+        const size_t slot = FindPageSlot(freeBlock);
+        const size_t block = FindBlockIndex(slot, freeBlock);
+        uint64_t& word = pristine[slot * occupancyWords + block / 64];
+        const uint64_t bit = uint64_t(1) << (block % 64);
+        pristineBlock = (word & bit) != 0;
+        word &= ~bit;
+    }
+
+    if (!zeroed)
+        memset(freeBlock, ALLOCATED_PATTERN, stats.ObjectSize_);
+    else if (!pristineBlock)
+        memset(freeBlock, 0, stats.ObjectSize_);
+    else
+        memset(freeBlock, 0, std::min<size_t>(stats.ObjectSize_, linkBytes ? linkBytes : ptrSize * (config.PlacementHints_ ? 2 : 1)));
+    if (trackLive.load(std::memory_order_relaxed))
+        SetOccupied(freeBlock, true);
+
+    //update stats
+    UpdateAllocationStats(stats);
+
+    //update headers info if any
+    UpdateHeaderInfo(headerBlock, allocFlag);
+
+    Object = freeBlock;
+    return S_OK;
+}
+
+/**
+ * @brief   Free an object memory allocated by the allocator
+ * 
+ * @param   Object
+ *          The object memory pointer
+ */
+void ObjectAllocator::Free(void* Object)
+{
+    OA_STATUS status = TryFree(Object);
+    if (status != S_OK)
+        ThrowStatus(status);
+}
+
+/**
+ * @brief   Non-throwing version of ObjectAllocator::Free
+ * 
+ * @param   Object
+ *          The object memory pointer
+ * 
+ * @return  S_OK on success, else the reason the object could not be freed
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::TryFree(void* Object) noexcept
+{
+    //no checks to run, so the same as FreeBlock without the optional parts
+    if (plain && Object)
+    {
+        memset(Object, FREED_PATTERN, stats.ObjectSize_);
+        GenericObject* temp = reinterpret_cast<GenericObject*>(Object);
+        temp->Next = freeList;
+        freeList = temp;
+        UpdateDeallocationStats(stats);
+        UpdateHeaderInfo(reinterpret_cast<uint8_t*>(Object), freedFlag);
+        return S_OK;
+    }
+    if (sharedRegion)
+    {
+        LockShared();
+        SetInFlight(Object);
+        OA_STATUS status = FreeBlock(Object);
+        UnlockShared();
+        return status;
+    }
+
+    std::unique_lock<std::mutex> guard = LockThreads();
+    OA_STATUS status = FreeBlock(Object);
+    if (status != S_OK)
+        return status;
+
+    //the object goes straight to the first AllocateAsync caller, if any
+    OAWaiter* ready = waitersHead ? TakeReadyWaiters() : nullptr;
+    if (!ready && threading && threading->waiting)
+        threading->freed.notify_one();
+
+    guard = std::unique_lock<std::mutex>();
+    ResumeWaiters(ready);
+    return status;
+}
+
+/**
+ * @brief   Frees many objects under a single lock
+ * 
+ * @param   Objects 
+ *          The objects to free
+ * 
+ * @param   Count 
+ *          Number of objects
+ * 
+ * @return  Number of objects freed, the ones that fail the debug 
+ *          checks are skipped
+ */
+unsigned ObjectAllocator::FreeBatch(void* const* Objects, size_t Count) noexcept
+{
+    unsigned int counter = 0;
+
+    if (sharedRegion)
+    {
+        for (size_t i = 0; i < Count; ++i)
+            counter += TryFree(Objects[i]) == S_OK;
+        return counter;
+    }
+
+    std::unique_lock<std::mutex> guard = LockThreads();
+    for (size_t i = 0; i < Count; ++i)
+        counter += FreeBlock(Objects[i]) == S_OK;
+
+    if (counter)
+        WakeWaiters(guard);
+    return counter;
+}
+
+/**
+ * @brief   Returns an object to the free list after the debug checks.
+ *          Shared by all the deallocation entry points
+ * 
+ * @param   Object
+ *          The object memory pointer
+ * 
+ * @return  S_OK on success, else the reason the object could not be freed
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::FreeBlock(void* Object) noexcept
+{
+    uint8_t* objBlock = reinterpret_cast<uint8_t*>(Object);
+
+    if (config.UseCPPMemManager_)
+    {
+        //update stats
+        UpdateDeallocationStats(stats);
+        delete[] objBlock;
+        return S_OK;
+    }
+    if (objBlock)
+    {
+        // debug check
+        if (config.DebugOn_)
+        {
+            if (IsMemoryFreed(objBlock))
+                return S_MULTIPLE_FREE;
+
             GenericObject* pageFound = FindPage(objBlock);
-            if (!pageFound)
-            {
-                throw OAException(OAException::E_BAD_BOUNDARY, "Freeing: Out of range memory\n");
-            }
-            if (!IsValidAlignment(objBlock, pageFound))
-            {
-                throw OAException(OAException::E_BAD_BOUNDARY, "Freeing: Valid alignment\n");
-            }
+            if (!pageFound || !IsValidAlignment(objBlock, pageFound))
+                return S_BAD_BOUNDARY;
+
             //check corruption
             if (IsPaddingCorrupted(objBlock))
-            {
-                throw(OAException(OAException::E_CORRUPTED_BLOCK, "MemoryBlock: Corruption detected\n"));
-            }
+                return S_CORRUPTED_BLOCK;
+        }
 
+        //off the bitmap before anything is written, a pointer off the blocks is refused
+        //(unchecked outside debug until the bitmaps are kept, see TrackLive)
+        if (trackLive.load(std::memory_order_relaxed))
+        {
+            OA_STATUS status = SetOccupied(objBlock, false);
+            if (status != S_OK)
+                return status;
         }
 
         //clear to freed pattern
         memset(Object, FREED_PATTERN, stats.ObjectSize_);
 
+        //back on the free list of the page's tag
+        if (!tagFreeLists.empty())
+        {
+            size_t slot = FindPageSlot(objBlock);
+            if (slot != NO_SLOT)
+                SwitchTag(pageSlots[slot].tag);
+        }
 
         //last to prevent overwrite
         GenericObject* temp = reinterpret_cast<GenericObject*>(Object);
-        temp->Next = freeList;
-        freeList = temp;
+        SetNextFree(temp, freeList);
+        SetFreeList(temp);
 
         //update stats
         UpdateDeallocationStats(stats);
@@ -393,6 +1194,7 @@ void ObjectAllocator::Free(void* Object)
         }
 
     }
+    return S_OK;
 }
 
 /**
@@ -405,29 +1207,24 @@ void ObjectAllocator::Free(void* Object)
  * 
  * @param   label 
  *          The string ptr for the external header's label
+ * 
+ * @return  S_OK on success, S_NO_MEMORY if the header could not be allocated
  */
-void ObjectAllocator::AllocateExternalHeader(uint8_t* objBlock, const char* label)
+ObjectAllocator::OA_STATUS ObjectAllocator::AllocateExternalHeader(uint8_t* objBlock, const char* label) noexcept
 {
     uint8_t* headerStart = objBlock - config.PadBytes_ - config.HBlockInfo_.size_;
 
-    MemBlockInfo* infoBlock = nullptr;
-    try
-    {
-        infoBlock = new MemBlockInfo;
-    }
-    catch (const std::bad_alloc&)
-    {
-        throw OAException(OAException::E_NO_MEMORY, "Failed to create ExternalHeader: No system memory available.");
-    }
+    MemBlockInfo* infoBlock = new (std::nothrow) MemBlockInfo;
+    if (!infoBlock)
+        return S_NO_MEMORY;
+
     size_t len = label ? strlen(label) : 0; //strlen
     //allocate for string label
-    try
-    {
-        infoBlock->label = new char[len + 1];
-    }
-    catch (const std::bad_alloc&)
+    infoBlock->label = new (std::nothrow) char[len + 1];
+    if (!infoBlock->label)
     {
-        throw OAException(OAException::E_NO_MEMORY, "Failed to create ExternalHeader: No system memory available.");
+        delete infoBlock;
+        return S_NO_MEMORY;
     }
     //ensure null teminated if label is nullptr
     infoBlock->label[0] = 0;
@@ -438,6 +1235,7 @@ void ObjectAllocator::AllocateExternalHeader(uint8_t* objBlock, const char* labe
     MemBlockInfo** tempHeaderPtr = reinterpret_cast<MemBlockInfo**>(headerStart);
     *tempHeaderPtr = infoBlock;
 
+    return S_OK;
 }
 
 /**
@@ -455,6 +1253,9 @@ void ObjectAllocator::FreeExternalHeader(uint8_t* objBlock)
     uint8_t* headerStart = objBlock - config.PadBytes_ - config.HBlockInfo_.size_;
 
     MemBlockInfo* infoBlock = *reinterpret_cast<MemBlockInfo**>(headerStart);
+    //already freed (FreePage frees the first block's header, free or not)
+    if (!infoBlock)
+        return;
 
     //free text mem
     delete[] infoBlock->label;
@@ -499,11 +1300,12 @@ void ObjectAllocator::UpdateHeaderInfo(uint8_t* objBlock, uint8_t flag)
     case OAConfig::HBLOCK_TYPE::hbExtended:
     {
         headerStart += config.HBlockInfo_.additional_;  //skip user define block
-        //used counter
+        //used counter, skipping 0 when it wraps so no handle encodes to 0
         if (isFromAllocateFunc)
         {
             uint16_t* useCounter = reinterpret_cast<uint16_t*>(headerStart);
-            ++* useCounter;
+            if (++* useCounter == 0)
+                *useCounter = 1;
         }
 
         headerStart += sizeof(uint16_t);
@@ -543,163 +1345,574 @@ void ObjectAllocator::UpdateHeaderInfo(uint8_t* objBlock, uint8_t flag)
  */
 GenericObject* ObjectAllocator::FindPage(uint8_t* objBlock) const
 {
-    // range check
-    uint8_t* page = reinterpret_cast<uint8_t*>(pageList);
-
-    //loop through all pages to check if block is within valid address range
-    while (page)
-    {
-        uint8_t* pageEnd = page + stats.PageSize_;
-
-        if (objBlock >= page && objBlock < pageEnd) //found page
-        {
-            return reinterpret_cast<GenericObject*>(page);
-        }
-
-        page = reinterpret_cast<uint8_t*>(reinterpret_cast<GenericObject*>(page)->Next);
-    }
+    size_t slot = FindPageSlot(objBlock);
 
-    return nullptr;
+    return slot == NO_SLOT ? nullptr : pageSlots[slot].page;
 }
 
 /**
- * @brief   Enquire whether an objectblock is memory 
- *          that has been previously freed
+ * @brief   Finds the directory slot of the page a given object memory 
+ *          block resides in O(1), from the page index entry of the 
+ *          block's granule
  *          
- * @param   objBlock
+ * @param   objBlock 
  *          The pointer to the start of object data block 
  * 
- * @return  true    - memory has been freed previously
- * @return  false   - memory has not been freed previously
+ * @return  The slot of the found page else
+ *          NO_SLOT to indicate not found
  */
-bool ObjectAllocator::IsMemoryFreed(uint8_t* objBlock) const
+size_t ObjectAllocator::FindPageSlot(const uint8_t* objBlock) const
 {
-    GenericObject* currBlock = freeList;
-    GenericObject* obj = reinterpret_cast<GenericObject*>(objBlock);
-    //scan through freeList
-    while (currBlock)
+    if (realTimeArena)
     {
-        if (obj == currBlock) // aldy exist on freeList
-            return true;
-        currBlock = currBlock->Next;
+        //pages sit back to back in the order they were created, which is slot order
+        if (objBlock < realTimeArena)
+            return NO_SLOT;
+        size_t offset = static_cast<size_t>(objBlock - realTimeArena);
+        size_t slot = offset / realTimeStride;
+
+        return slot < pageSlots.size() && offset % realTimeStride < stats.PageSize_ ? slot : NO_SLOT;
     }
-    return false;
 
+    if (reservedBase)
+    {
+        //a range compare, the page in slot n is at frame n
+        if (objBlock < reservedBase || objBlock >= reservedBase + reservedSize)
+            return NO_SLOT;
+        size_t offset = static_cast<size_t>(objBlock - reservedBase);
+        size_t slot = offset / reservedStride;
+
+        return slot < pageSlots.size() && pageSlots[slot].page && offset % reservedStride < stats.PageSize_ ? slot : NO_SLOT;
+    }
+
+    if (pageIndex.empty())
+        return NO_SLOT;
+
+    //the pages touching the block's granule, one of them holds it if any does
+    const uintptr_t granule = reinterpret_cast<uintptr_t>(objBlock) >> granuleShift;
+    const size_t mask = pageIndex.size() - 1;
+    for (size_t i = PageIndexHome(granule); pageIndex[i].granule; i = (i + 1) & mask)
+    {
+        if (pageIndex[i].granule != granule)
+            continue;
+
+        for (uint32_t entry : pageIndex[i].slots)
+        {
+            const uint8_t* page = entry ? reinterpret_cast<const uint8_t*>(pageSlots[entry - 1].page) : nullptr;
+            if (page && objBlock >= page && objBlock < page + stats.PageSize_)
+                return entry - 1;
+        }
+        return NO_SLOT;
+    }
+    return NO_SLOT;
 }
 
 /**
- * @brief   Enquire whether an objectblock is aligned 
- *          to each other
+ * @brief   Registers a newly created page in the page directory,
+ *          reusing a vacant slot if there is one
  * 
- * @param   objBlock 
- *          The pointer to the start of object data block 
+ * @param   page 
+ *          The new page
  * 
- * @param   pageLocation 
- *          The page the param objBlock resides in
- *          
- * @return  true    - Objectblocks are aligned
- * @return  false   - Objectblocks are not aligned
+ * @return  true    - page registered
+ * @return  false   - out of system memory
  */
-bool ObjectAllocator::IsValidAlignment(uint8_t* objBlock, GenericObject* pageLocation) const
+bool ObjectAllocator::AddPageSlot(GenericObject* page)
 {
-    if (!pageLocation)
-        return false;
-
-    //page first data block section
-    uint8_t* dataBlockStart =
-        reinterpret_cast<uint8_t*>(pageLocation)
-        + ptrSize + config.LeftAlignSize_ + config.HBlockInfo_.size_ + config.PadBytes_;
+    size_t slot = 0;
+    if (reservedBase)//frame and slot match so FindPageSlot is arithmetic
+        slot = static_cast<size_t>(reinterpret_cast<uint8_t*>(page) - reservedBase) / reservedStride;
+    else
+        while (slot < pageSlots.size() && pageSlots[slot].page)
+            ++slot;
 
-    //next object's advancement size
-    size_t objAdvSize = stats.ObjectSize_
-        + config.PadBytes_ * 2 + config.InterAlignSize_ + config.HBlockInfo_.size_;
+    auto pos = std::lower_bound(pageOrder.begin(), pageOrder.end(), page,
+        [this](size_t lhs, const GenericObject* rhs) { return pageSlots[lhs].page < rhs; });
+    const size_t index = static_cast<size_t>(pos - pageOrder.begin());
 
-    size_t actualSize = objBlock - dataBlockStart;
+    try
+    {
+        if (slot >= pageSlots.size())
+        {
+            occupancy.resize((slot + 1) * occupancyWords);
+            if (reservedBase)
+                pristine.resize((slot + 1) * occupancyWords);
+            pageSlots.resize(slot + 1, PageSlot{ nullptr, 0, false, false, false, 0, 0 });
+            //so Reset never has to grow it
+            pendingSlots.reserve(pageSlots.size());
+        }
+        //both grow first so the inserts can't fail halfway
+        pageOrder.reserve(pageOrder.size() + 1);
+        ReservePageIndex();
+        pageOrder.insert(pageOrder.begin() + index, slot);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
 
-    return actualSize % objAdvSize == 0;
+    pageSlots[slot].page = page;
+    IndexPage(slot);
+    pageSlots[slot].touched = false;
+    pageSlots[slot].trimmed = false;
+    pageSlots[slot].pending = false;
+    pageSlots[slot].tag = static_cast<unsigned short>(currentTag);
+    pageSlots[slot].deferred = 0;
+    std::fill_n(OccupancyOf(slot), occupancyWords, 0);
+    if (!pristine.empty())
+        std::fill_n(&pristine[slot * occupancyWords], occupancyWords, 0);
+    return true;
 }
 
 /**
- * @brief   Enquire whether an objectblock's padding has been corrupted
- * 
- * @param   objBlock 
- *          The pointer to the start of object data block 
+ * @brief   Removes a page from the page directory. The slot's epoch
+ *          is bumped so handles into the old page never resolve again
  * 
- * @return  true    - block corrupted
- * @return  false   - block is not corrupted
+ * @param   page 
+ *          The page being freed
  */
-bool ObjectAllocator::IsPaddingCorrupted(uint8_t* objBlock) const
+void ObjectAllocator::RemovePageSlot(GenericObject* page)
 {
-    if (config.PadBytes_ == 0) //early out
-        return false;
-    uint8_t* padStart = objBlock - config.PadBytes_;
-    uint8_t* padEnd = padStart + stats.ObjectSize_ + config.PadBytes_;
+    size_t slot = FindPageSlot(reinterpret_cast<uint8_t*>(page));
+    if (slot == NO_SLOT)
+        return;
 
-    for (size_t i = 0; i < config.PadBytes_; ++i)
-    {
-        if (padStart[i] != PAD_PATTERN)
-            return true;
-        if (padEnd[i] != PAD_PATTERN)
-            return true;
-    }
-    return false;
+    pageOrder.erase(std::find(pageOrder.begin(), pageOrder.end(), slot));
+    UnindexPage(slot);
+    pageSlots[slot].page = nullptr;
+    ++pageSlots[slot].epoch;
+    std::fill_n(OccupancyOf(slot), occupancyWords, 0);
 }
 
 /**
- * @brief   Enquire whether an objectblock is allocated to client(in-use)
- *              
- * @param   objBlock 
- *          The pointer to the start of object data block
+ * @brief   First entry of the page index to probe for a granule 
+ *          (Fibonacci hashing, pages are often a granule apart)
  * 
- * @return  true    - In use
- * @return  false   - Not in use
+ * @param   granule 
+ *          An address shifted right by granuleShift
+ * 
+ * @return  The index of the entry
  */
-bool ObjectAllocator::IsObjectBlockInUse(uint8_t* objBlock) const
+size_t ObjectAllocator::PageIndexHome(uintptr_t granule) const
+{
+    return static_cast<size_t>((static_cast<uint64_t>(granule) * 0x9E3779B97F4A7C15ull) >> 32) & (pageIndex.size() - 1);
+}
+
+/**
+ * @brief   Grows the page index (keeping it at most half full) so 
+ *          the granules of one more page can be added by IndexPage 
+ *          without allocating
+ */
+void ObjectAllocator::ReservePageIndex()
 {
-    bool usedFlag = false;
-    //read header info if available
-    if (config.HBlockInfo_.type_ != OAConfig::hbNone)
+    //a page touches at most ceil(PageSize_ / granule) + 1 <= 3 granules
+    if ((pageIndexUsed + 3) * 2 <= pageIndex.size())
+        return;
+
+    std::vector<PageGranule> old(std::max<size_t>(pageIndex.size() * 2, 16), PageGranule{ 0, { 0, 0 } });
+    old.swap(pageIndex);
+    const size_t mask = pageIndex.size() - 1;
+    for (const PageGranule& entry : old)
     {
-        uint8_t* headerStart = objBlock - config.PadBytes_ - config.HBlockInfo_.size_;
+        if (!entry.granule)
+            continue;
+        size_t i = PageIndexHome(entry.granule);
+        while (pageIndex[i].granule)
+            i = (i + 1) & mask;
+        pageIndex[i] = entry;
+    }
+}
 
-        switch (config.HBlockInfo_.type_)
-        {
-        case OAConfig::HBLOCK_TYPE::hbBasic:
-        {
-            headerStart += sizeof(uint32_t);
-            //flag bit
-            usedFlag = *headerStart;
-            break;
-        }
-        case OAConfig::HBLOCK_TYPE::hbExtended:
+/**
+ * @brief   Adds a page to the entries of the granules it touches
+ * 
+ * @param   slot 
+ *          The page's directory slot
+ */
+void ObjectAllocator::IndexPage(size_t slot)
+{
+    const uintptr_t start = reinterpret_cast<uintptr_t>(pageSlots[slot].page);
+    const size_t mask = pageIndex.size() - 1;
+
+    for (uintptr_t granule = start >> granuleShift; granule <= (start + stats.PageSize_ - 1) >> granuleShift; ++granule)
+    {
+        size_t i = PageIndexHome(granule);
+        while (pageIndex[i].granule && pageIndex[i].granule != granule)
+            i = (i + 1) & mask;
+
+        if (!pageIndex[i].granule)
         {
-            headerStart += config.HBlockInfo_.additional_;  //skip user define block
-            //skip used counter
-            headerStart += sizeof(uint16_t) + sizeof(uint32_t);
-            //flag bit
-            usedFlag = *headerStart;
-            break;
+            pageIndex[i].granule = granule;
+            ++pageIndexUsed;
         }
-        case OAConfig::HBLOCK_TYPE::hbExternal:
+        pageIndex[i].slots[pageIndex[i].slots[0] ? 1 : 0] = static_cast<uint32_t>(slot + 1);
+    }
+}
+
+/**
+ * @brief   Removes a page from the entries of the granules it 
+ *          touches, freeing the entries no page touches any more
+ *          (the entries after one are shifted back, so probing 
+ *          never needs markers)
+ * 
+ * @param   slot 
+ *          The page's directory slot, its page still set
+ */
+void ObjectAllocator::UnindexPage(size_t slot)
+{
+    const uintptr_t start = reinterpret_cast<uintptr_t>(pageSlots[slot].page);
+    const size_t mask = pageIndex.size() - 1;
+
+    for (uintptr_t granule = start >> granuleShift; granule <= (start + stats.PageSize_ - 1) >> granuleShift; ++granule)
+    {
+        size_t i = PageIndexHome(granule);
+        while (pageIndex[i].granule != granule)
+            i = (i + 1) & mask;
+
+        uint32_t* slots = pageIndex[i].slots;
+        if (slots[0] == slot + 1)
+            slots[0] = slots[1];
+        slots[1] = 0;
+        if (slots[0])
+            continue;
+
+        //backward shift: move up each later entry whose home isn't between the hole and it
+        --pageIndexUsed;
+        for (size_t j = (i + 1) & mask; pageIndex[j].granule; j = (j + 1) & mask)
         {
-            MemBlockInfo* infoBlock = *reinterpret_cast<MemBlockInfo**>(headerStart);
-            if (infoBlock) //if valid
+            const size_t home = PageIndexHome(pageIndex[j].granule);
+            if (((j - home) & mask) >= ((j - i) & mask))
             {
-                usedFlag = infoBlock->in_use;
+                pageIndex[i] = pageIndex[j];
+                i = j;
             }
-            break;
-        }
-        default:
-            break;
         }
+        pageIndex[i] = PageGranule{ 0, { 0, 0 } };
+    }
+}
+
+/**
+ * @brief   Offset from the start of a page to its first object
+ * 
+ * @return  The offset in bytes
+ */
+size_t ObjectAllocator::PageToDataOffset() const
+{
+    return ptrSize + config.LeftAlignSize_ + config.HBlockInfo_.size_ + config.PadBytes_;
+}
+
+/**
+ * @brief   Offset from one object to the next on the same page
+ * 
+ * @return  The offset in bytes
+ */
+size_t ObjectAllocator::ObjectStride() const
+{
+    return stats.ObjectSize_ + config.PadBytes_ * 2 + config.InterAlignSize_ + config.HBlockInfo_.size_;
+}
+
+/**
+ * @brief   Index of an object within a page
+ * 
+ * @param   slot 
+ *          The slot of the page the object resides in
+ * 
+ * @param   objBlock 
+ *          The pointer to the start of object data block 
+ * 
+ * @return  The block index, or NO_BLOCK if the pointer is 
+ *          not on a block boundary
+ */
+size_t ObjectAllocator::FindBlockIndex(size_t slot, const uint8_t* objBlock) const
+{
+    const uint8_t* dataStart = reinterpret_cast<const uint8_t*>(pageSlots[slot].page) + PageToDataOffset();
+    if (objBlock < dataStart)
+        return NO_BLOCK;
+
+    //the index by multiplying, then the boundary check
+    const size_t offset = static_cast<size_t>(objBlock - dataStart);
+    if (offset >= stats.PageSize_)
+        return NO_BLOCK;
+    const size_t block = strideReciprocal ? static_cast<size_t>(MultiplyHigh(strideReciprocal, offset)) : offset;
+    return block * ObjectStride() == offset && block < config.ObjectsPerPage_ ? block : NO_BLOCK;
+}
+
+/**
+ * @brief   Marks an object block as in use / free in the 
+ *          occupancy bitmap of the page it resides in
+ * 
+ * @param   objBlock 
+ *          The pointer to the start of object data block 
+ * 
+ * @param   inUse 
+ *          true if the block was just allocated, false if freed
+ * 
+ * @return  S_OK, or S_BAD_BOUNDARY if objBlock is not the start of a
+ *          block on one of the pages
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::SetOccupied(const uint8_t* objBlock, bool inUse)
+{
+    size_t slot = FindPageSlot(objBlock);
+    if (slot == NO_SLOT)
+        return S_BAD_BOUNDARY;
+    size_t block = FindBlockIndex(slot, objBlock);
+    if (block == NO_BLOCK)
+        return S_BAD_BOUNDARY;
 
+    uint64_t& word = OccupancyOf(slot)[block / 64];
+    const uint64_t bit = uint64_t(1) << (block % 64);
+
+    if (inUse)
+    {
+        word |= bit;
+        pageSlots[slot].touched = true;
     }
-    //else loop through freelist
     else
+        word &= ~bit;
+    return S_OK;
+}
+
+/**
+ * @brief   Makes sure the occupancy bitmaps are kept. Allocate and 
+ *          Free leave them alone until the first call that reads 
+ *          them, which builds them from the free list here
+ */
+void ObjectAllocator::TrackLive() const
+{
+    if (trackLive.load(std::memory_order_acquire))
+        return;
+
+    //readers are const, the bitmaps are bookkeeping
+    ObjectAllocator* self = const_cast<ObjectAllocator*>(this);
+    std::call_once(self->liveOnce, [self]
+    {
+        self->RebuildOccupancy();
+        self->trackLive.store(true, std::memory_order_release);
+        self->UpdatePlain();
+    });
+}
+
+/**
+ * @brief   Builds the occupancy bitmaps: every block is in use 
+ *          unless it is on a free list or on a page pending refill.
+ *          Pages count as touched, as their history is not known
+ */
+void ObjectAllocator::RebuildOccupancy()
+{
+    if (config.UseCPPMemManager_)
+        return;
+
+    const size_t tailBits = config.ObjectsPerPage_ % 64;
+    for (size_t slot : pageOrder)
+    {
+        uint64_t* words = OccupancyOf(slot);
+        std::fill_n(words, occupancyWords, UINT64_MAX);
+        if (tailBits != 0)
+            words[occupancyWords - 1] = (uint64_t(1) << tailBits) - 1;
+        pageSlots[slot].touched = true;
+    }
+
+    //blocks below pendingBlock of the last pending page are already on the free list
+    for (size_t i = 0; i < pendingSlots.size(); ++i)
+    {
+        uint64_t* words = OccupancyOf(pendingSlots[i]);
+        const size_t first = i + 1 == pendingSlots.size() ? pendingBlock : 0;
+        for (size_t block = first; block < config.ObjectsPerPage_; ++block)
+            words[block / 64] &= ~(uint64_t(1) << (block % 64));
+    }
+
+    const unsigned tag = currentTag;
+    const size_t tags = std::max<size_t>(tagFreeLists.size(), 1);
+    for (size_t t = 0; t < tags; ++t)
+    {
+        if (!tagFreeLists.empty())
+            SwitchTag(static_cast<unsigned>(t));
+        for (GenericObject* block = freeList; block; block = NextFree(block))
+        {
+            const uint8_t* objBlock = reinterpret_cast<const uint8_t*>(block);
+            const size_t slot = FindPageSlot(objBlock);
+            const size_t index = FindBlockIndex(slot, objBlock);
+            OccupancyOf(slot)[index / 64] &= ~(uint64_t(1) << (index % 64));
+        }
+    }
+    if (!tagFreeLists.empty())
+        SwitchTag(tag);
+}
+
+/**
+ * @brief   Creates a generational handle to an allocated object. 
+ *          The generation is the use counter of the extended header,
+ *          so handles are only available with hbExtended headers
+ * 
+ * @param   Object 
+ *          The allocated object
+ * 
+ * @return  The handle, or 0 if the object is not an allocated 
+ *          block of this allocator
+ */
+OAHandle ObjectAllocator::GetHandle(const void* Object) const
+{
+    std::unique_lock<std::mutex> guard = LockThreads();
+    if (config.HBlockInfo_.type_ != OAConfig::hbExtended || config.UseCPPMemManager_)
+        return 0;
+
+    const uint8_t* objBlock = reinterpret_cast<const uint8_t*>(Object);
+    size_t slot = FindPageSlot(objBlock);
+    if (slot == NO_SLOT || slot > handleFieldMask)
+        return 0;
+
+    size_t block = FindBlockIndex(slot, objBlock);
+    if (block == NO_BLOCK || block > handleFieldMask)
+        return 0;
+
+    uint8_t* mutBlock = const_cast<uint8_t*>(objBlock);
+    if (!IsObjectBlockInUse(mutBlock))
+        return 0;
+
+    //use counter sits after the user-defined bytes
+    const uint8_t* headerStart = objBlock - config.PadBytes_ - config.HBlockInfo_.size_;
+    uint16_t generation = *reinterpret_cast<const uint16_t*>(headerStart + config.HBlockInfo_.additional_);
+
+    return static_cast<uint64_t>(generation)
+        | static_cast<uint64_t>(block) << handleFieldBits
+        | static_cast<uint64_t>(slot) << (handleFieldBits * 2)
+        | static_cast<uint64_t>(pageSlots[slot].epoch) << (handleFieldBits * 3);
+}
+
+/**
+ * @brief   Resolves a handle back into the object it refers to in O(1)
+ * 
+ * @param   handle 
+ *          A handle returned by ObjectAllocator::GetHandle
+ * 
+ * @return  The object, or nullptr if the object (or its page) was 
+ *          freed since the handle was created
+ */
+void* ObjectAllocator::Resolve(OAHandle handle) const
+{
+    std::unique_lock<std::mutex> guard = LockThreads();
+    if (handle == 0 || config.HBlockInfo_.type_ != OAConfig::hbExtended)
+        return nullptr;
+
+    uint16_t generation = static_cast<uint16_t>(handle & handleFieldMask);
+    size_t block = static_cast<size_t>((handle >> handleFieldBits) & handleFieldMask);
+    size_t slot = static_cast<size_t>((handle >> (handleFieldBits * 2)) & handleFieldMask);
+    unsigned short epoch = static_cast<unsigned short>(handle >> (handleFieldBits * 3));
+
+    if (slot >= pageSlots.size() || !pageSlots[slot].page || pageSlots[slot].epoch != epoch)
+        return nullptr;
+    if (block >= config.ObjectsPerPage_)
+        return nullptr;
+
+    uint8_t* objBlock = reinterpret_cast<uint8_t*>(pageSlots[slot].page) + PageToDataOffset() + block * ObjectStride();
+    if (!IsObjectBlockInUse(objBlock))
+        return nullptr;
+
+    const uint8_t* headerStart = objBlock - config.PadBytes_ - config.HBlockInfo_.size_;
+    if (*reinterpret_cast<const uint16_t*>(headerStart + config.HBlockInfo_.additional_) != generation)
+        return nullptr;
+
+    return objBlock;
+}
+
+/**
+ * @brief   Enquire whether an objectblock is memory 
+ *          that has been previously freed
+ *          
+ * @param   objBlock
+ *          The pointer to the start of object data block 
+ * 
+ * @return  true    - memory has been freed previously
+ * @return  false   - memory has not been freed previously
+ */
+bool ObjectAllocator::IsMemoryFreed(uint8_t* objBlock) const
+{
+    TrackLive();
+    //look up the block's bit instead of scanning through freeList
+    size_t slot = FindPageSlot(objBlock);
+    if (slot == NO_SLOT)
+        return false;
+
+    size_t block = FindBlockIndex(slot, objBlock);
+    if (block == NO_BLOCK)
+        return false;
+
+    uint64_t word = OccupancyOf(slot)[block / 64];
+    return ((word >> (block % 64)) & 1u) == 0;
+}
+
+/**
+ * @brief   Enquire whether an objectblock is aligned 
+ *          to each other
+ * 
+ * @param   objBlock 
+ *          The pointer to the start of object data block 
+ * 
+ * @param   pageLocation 
+ *          The page the param objBlock resides in
+ *          
+ * @return  true    - Objectblocks are aligned
+ * @return  false   - Objectblocks are not aligned
+ */
+bool ObjectAllocator::IsValidAlignment(uint8_t* objBlock, GenericObject* pageLocation) const
+{
+    if (!pageLocation)
+        return false;
+
+    //page first data block section
+    uint8_t* dataBlockStart =
+        reinterpret_cast<uint8_t*>(pageLocation)
+        + ptrSize + config.LeftAlignSize_ + config.HBlockInfo_.size_ + config.PadBytes_;
+
+    //next object's advancement size
+    size_t objAdvSize = stats.ObjectSize_
+        + config.PadBytes_ * 2 + config.InterAlignSize_ + config.HBlockInfo_.size_;
+
+    size_t actualSize = objBlock - dataBlockStart;
+
+    return actualSize % objAdvSize == 0;
+}
+
+/**
+ * @brief   Enquire whether an objectblock's padding has been corrupted
+ * 
+ * @param   objBlock 
+ *          The pointer to the start of object data block 
+ * 
+ * @return  true    - block corrupted
+ * @return  false   - block is not corrupted
+ */
+bool ObjectAllocator::IsPaddingCorrupted(uint8_t* objBlock) const
+{
+    if (config.PadBytes_ == 0) //early out
+        return false;
+    uint8_t* padStart = objBlock - config.PadBytes_;
+    uint8_t* padEnd = padStart + stats.ObjectSize_ + config.PadBytes_;
+
+    for (size_t i = 0; i < config.PadBytes_; ++i)
     {
-        usedFlag = !IsMemoryFreed(objBlock);
+        if (padStart[i] != PAD_PATTERN)
+            return true;
+        if (padEnd[i] != PAD_PATTERN)
+            return true;
     }
-    return usedFlag;
+    return false;
+}
+
+/**
+ * @brief   Enquire whether an objectblock is allocated to client(in-use).
+ *          The occupancy bitmap is authoritative, block headers are 
+ *          not rewritten by Reset outside of debug mode
+ *              
+ * @param   objBlock 
+ *          The pointer to the start of object data block
+ * 
+ * @return  true    - In use
+ * @return  false   - Not in use
+ */
+bool ObjectAllocator::IsObjectBlockInUse(uint8_t* objBlock) const
+{
+    return !IsMemoryFreed(objBlock);
 }
 
 /**
@@ -712,6 +1925,7 @@ bool ObjectAllocator::IsObjectBlockInUse(uint8_t* objBlock) const
  */
 unsigned ObjectAllocator::DumpMemoryInUse(DUMPCALLBACK fn) const
 {
+    std::unique_lock<std::mutex> guard = LockThreads();
     unsigned int counter = 0;
 
     GenericObject* page = pageList;
@@ -742,7 +1956,7 @@ unsigned ObjectAllocator::DumpMemoryInUse(DUMPCALLBACK fn) const
             }
 
         }
-        page = page->Next;
+        page = NextOf(page);
     }
     return counter;
 }
@@ -758,6 +1972,7 @@ unsigned ObjectAllocator::DumpMemoryInUse(DUMPCALLBACK fn) const
  */
 unsigned ObjectAllocator::ValidatePages(VALIDATECALLBACK fn) const
 {
+    std::unique_lock<std::mutex> guard = LockThreads();
     unsigned int counter = 0;
 
     if (config.PadBytes_ > 0)
@@ -773,6 +1988,13 @@ unsigned ObjectAllocator::ValidatePages(VALIDATECALLBACK fn) const
         {
             uint8_t* objData = reinterpret_cast<uint8_t*>(page) + pageToDataAdv;
 
+            //a trimmed page has no blocks to check until it is reused
+            if (pageSlots[FindPageSlot(objData)].trimmed)
+            {
+                page = NextOf(page);
+                continue;
+            }
+
             for (size_t i = 0; i < config.ObjectsPerPage_; ++i)
             {
                 if (IsPaddingCorrupted(objData))
@@ -787,76 +2009,247 @@ unsigned ObjectAllocator::ValidatePages(VALIDATECALLBACK fn) const
                 }
 
             }
-            page = page->Next;
+            page = NextOf(page);
         }
     }
     return counter;
 }
 
 /**
- * @brief   Helper function to free a page in the allocator
- *          
- * @param   currPage 
- *          The page to free
- * @param   prevPage 
- *          The previous page before the param currPage
+ * @brief   Appends a record to a heap snapshot image
+ * 
+ * @param   image 
+ *          The image being built
+ * 
+ * @param   bytes 
+ *          Start of the record
+ * 
+ * @param   size 
+ *          Size of the record in bytes
  */
-void ObjectAllocator::FreePage(GenericObject*& currPage, GenericObject* prevPage )
+static void AppendSnapshot(std::vector<uint8_t>& image, const void* bytes, size_t size)
 {
-	if (!currPage)
-		return;
+    const uint8_t* start = static_cast<const uint8_t*>(bytes);
+    image.insert(image.end(), start, start + size);
+}
 
-	uint8_t* rawMem = reinterpret_cast<uint8_t*>(currPage);
-	uint8_t* objMem = rawMem + ptrSize + config.LeftAlignSize_ + config.HBlockInfo_.size_ + config.PadBytes_;
-	if (config.HBlockInfo_.type_ == OAConfig::hbExternal)
-	{
-		FreeExternalHeader(objMem);
-	}
-	const size_t objAdvSize = stats.ObjectSize_ + config.PadBytes_ * 2 + config.InterAlignSize_ + config.HBlockInfo_.size_;
+/**
+ * @brief   Writes a heap snapshot for offline analysis. The state is 
+ *          streamed into an in-memory image while the lock is held, 
+ *          which takes one pass over the pages and no I/O, and the 
+ *          image is written to the file after the lock is released
+ * 
+ * @param   path 
+ *          The file to create (replaced if it exists)
+ * 
+ * @return  true if the whole snapshot was written
+ */
+bool ObjectAllocator::WriteSnapshot(const char* path) const
+{
+    std::vector<uint8_t> image;
+    try
+    {
+        std::unique_lock<std::mutex> guard = LockThreads();
+        CaptureSnapshot(image);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
 
-	GenericObject* currFreeBlock = freeList;
-	GenericObject* prevFreeBlock = nullptr;
-	//PrintList("List:", freeList);
-	uint32_t objFreed = 0;
-	while (currFreeBlock)
-	{
-		//serach in page for address
-		for (size_t i = 0; i < config.ObjectsPerPage_; ++i)
-		{
-			if (currFreeBlock == reinterpret_cast<GenericObject*>(objMem))
-			{
-				if (prevFreeBlock)// not head
-				{
-					prevFreeBlock->Next = currFreeBlock->Next;
-				}
-				else
-				{
-					freeList = currFreeBlock->Next;
-					currFreeBlock = freeList;
-				}
-				++objFreed;
-			}
-			if (i != config.ObjectsPerPage_ - 1)
-				objMem += objAdvSize;
-		}
-		if (objFreed == config.ObjectsPerPage_) //early out
-			break;
+    std::FILE* file = std::fopen(path, "wb");
+    if (!file)
+        return false;
 
-		prevFreeBlock = currFreeBlock;
-		if (currFreeBlock)
-			currFreeBlock = currFreeBlock->Next;
-	}
+    const bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size();
+    return std::fclose(file) == 0 && written;
+}
+
+/**
+ * @brief   Copies the allocator state into a heap snapshot image
+ *          (see OASnapshotHeader for the layout)
+ * 
+ * @param   image 
+ *          Receives the snapshot
+ */
+void ObjectAllocator::CaptureSnapshot(std::vector<uint8_t>& image) const
+{
+    TrackLive();
+    const OAConfig::HBLOCK_TYPE headerType = config.HBlockInfo_.type_;
+    const size_t dataOffset = PageToDataOffset();
+    const size_t stride = ObjectStride();
+    const size_t bitmapBytes = occupancyWords * sizeof(uint64_t);
+
+    OASnapshotHeader header{};
+    header.magic_ = OA_SNAPSHOT_MAGIC;
+    header.version_ = OA_SNAPSHOT_VERSION;
+    header.headerType_ = static_cast<uint32_t>(headerType);
+    header.objectSize_ = stats.ObjectSize_;
+    header.pageSize_ = stats.PageSize_;
+    header.dataOffset_ = dataOffset;
+    header.objectStride_ = stride;
+    header.objectsPerPage_ = config.ObjectsPerPage_;
+    header.occupancyWords_ = static_cast<uint32_t>(occupancyWords);
+    header.pageCount_ = static_cast<uint32_t>(pageOrder.size());
+    header.overheadBytes_ = pageOrder.size() * (stats.PageSize_ - config.ObjectsPerPage_ * stats.ObjectSize_);
+    header.allocations_ = stats.Allocations_;
+    header.deallocations_ = stats.Deallocations_;
+    header.mostObjects_ = stats.MostObjects_;
+    header.objectsInUse_ = stats.ObjectsInUse_;
+    header.freeObjects_ = stats.FreeObjects_;
+
+    //all but the labels is known up front, the header is filled in last
+    image.reserve(sizeof(header) + pageOrder.size() * (sizeof(OASnapshotPage) + 2 * bitmapBytes)
+        + stats.ObjectsInUse_ * sizeof(OASnapshotBlock));
+    image.resize(sizeof(header));
+
+    std::unordered_map<std::string, uint32_t> labelIds;
+    std::vector<const char*> labels;
+    std::vector<uint64_t> headerBits(occupancyWords);
+
+    for (size_t slot : pageOrder)
+    {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(pageSlots[slot].page) + dataOffset;
+        const uint64_t* words = OccupancyOf(slot);
+
+        OASnapshotPage page{ reinterpret_cast<uintptr_t>(pageSlots[slot].page), 0, pageSlots[slot].tag };
+        for (size_t w = 0; w < occupancyWords; ++w)
+            for (uint64_t bits = words[w]; bits; bits &= bits - 1)
+                ++page.liveCount_;
+
+        //the in-use flag of every block's header (a trimmed page's headers are gone)
+        std::fill(headerBits.begin(), headerBits.end(), 0);
+        if (headerType != OAConfig::hbNone && !pageSlots[slot].trimmed)
+        {
+            for (size_t block = 0; block < config.ObjectsPerPage_; ++block)
+            {
+                const uint8_t* headerStart = data + block * stride - config.PadBytes_ - config.HBlockInfo_.size_;
+                bool inUse = false;
+                if (headerType == OAConfig::hbExternal)
+                {
+                    const MemBlockInfo* info;
+                    memcpy(&info, headerStart, sizeof(info));
+                    inUse = info && info->in_use;
+                }
+                else
+                {
+                    const size_t flagOffset = headerType == OAConfig::hbBasic
+                        ? sizeof(uint32_t) : config.HBlockInfo_.additional_ + sizeof(uint16_t) + sizeof(uint32_t);
+                    inUse = headerStart[flagOffset] == allocFlag;
+                }
+                if (inUse)
+                    headerBits[block / 64] |= uint64_t(1) << (block % 64);
+            }
+        }
+
+        AppendSnapshot(image, &page, sizeof(page));
+        AppendSnapshot(image, words, bitmapBytes);
+        AppendSnapshot(image, headerBits.data(), bitmapBytes);
+
+        for (size_t w = 0; w < occupancyWords; ++w)
+        {
+            for (uint64_t bits = words[w]; bits; bits &= bits - 1)
+            {
+                OASnapshotBlock record{ static_cast<uint32_t>(w * 64 + LowestSetBit(bits)), 0, 0 };
+                const uint8_t* headerStart = data + record.index_ * stride - config.PadBytes_ - config.HBlockInfo_.size_;
+
+                if (headerType == OAConfig::hbBasic)
+                    memcpy(&record.allocNum_, headerStart, sizeof(uint32_t));
+                else if (headerType == OAConfig::hbExtended)
+                    memcpy(&record.allocNum_, headerStart + config.HBlockInfo_.additional_ + sizeof(uint16_t), sizeof(uint32_t));
+                else if (headerType == OAConfig::hbExternal)
+                {
+                    const MemBlockInfo* info;
+                    memcpy(&info, headerStart, sizeof(info));
+                    if (info)
+                    {
+                        record.allocNum_ = info->alloc_num;
+                        header.overheadBytes_ += sizeof(MemBlockInfo) + (info->label ? strlen(info->label) + 1 : 0);
+                        if (info->label)
+                        {
+                            auto inserted = labelIds.emplace(info->label, static_cast<uint32_t>(labels.size() + 1));
+                            if (inserted.second)
+                                labels.push_back(info->label);
+                            record.label_ = inserted.first->second;
+                        }
+                    }
+                }
+                AppendSnapshot(image, &record, sizeof(record));
+            }
+        }
+    }
+
+    header.labelCount_ = static_cast<uint32_t>(labels.size());
+    for (const char* label : labels)
+    {
+        const uint32_t length = static_cast<uint32_t>(strlen(label));
+        AppendSnapshot(image, &length, sizeof(length));
+        AppendSnapshot(image, label, length);
+    }
+
+    memcpy(image.data(), &header, sizeof(header));
+}
+
+/**
+ * @brief   Helper function to free a page in the allocator
+ *          
+ * @param   currPage 
+ *          The page to free
+ * @param   prevPage 
+ *          The previous page before the param currPage
+ * @param   listed 
+ *          Number of the page's blocks on the free list (fewer than 
+ *          ObjectsPerPage_ if it is pending)
+ */
+void ObjectAllocator::FreePage(GenericObject*& currPage, GenericObject* prevPage, size_t listed)
+{
+	if (!currPage)
+		return;
 
+	uint8_t* rawMem = reinterpret_cast<uint8_t*>(currPage);
+	uint8_t* objMem = rawMem + ptrSize + config.LeftAlignSize_ + config.HBlockInfo_.size_ + config.PadBytes_;
+	if (config.HBlockInfo_.type_ == OAConfig::hbExternal)
+	{
+		FreeExternalHeader(objMem);
+	}
+	GenericObject* currFreeBlock = freeList;
+	GenericObject* prevFreeBlock = nullptr;
+	//PrintList("List:", freeList);
+	uint32_t objFreed = 0;
+	uint8_t* pageEnd = rawMem + stats.PageSize_;
+	while (currFreeBlock && objFreed < listed)
+	{
+		GenericObject* nextFreeBlock = NextFree(currFreeBlock);
+
+		//block lies in the page, unlink it (blocks can be in any order)
+		uint8_t* blockMem = reinterpret_cast<uint8_t*>(currFreeBlock);
+		if (blockMem >= rawMem && blockMem < pageEnd)
+		{
+			if (prevFreeBlock)// not head
+				SetNextFree(prevFreeBlock, nextFreeBlock);
+			else
+				SetFreeList(nextFreeBlock);
+
+			++objFreed;
+		}
+		else
+		{
+			prevFreeBlock = currFreeBlock;
+		}
+		currFreeBlock = nextFreeBlock;
+	}
+	//after the walk, index links still resolve through the page's slot
+	RemovePageSlot(currPage);
 
 	if (prevPage)// not head
 	{
-		prevPage->Next = currPage->Next;
+		SetNext(prevPage, NextOf(currPage));
 		//update the currPage in freeemptypage function
-		currPage = currPage->Next;
+		currPage = NextOf(currPage);
 	}
 	else
 	{
-		pageList = currPage->Next;
+		SetPageList(NextOf(currPage));
 		//update the currPage in freeemptypage function
 		currPage = pageList;
 	}
@@ -875,8 +2268,39 @@ void ObjectAllocator::FreePage(GenericObject*& currPage, GenericObject* prevPage
  * @return  Number of freed pages 
  */
 unsigned ObjectAllocator::FreeEmptyPages()
+{
+	if (config.RealTime_)
+		return 0;
+
+	std::unique_lock<std::mutex> guard = LockThreads();
+	unsigned freed = 0;
+	if (ReclaimEmptyPages(0, freed) != S_OK)
+		throw OAException(OAException::E_NO_MEMORY, "Failed to create memory queue: No system memory available.");
+	return freed;
+}
+
+/**
+ * @brief   Frees empty pages as long as at least keepFree objects 
+ *          stay free. Never throws, so the maintenance thread can 
+ *          call it
+ * 
+ * @param   keepFree 
+ *          Number of free objects to keep
+ * 
+ * @param   freed 
+ *          Receives the number of freed pages
+ * 
+ * @return  S_OK, or S_NO_MEMORY if the memory queue could not be 
+ *          created (no page is freed)
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::ReclaimEmptyPages(unsigned keepFree, unsigned& freed) noexcept
 {
 	unsigned int counter = 0;
+	freed = 0;
+
+	//other processes may be using any page of a shared allocator
+	if (sharedRegion)
+		return S_OK;
 
 	GenericObject* currPage = pageList;
 	GenericObject* prevPage = nullptr;
@@ -887,16 +2311,9 @@ unsigned ObjectAllocator::FreeEmptyPages()
 	//offset to next obj
 	const size_t objAdvancement =
 		stats.ObjectSize_ + config.PadBytes_ * 2 + config.InterAlignSize_ + config.HBlockInfo_.size_;
-	uint8_t** memQueue = nullptr;
-	
-	try
-	{
-		memQueue = new uint8_t*[stats.PagesInUse_];
-	}
-	catch (const std::bad_alloc&)
-	{
-		throw OAException(OAException::E_NO_MEMORY, "Failed to create memory queue: No system memory available.");
-	}
+	uint8_t** memQueue = new (std::nothrow) uint8_t*[stats.PagesInUse_];
+	if (!memQueue)
+		return S_NO_MEMORY;
 
 
 	while (currPage)
@@ -917,11 +2334,28 @@ unsigned ObjectAllocator::FreeEmptyPages()
 			}
 
 		}
-		//no objects in page is used
-		if (objectsIsUse == 0)
+		//no objects in page is used (deferred ones are neither in use nor free yet)
+		const size_t slot = FindPageSlot(reinterpret_cast<uint8_t*>(currPage));
+		if (objectsIsUse == 0 && pageSlots[slot].deferred == 0 && stats.FreeObjects_ >= keepFree + config.ObjectsPerPage_)
 		{
+			//a pending page has only its refilled blocks on the free list
+			//(none if trimmed), the rest are never touched
+			size_t listed = config.ObjectsPerPage_;
+			if (pageSlots[slot].pending)
+			{
+				auto pending = std::find(pendingSlots.begin(), pendingSlots.end(), slot);
+				pageSlots[slot].pending = false;
+				listed = 0;
+				if (pending + 1 == pendingSlots.end())
+					std::swap(listed, pendingBlock);
+				pendingSlots.erase(pending);
+			}
+
+			//its blocks are on the free list of its tag
+			if (!tagFreeLists.empty())
+				SwitchTag(pageSlots[slot].tag);
 			memQueue[counter] = reinterpret_cast<uint8_t*>(currPage);
-			FreePage(currPage, prevPage);	
+			FreePage(currPage, prevPage, listed);	
 			++counter;
 			updatePage = false; //skip update
 		}
@@ -929,15 +2363,2295 @@ unsigned ObjectAllocator::FreeEmptyPages()
 		{
 			prevPage = currPage;
 			if (currPage)
-				currPage = currPage->Next;
+				currPage = NextOf(currPage);
 		}
 		
 	}
 	//free everything at end
 	for (size_t i = 0; i < counter; ++i)
 	{
-		delete[] memQueue[i];
+		ReleasePage(memQueue[i]);
 	}
 	delete[] memQueue;
-	return counter;
-}
\ No newline at end of file
+	freed = counter;
+	return S_OK;
+}
+
+/**
+ * @brief   Hands the next block of the pages emptied by Reset (or 
+ *          trimmed by TrimIdlePages) to the free list. Blocks are 
+ *          given out in address order; a trimmed page has its 
+ *          patterns rewritten when its first block is taken
+ * 
+ * @return  true    - a block was added to the free list
+ * @return  false   - no pages are pending
+ */
+bool ObjectAllocator::RefillFromPending()
+{
+    if (pendingSlots.empty())
+        return false;
+
+    PageSlot& slot = pageSlots[pendingSlots.back()];
+    uint8_t* page = reinterpret_cast<uint8_t*>(slot.page);
+    if (slot.trimmed)
+    {
+        InitPageBlocks(page);
+        slot.trimmed = false;
+        if (!pristine.empty())
+            std::fill_n(&pristine[pendingSlots.back() * occupancyWords], occupancyWords, 0);
+    }
+
+    GenericObject* block = reinterpret_cast<GenericObject*>(page + PageToDataOffset() + pendingBlock * ObjectStride());
+
+    const unsigned tag = currentTag;
+    SwitchTag(slot.tag);
+
+    if (++pendingBlock == config.ObjectsPerPage_)
+    {
+        slot.pending = false;
+        pendingSlots.pop_back();
+        pendingBlock = 0;
+    }
+
+    SetNextFree(block, freeList);
+    SetFreeList(block);
+    SwitchTag(tag);
+    return true;
+}
+
+/**
+ * @brief   Makes freeList the free list of a tag. The list it held
+ *          is kept in tagFreeLists until its tag is switched back to
+ * 
+ * @param   tag 
+ *          The tag to work on (0 if untagged)
+ */
+void ObjectAllocator::SwitchTag(unsigned tag)
+{
+    if (tag == currentTag)
+        return;
+
+    tagFreeLists[currentTag] = freeList;
+    freeList = tagFreeLists[tag];
+    currentTag = tag;
+}
+
+/**
+ * @brief   Puts every block of the pages emptied by Reset 
+ *          on the free list
+ */
+void ObjectAllocator::FlushPending()
+{
+    while (RefillFromPending())
+        ;
+}
+
+/**
+ * @brief   Frees the external headers of every live block and, in 
+ *          debug mode, resets their pattern and header. Outside of 
+ *          debug mode with no external headers the objects are 
+ *          not touched at all
+ */
+void ObjectAllocator::ClearLiveBlocks()
+{
+    const bool external = config.HBlockInfo_.type_ == OAConfig::hbExternal;
+    if (!config.DebugOn_ && !external)
+        return;
+
+    ForEachLive([this, external](void* object)
+        {
+            uint8_t* objBlock = static_cast<uint8_t*>(object);
+            if (config.DebugOn_)
+            {
+                memset(objBlock, FREED_PATTERN, stats.ObjectSize_);
+                UpdateHeaderInfo(objBlock, freedFlag);
+            }
+            if (external)
+            {
+                FreeExternalHeader(objBlock);
+            }
+        });
+}
+
+/**
+ * @brief   Frees every object in the allocator at once while 
+ *          keeping all pages. Costs O(pages): the free list is 
+ *          rebuilt lazily by Allocate, a block at a time (at once 
+ *          in mapped file mode, where it is persisted)
+ */
+void ObjectAllocator::Reset()
+{
+    std::unique_lock<std::mutex> guard = LockThreads();
+    if (config.UseCPPMemManager_ || sharedRegion)
+        return;
+
+    DropDeferred();
+    ClearLiveBlocks();
+
+    std::fill_n(OccupancyOf(0), pageSlots.size() * occupancyWords, 0);
+    SetFreeList(nullptr);
+    std::fill(tagFreeLists.begin(), tagFreeLists.end(), nullptr);
+    //lowest address on top
+    pendingSlots.assign(pageOrder.rbegin(), pageOrder.rend());
+    pendingBlock = 0;
+    for (size_t slot : pageOrder)
+        pageSlots[slot].pending = true;
+    //the mapped file must list every free block in case the process dies before Sync
+    if (regionBase)
+        FlushPending();
+
+    //update stats
+    stats.Deallocations_ += stats.ObjectsInUse_;
+    stats.FreeObjects_ += stats.ObjectsInUse_;
+    stats.ObjectsInUse_ = 0;
+
+    WakeWaiters(guard);
+}
+
+/**
+ * @brief   Frees every object and returns every page to the system.
+ *          Pages are created again on demand by Allocate
+ */
+void ObjectAllocator::Release()
+{
+    std::unique_lock<std::mutex> guard = LockThreads();
+    if (config.UseCPPMemManager_ || sharedRegion || realTimeArena)
+        return;
+
+    DropDeferred();
+    ClearLiveBlocks();
+
+    //retire every slot so outstanding handles go stale
+    for (size_t slot : pageOrder)
+    {
+        pageSlots[slot].page = nullptr;
+        pageSlots[slot].pending = false;
+        ++pageSlots[slot].epoch;
+    }
+    pageOrder.clear();
+    pageIndex.clear();
+    pageIndexUsed = 0;
+    std::fill_n(OccupancyOf(0), pageSlots.size() * occupancyWords, 0);
+    pendingSlots.clear();
+    pendingBlock = 0;
+
+    while (pageList)
+    {
+        GenericObject* next = NextOf(pageList);
+        ReleasePage(reinterpret_cast<uint8_t*>(pageList));
+        SetPageList(next);
+    }
+    SetFreeList(nullptr);
+    std::fill(tagFreeLists.begin(), tagFreeLists.end(), nullptr);
+
+    //update stats
+    stats.Deallocations_ += stats.ObjectsInUse_;
+    stats.ObjectsInUse_ = 0;
+    stats.FreeObjects_ = 0;
+    stats.PagesInUse_ = 0;
+
+    //pages can be created again
+    WakeWaiters(guard);
+}
+
+/**
+ * @brief   Records which objects are currently alive so 
+ *          ObjectAllocator::Rollback can later free the rest
+ * 
+ * @return  The mark 
+ */
+OAMark ObjectAllocator::Mark() const
+{
+    std::unique_lock<std::mutex> guard = LockThreads();
+    TrackLive();
+    OAMark mark;
+    mark.allocations_ = stats.Allocations_;
+
+    try
+    {
+        mark.pages_.reserve(pageSlots.size());
+        mark.epochs_.reserve(pageSlots.size());
+        for (const PageSlot& slot : pageSlots)
+        {
+            mark.pages_.push_back(slot.page);
+            mark.epochs_.push_back(slot.epoch);
+        }
+        mark.occupancy_.assign(OccupancyOf(0), OccupancyOf(pageSlots.size()));
+    }
+    catch (const std::bad_alloc&)
+    {
+        throw OAException(OAException::E_NO_MEMORY, "Failed to create mark: No system memory available.");
+    }
+
+    return mark;
+}
+
+/**
+ * @brief   Frees every object allocated after the mark was taken.
+ *          With headers the allocation number decides, otherwise 
+ *          any block that was not live at the mark is freed (so a 
+ *          block freed and allocated again since then is kept)
+ * 
+ * @param   mark 
+ *          A mark taken from this allocator by ObjectAllocator::Mark
+ * 
+ * @return  Number of objects freed 
+ */
+unsigned ObjectAllocator::Rollback(const OAMark& mark) noexcept
+{
+    std::unique_lock<std::mutex> guard = LockThreads();
+    //a shared allocator's objects may belong to other processes
+    if (config.UseCPPMemManager_ || sharedRegion)
+        return 0;
+    TrackLive();
+
+    unsigned int counter = 0;
+    const bool hasAllocNum = config.HBlockInfo_.type_ != OAConfig::hbNone;
+    const size_t dataOffset = PageToDataOffset();
+    const size_t stride = ObjectStride();
+
+    for (size_t slot : pageOrder)
+    {
+        //the mark only knows this page if it was in the same slot at the time
+        const bool markedPage = slot < mark.pages_.size()
+            && mark.pages_[slot] == pageSlots[slot].page && mark.epochs_[slot] == pageSlots[slot].epoch;
+        uint8_t* dataStart = reinterpret_cast<uint8_t*>(pageSlots[slot].page) + dataOffset;
+
+        for (size_t w = 0; w < occupancyWords; ++w)
+        {
+            uint64_t bits = OccupancyOf(slot)[w];
+            if (markedPage && !hasAllocNum)
+                bits &= ~mark.occupancy_[slot * occupancyWords + w];
+
+            while (bits)
+            {
+                uint8_t* objBlock = dataStart + (w * 64 + LowestSetBit(bits)) * stride;
+                bits &= bits - 1;
+
+                if (hasAllocNum && GetAllocationNumber(objBlock) <= mark.allocations_)
+                    continue;
+                if (FreeBlock(objBlock) == S_OK)
+                    ++counter;
+            }
+        }
+    }
+
+    if (counter)
+        WakeWaiters(guard);
+    return counter;
+}
+
+/**
+ * @brief   Reads the allocation number stored in a block's header
+ * 
+ * @param   objBlock 
+ *          The pointer to the start of object data block
+ * 
+ * @return  The allocation number, 0 if the blocks have no headers
+ */
+unsigned ObjectAllocator::GetAllocationNumber(const uint8_t* objBlock) const
+{
+    const uint8_t* headerStart = objBlock - config.PadBytes_ - config.HBlockInfo_.size_;
+
+    switch (config.HBlockInfo_.type_)
+    {
+    case OAConfig::HBLOCK_TYPE::hbBasic:
+        return *reinterpret_cast<const uint32_t*>(headerStart);
+    case OAConfig::HBLOCK_TYPE::hbExtended:
+        //skip user define block and use counter
+        return *reinterpret_cast<const uint32_t*>(headerStart + config.HBlockInfo_.additional_ + sizeof(uint16_t));
+    case OAConfig::HBLOCK_TYPE::hbExternal:
+    {
+        const MemBlockInfo* infoBlock = *reinterpret_cast<MemBlockInfo* const*>(headerStart);
+        return infoBlock ? infoBlock->alloc_num : 0;
+    }
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief   Reads the link stored in a free block or page. In mapped 
+ *          file mode links are offsets from the start of the mapping
+ * 
+ * @param   node 
+ *          The block or page holding the link
+ * 
+ * @return  The next block or page, nullptr at the end of the list
+ */
+GenericObject* ObjectAllocator::NextOf(const GenericObject* node) const
+{
+    if (!regionBase)
+        return node->Next;
+
+    uintptr_t offset = reinterpret_cast<uintptr_t>(node->Next);
+    return offset ? reinterpret_cast<GenericObject*>(regionBase + offset) : nullptr;
+}
+
+/**
+ * @brief   Reads the link stored in a free block. Blocks too small 
+ *          for a pointer hold a 16/32-bit block index instead
+ * 
+ * @param   block 
+ *          The free block holding the link
+ * 
+ * @return  The next free block, nullptr at the end of the list
+ */
+GenericObject* ObjectAllocator::NextFree(const GenericObject* block) const
+{
+    if (linkBytes == 0)
+        return NextOf(block);
+    return NextFreeByIndex(block);
+}
+
+/**
+ * @brief   Reads the 16/32-bit block index link of a free block
+ * 
+ * @param   block 
+ *          The free block holding the link
+ * 
+ * @return  The next free block, nullptr at the end of the list
+ */
+GenericObject* ObjectAllocator::NextFreeByIndex(const GenericObject* block) const
+{
+    uint32_t link = 0;
+    if (linkBytes == sizeof(uint32_t))
+    {
+        memcpy(&link, block, sizeof(uint32_t));
+    }
+    else
+    {
+        uint16_t shortLink;
+        memcpy(&shortLink, block, sizeof(uint16_t));
+        link = shortLink;
+    }
+    if (link == 0)
+        return nullptr;
+
+    const size_t slot = (link - 1) / config.ObjectsPerPage_;
+    const size_t index = (link - 1) % config.ObjectsPerPage_;
+    return reinterpret_cast<GenericObject*>(reinterpret_cast<uint8_t*>(pageSlots[slot].page) + PageToDataOffset() + index * ObjectStride());
+}
+
+/**
+ * @brief   Writes the link stored in a free block
+ * 
+ * @param   block 
+ *          The free block holding the link
+ * 
+ * @param   next 
+ *          The next free block, nullptr at the end of the list
+ */
+void ObjectAllocator::SetNextFree(GenericObject* block, GenericObject* next)
+{
+    if (config.PlacementHints_ && next)
+        memcpy(reinterpret_cast<uint8_t*>(next) + ptrSize, &block, ptrSize);
+
+    if (linkBytes == 0)
+        SetNext(block, next);
+    else
+        SetNextFreeByIndex(block, next);
+}
+
+/**
+ * @brief   Writes the 16/32-bit block index link of a free block
+ * 
+ * @param   block 
+ *          The free block holding the link
+ * 
+ * @param   next 
+ *          The next free block, nullptr at the end of the list
+ */
+void ObjectAllocator::SetNextFreeByIndex(GenericObject* block, GenericObject* next)
+{
+    uint32_t link = 0;
+    if (next)
+    {
+        const uint8_t* nextBlock = reinterpret_cast<const uint8_t*>(next);
+        const size_t slot = FindPageSlot(nextBlock);
+        link = static_cast<uint32_t>(slot * config.ObjectsPerPage_ + FindBlockIndex(slot, nextBlock) + 1);
+    }
+
+    if (linkBytes == sizeof(uint32_t))
+    {
+        memcpy(block, &link, sizeof(uint32_t));
+    }
+    else
+    {
+        uint16_t shortLink = static_cast<uint16_t>(link);
+        memcpy(block, &shortLink, sizeof(uint16_t));
+    }
+}
+
+/**
+ * @brief   Reads the back link of a free block (PlacementHints_ only)
+ * 
+ * @param   block 
+ *          A block on the free list
+ * 
+ * @return  The free block before it, nullptr if it is the head
+ */
+GenericObject* ObjectAllocator::PrevFree(const GenericObject* block) const
+{
+    GenericObject* prev;
+    memcpy(&prev, reinterpret_cast<const uint8_t*>(block) + ptrSize, ptrSize);
+    return prev;
+}
+
+/**
+ * @brief   Writes the link stored in a free block or page
+ * 
+ * @param   node 
+ *          The block or page holding the link
+ * 
+ * @param   next 
+ *          The next block or page, nullptr at the end of the list
+ */
+void ObjectAllocator::SetNext(GenericObject* node, GenericObject* next)
+{
+    if (!regionBase)
+    {
+        node->Next = next;
+        return;
+    }
+
+    node->Next = reinterpret_cast<GenericObject*>(ToRegionOffset(next));
+}
+
+/**
+ * @brief   Sets the head of the free list, keeping the copy in 
+ *          the mapped file (if any) up to date
+ * 
+ * @param   head 
+ *          The new first free block
+ */
+void ObjectAllocator::SetFreeList(GenericObject* head)
+{
+    if (config.PlacementHints_ && head)
+    {
+        GenericObject* none = nullptr;
+        memcpy(reinterpret_cast<uint8_t*>(head) + ptrSize, &none, ptrSize);
+    }
+
+    freeList = head;
+    if (regionBase)
+        reinterpret_cast<RegionHeader*>(regionBase)->freeListOffset = ToRegionOffset(head);
+}
+
+/**
+ * @brief   Sets the head of the page list, keeping the copy in 
+ *          the mapped file (if any) up to date
+ * 
+ * @param   head 
+ *          The new first page
+ */
+void ObjectAllocator::SetPageList(GenericObject* head)
+{
+    pageList = head;
+    if (regionBase)
+        reinterpret_cast<RegionHeader*>(regionBase)->pageListOffset = ToRegionOffset(head);
+}
+
+/**
+ * @brief   Offset of a pointer from the start of the mapping
+ * 
+ * @param   ptr 
+ *          A pointer into the mapping, or nullptr
+ * 
+ * @return  The offset, 0 for nullptr
+ */
+uint64_t ObjectAllocator::ToRegionOffset(const void* ptr) const
+{
+    return ptr ? static_cast<uint64_t>(reinterpret_cast<const uint8_t*>(ptr) - regionBase) : 0;
+}
+
+/**
+ * @brief   Gets the memory for a new page, from the heap or from
+ *          a free page frame of the mapped file
+ * 
+ * @return  The page memory, nullptr if none is available
+ */
+uint8_t* ObjectAllocator::AcquirePage() noexcept
+{
+    //real-time pages are never given back, so the next one is always at the end
+    if (realTimeArena)
+        return realTimeArena + stats.PagesInUse_ * realTimeStride;
+
+#ifdef OA_HAS_MMAP
+    if (reservedBase)
+    {
+        //the frame of the lowest vacant slot, which AddPageSlot will give the page
+        size_t frame = 0;
+        while (frame < pageSlots.size() && pageSlots[frame].page)
+            ++frame;
+        if ((frame + 1) * reservedStride > reservedSize)
+            return nullptr;
+
+        uint8_t* page = reservedBase + frame * reservedStride;
+        if (mprotect(page, reservedStride, PROT_READ | PROT_WRITE) != 0)
+            return nullptr;
+        return page;
+    }
+#endif
+
+    if (!regionBase)
+    {
+        const size_t footprint = PageFootprint();
+        uint8_t* mem = config.SharePages_ ? OAPageCache::Acquire(footprint) : new (std::nothrow) uint8_t[footprint];
+        if (!mem || colorStep == 0)
+            return mem;
+
+        //the color is kept just before the page for ReleasePage
+        const unsigned color = nextColor.fetch_add(1, std::memory_order_relaxed) % colorCount;
+        uint8_t* page = mem + colorTagSize + color * colorStep;
+        page[-1] = static_cast<uint8_t>(color);
+        return page;
+    }
+
+    for (size_t frame = 0; frame < regionFrameUsed.size(); ++frame)
+    {
+        if (!regionFrameUsed[frame])
+        {
+            regionFrameUsed[frame] = true;
+            return regionBase + regionFrames + frame * regionStride;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief   Returns the memory of a page obtained by AcquirePage
+ * 
+ * @param   page 
+ *          The page memory
+ */
+void ObjectAllocator::ReleasePage(uint8_t* page) noexcept
+{
+    if (realTimeArena)
+        return;
+
+#ifdef OA_HAS_MMAP
+    if (reservedBase)
+    {
+        //decommit, the frame keeps its place in the range
+        madvise(page, reservedStride, MADV_DONTNEED);
+        mprotect(page, reservedStride, PROT_NONE);
+        return;
+    }
+#endif
+
+    if (!regionBase)
+    {
+        if (colorStep != 0)
+            page -= colorTagSize + page[-1] * colorStep;
+
+        if (config.SharePages_)
+            OAPageCache::Release(page, PageFootprint());
+        else
+            delete[] page;
+        return;
+    }
+
+    regionFrameUsed[(page - regionBase - regionFrames) / regionStride] = false;
+}
+
+/**
+ * @brief   Bytes of heap memory behind each page. With Coloring_ a
+ *          page is placed at one of colorCount offsets in its memory
+ * 
+ * @return  The size in bytes
+ */
+size_t ObjectAllocator::PageFootprint() const
+{
+    if (colorStep == 0)
+        return stats.PageSize_;
+
+    return colorTagSize + (colorCount - 1) * colorStep + stats.PageSize_;
+}
+
+/**
+ * @brief   Maps the file backing the allocator, creating it if needed
+ * 
+ * @param   path 
+ *          Path of the file to map
+ * 
+ * @return  true    - an existing allocator was resumed from the file
+ * @return  false   - the file is new and has no pages yet
+ */
+bool ObjectAllocator::OpenMappedFile(const char* path)
+{
+#ifdef OA_HAS_MMAP
+    if (config.UseCPPMemManager_ || config.MaxPages_ == 0 || config.HBlockInfo_.type_ == OAConfig::hbExternal)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to map file: mapped allocators need MaxPages and no external headers.");
+    //index links name pages by slot, which is not kept across runs
+    if (linkBytes != 0)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to map file: objects must be able to hold a pointer.");
+
+    const size_t stride = (stats.PageSize_ + regionFrameAlign - 1) & ~(regionFrameAlign - 1);
+    const size_t size = regionHeaderSize + config.MaxPages_ * stride;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        throw OAException(OAException::E_NO_MEMORY, std::string("Failed to map file: cannot open ") + path);
+
+    struct stat fileInfo;
+    RegionHeader saved{};
+    bool existing = fstat(fd, &fileInfo) == 0 && fileInfo.st_size > 0;
+    if (existing)
+    {
+        if (static_cast<size_t>(fileInfo.st_size) != size
+            || pread(fd, &saved, sizeof(saved), 0) != static_cast<ssize_t>(sizeof(saved)) 
+            || saved.magic != regionMagic)
+        {
+            close(fd);
+            throw OAException(OAException::E_CORRUPTED_BLOCK, std::string("Mapped file: not an allocator of this layout: ") + path);
+        }
+    }
+    else if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        close(fd);
+        throw OAException(OAException::E_NO_MEMORY, std::string("Failed to map file: cannot resize ") + path);
+    }
+
+    //ask for the previous address so pointers between objects stay valid
+    void* hint = existing ? reinterpret_cast<void*>(saved.baseAddress) : nullptr;
+    void* mem = mmap(hint, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+        throw OAException(OAException::E_NO_MEMORY, std::string("Failed to map file: ") + path);
+
+    regionBase = static_cast<uint8_t*>(mem);
+    regionSize = size;
+    regionStride = stride;
+    regionFrames = regionHeaderSize;
+    regionFrameUsed.assign(config.MaxPages_, false);
+
+    RegionHeader* header = reinterpret_cast<RegionHeader*>(regionBase);
+    if (existing)
+    {
+        try
+        {
+            ResumeMappedFile();
+        }
+        catch (...)
+        {
+            munmap(regionBase, regionSize);
+            regionBase = nullptr;
+            throw;
+        }
+    }
+    else
+    {
+        WriteRegionLayout();
+        header->magic = regionMagic;
+    }
+    header->baseAddress = reinterpret_cast<uintptr_t>(regionBase);
+
+    return existing;
+#else
+    (void)path;
+    throw OAException(OAException::E_NO_MEMORY, "Failed to map file: not supported on this platform.");
+#endif
+}
+
+/**
+ * @brief   Rebuilds the allocator from a mapped file, checking that 
+ *          its page list and free list are consistent and that no
+ *          pad bytes were overwritten
+ */
+void ObjectAllocator::ResumeMappedFile()
+{
+    const RegionHeader* header = reinterpret_cast<const RegionHeader*>(regionBase);
+
+    if (!IsRegionLayoutValid())
+        throw OAException(OAException::E_CORRUPTED_BLOCK, "Mapped file: layout does not match the configuration.");
+
+    //every page on the page list starts out fully in use
+    unsigned pages = 0;
+    for (uint64_t offset = header->pageListOffset; offset; )
+    {
+        size_t frame = static_cast<size_t>((offset - regionFrames) / regionStride);
+        if (offset < regionFrames || (offset - regionFrames) % regionStride != 0
+            || frame >= regionFrameUsed.size() || regionFrameUsed[frame])
+        {
+            throw OAException(OAException::E_CORRUPTED_BLOCK, "Mapped file: page list is corrupted.");
+        }
+        regionFrameUsed[frame] = true;
+
+        GenericObject* page = reinterpret_cast<GenericObject*>(regionBase + offset);
+        if (!AddPageSlot(page))
+            throw OAException(OAException::E_NO_MEMORY, "Mapped file: No system memory available.");
+
+        size_t slot = FindPageSlot(reinterpret_cast<uint8_t*>(page));
+        for (size_t block = 0; block < config.ObjectsPerPage_; ++block)
+            OccupancyOf(slot)[block / 64] |= uint64_t(1) << (block % 64);
+
+        offset = reinterpret_cast<uintptr_t>(page->Next);
+        ++pages;
+    }
+
+    //then every block on the free list is cleared (once)
+    unsigned freeObjects = 0;
+    for (uint64_t offset = header->freeListOffset; offset; )
+    {
+        uint8_t* objBlock = regionBase + offset;
+        size_t slot = offset < regionSize ? FindPageSlot(objBlock) : NO_SLOT;
+        size_t block = slot != NO_SLOT ? FindBlockIndex(slot, objBlock) : NO_BLOCK;
+        if (block == NO_BLOCK || IsMemoryFreed(objBlock))
+            throw OAException(OAException::E_CORRUPTED_BLOCK, "Mapped file: free list is corrupted.");
+
+        OccupancyOf(slot)[block / 64] &= ~(uint64_t(1) << (block % 64));
+
+        offset = reinterpret_cast<uintptr_t>(reinterpret_cast<GenericObject*>(objBlock)->Next);
+        ++freeObjects;
+    }
+
+    pageList = header->pageListOffset ? reinterpret_cast<GenericObject*>(regionBase + header->pageListOffset) : nullptr;
+    freeList = header->freeListOffset ? reinterpret_cast<GenericObject*>(regionBase + header->freeListOffset) : nullptr;
+
+    stats.PagesInUse_ = pages;
+    stats.FreeObjects_ = freeObjects;
+    stats.ObjectsInUse_ = pages * config.ObjectsPerPage_ - freeObjects;
+    stats.Allocations_ = header->allocations;
+    stats.Deallocations_ = header->deallocations;
+    stats.MostObjects_ = std::max(header->mostObjects, stats.ObjectsInUse_);
+
+    if (ValidatePages([](const void*, size_t) {}) != 0)
+        throw OAException(OAException::E_CORRUPTED_BLOCK, "Mapped file: pad bytes have been overwritten.");
+}
+
+/**
+ * @brief   Syncs and unmaps the file backing the allocator
+ */
+void ObjectAllocator::CloseMappedFile()
+{
+#ifdef OA_HAS_MMAP
+    if (!regionBase)
+        return;
+
+    Sync();
+    munmap(regionBase, regionSize);
+    regionBase = nullptr;
+    sharedRegion = false;
+#endif
+}
+
+/**
+ * @brief   Writes the allocator state to the mapped file and
+ *          flushes it to disk. Does nothing for heap pages
+ */
+void ObjectAllocator::Sync()
+{
+#ifdef OA_HAS_MMAP
+    //a shared allocator publishes its state after every operation
+    if (!regionBase || sharedRegion)
+        return;
+
+    RegionHeader* header = reinterpret_cast<RegionHeader*>(regionBase);
+    header->allocations = stats.Allocations_;
+    header->deallocations = stats.Deallocations_;
+    header->mostObjects = stats.MostObjects_;
+
+    msync(regionBase, regionSize, MS_SYNC);
+#endif
+}
+
+/**
+ * @brief   Records the client's root object in the mapped file so 
+ *          it can be found again after a restart
+ * 
+ * @param   Object 
+ *          An object of this allocator, or nullptr
+ */
+void ObjectAllocator::SetRoot(const void* Object)
+{
+    if (regionBase)
+        reinterpret_cast<RegionHeader*>(regionBase)->rootOffset = ToRegionOffset(Object);
+}
+
+/**
+ * @brief   Getter for the root object recorded by SetRoot
+ * 
+ * @return  The root object, nullptr if none (or not mapped)
+ */
+void* ObjectAllocator::GetRoot() const
+{
+    if (!regionBase)
+        return nullptr;
+
+    uint64_t offset = reinterpret_cast<const RegionHeader*>(regionBase)->rootOffset;
+    return offset ? regionBase + offset : nullptr;
+}
+
+/**
+ * @brief   Getter for the start of the mapped file
+ * 
+ * @return  The base address, nullptr for heap pages
+ */
+const void* ObjectAllocator::GetRegionBase() const { return regionBase; }
+
+/**
+ * @brief   Getter for the start of the reserved range
+ * 
+ * @return  The base address, nullptr unless Compressed_
+ */
+const void* ObjectAllocator::GetReservedBase() const { return reservedBase; }
+
+/**
+ * @brief   Getter for the size of the reserved range
+ * 
+ * @return  The size in bytes, 0 unless Compressed_
+ */
+size_t ObjectAllocator::GetReservedSize() const { return reservedSize; }
+
+/**
+ * @brief   Writes the layout of the allocator to the mapping's header
+ */
+void ObjectAllocator::WriteRegionLayout()
+{
+    RegionHeader* header = reinterpret_cast<RegionHeader*>(regionBase);
+
+    header->objectSize = stats.ObjectSize_;
+    header->pageSize = stats.PageSize_;
+    header->pageStride = regionStride;
+    header->headerSize = config.HBlockInfo_.size_;
+    header->objectsPerPage = config.ObjectsPerPage_;
+    header->maxPages = config.MaxPages_;
+    header->padBytes = config.PadBytes_;
+    header->headerType = static_cast<uint32_t>(config.HBlockInfo_.type_);
+    header->leftAlignSize = config.LeftAlignSize_;
+    header->interAlignSize = config.InterAlignSize_;
+}
+
+/**
+ * @brief   Enquire whether the mapping's header describes the same 
+ *          layout as this allocator's configuration
+ * 
+ * @return  true    - layouts match
+ * @return  false   - the mapping was created with another configuration
+ */
+bool ObjectAllocator::IsRegionLayoutValid() const
+{
+    const RegionHeader* header = reinterpret_cast<const RegionHeader*>(regionBase);
+
+    return header->objectSize == stats.ObjectSize_ && header->pageSize == stats.PageSize_
+        && header->pageStride == regionStride && header->headerSize == config.HBlockInfo_.size_
+        && header->objectsPerPage == config.ObjectsPerPage_ && header->maxPages == config.MaxPages_
+        && header->padBytes == config.PadBytes_ && header->headerType == static_cast<uint32_t>(config.HBlockInfo_.type_)
+        && header->leftAlignSize == config.LeftAlignSize_ && header->interAlignSize == config.InterAlignSize_;
+}
+
+/**
+ * @brief   Creates or attaches to a pool in a POSIX shared memory 
+ *          object. The segment holds the header (with a process-shared 
+ *          robust mutex), the occupancy bitmaps and MaxPages_ pages, 
+ *          all of which are created up front so every process sees 
+ *          the same page directory. Processes attach at the creator's 
+ *          address when they can; otherwise objects have to be passed 
+ *          between them as offsets from GetRegionBase()
+ * 
+ * @param   name 
+ *          Name of the shared memory object
+ */
+void ObjectAllocator::OpenSharedMemory(const char* name)
+{
+#ifdef OA_HAS_MMAP
+    if (config.UseCPPMemManager_ || config.MaxPages_ == 0 || config.HBlockInfo_.type_ == OAConfig::hbExternal)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to map shared memory: shared allocators need MaxPages and no external headers.");
+
+    const size_t stride = (stats.PageSize_ + regionFrameAlign - 1) & ~(regionFrameAlign - 1);
+    const size_t bitmapBytes = config.MaxPages_ * occupancyWords * sizeof(uint64_t);
+    const size_t frames = (regionHeaderSize + bitmapBytes + regionFrameAlign - 1) & ~(regionFrameAlign - 1);
+    const size_t size = frames + config.MaxPages_ * stride;
+
+    bool creator = true;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST)
+    {
+        creator = false;
+        fd = shm_open(name, O_RDWR, 0600);
+    }
+    if (fd < 0)
+        throw OAException(OAException::E_NO_MEMORY, std::string("Failed to map shared memory: cannot open ") + name);
+
+    if (creator && ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        close(fd);
+        shm_unlink(name);
+        throw OAException(OAException::E_NO_MEMORY, std::string("Failed to map shared memory: cannot resize ") + name);
+    }
+
+    //wait (up to ~5s) for the creator to size the segment
+    struct stat info;
+    for (int tries = 0; !creator && (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < size); ++tries)
+    {
+        const timespec delay = { 0, 1000000 };
+        if (tries == 5000)
+        {
+            close(fd);
+            throw OAException(OAException::E_CORRUPTED_BLOCK, std::string("Shared memory: not an allocator of this layout: ") + name);
+        }
+        nanosleep(&delay, nullptr);
+    }
+
+    //attach at the creator's address if it's free here, so object pointers can be passed around as is
+    RegionHeader saved{};
+    void* hint = nullptr;
+    if (!creator && pread(fd, &saved, sizeof(saved), 0) == static_cast<ssize_t>(sizeof(saved)))
+        hint = reinterpret_cast<void*>(saved.baseAddress);
+
+    void* mem = mmap(hint, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED)
+        throw OAException(OAException::E_NO_MEMORY, std::string("Failed to map shared memory: ") + name);
+
+    regionBase = static_cast<uint8_t*>(mem);
+    regionSize = size;
+    regionStride = stride;
+    regionFrames = frames;
+    regionFrameUsed.assign(config.MaxPages_, false);
+
+    RegionHeader* header = reinterpret_cast<RegionHeader*>(regionBase);
+    if (creator)
+    {
+        WriteRegionLayout();
+        header->baseAddress = reinterpret_cast<uintptr_t>(regionBase);
+
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+        pthread_mutex_init(&header->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+
+        //pages are created in frame order, so slot == frame in every process
+        for (unsigned page = 0; page < config.MaxPages_; ++page)
+        {
+            OA_STATUS status = CreatePage();
+            if (status != S_OK)
+            {
+                munmap(regionBase, regionSize);
+                regionBase = nullptr;
+                shm_unlink(name);
+                ThrowStatus(status);
+            }
+        }
+        header->freeObjects = stats.FreeObjects_;
+        header->objectsInUse = 0;
+
+        __atomic_store_n(&header->magic, regionMagic, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        for (int tries = 0; __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != regionMagic; ++tries)
+        {
+            const timespec delay = { 0, 1000000 };
+            if (tries == 5000)
+                break;
+            nanosleep(&delay, nullptr);
+        }
+        if (header->magic != regionMagic || !IsRegionLayoutValid())
+        {
+            munmap(regionBase, regionSize);
+            regionBase = nullptr;
+            throw OAException(OAException::E_CORRUPTED_BLOCK, std::string("Shared memory: not an allocator of this layout: ") + name);
+        }
+
+        for (size_t frame = 0; frame < config.MaxPages_; ++frame)
+        {
+            regionFrameUsed[frame] = true;
+            if (!AddPageSlot(reinterpret_cast<GenericObject*>(regionBase + frames + frame * stride)))
+            {
+                munmap(regionBase, regionSize);
+                regionBase = nullptr;
+                throw OAException(OAException::E_NO_MEMORY, "Shared memory: No system memory available.");
+            }
+        }
+        stats.PagesInUse_ = config.MaxPages_;
+    }
+
+    //from now on the bitmaps live in the segment
+    sharedOccupancy = reinterpret_cast<uint64_t*>(regionBase + regionHeaderSize);
+    sharedRegion = true;
+#else
+    (void)name;
+    throw OAException(OAException::E_NO_MEMORY, "Failed to map shared memory: not supported on this platform.");
+#endif
+}
+
+/**
+ * @brief   Removes the name of a shared pool so no new process can 
+ *          attach to it. Processes already attached are unaffected
+ * 
+ * @param   name 
+ *          Name of the shared memory object
+ */
+void ObjectAllocator::UnlinkShared(const char* name)
+{
+#ifdef OA_HAS_MMAP
+    shm_unlink(name);
+#else
+    (void)name;
+#endif
+}
+
+/**
+ * @brief   Locks a shared allocator and loads the list heads and 
+ *          stats other processes may have changed. If the previous 
+ *          owner died holding the lock, its state is repaired by 
+ *          RecoverShared before the lock is marked consistent
+ */
+void ObjectAllocator::LockShared() noexcept
+{
+#ifdef OA_HAS_MMAP
+    RegionHeader* header = reinterpret_cast<RegionHeader*>(regionBase);
+
+#ifdef __linux__
+    if (pthread_mutex_lock(&header->lock) == EOWNERDEAD)
+    {
+        RecoverShared();
+        pthread_mutex_consistent(&header->lock);
+    }
+#else
+    pthread_mutex_lock(&header->lock);
+#endif
+
+    freeList = header->freeListOffset ? reinterpret_cast<GenericObject*>(regionBase + header->freeListOffset) : nullptr;
+    pageList = header->pageListOffset ? reinterpret_cast<GenericObject*>(regionBase + header->pageListOffset) : nullptr;
+    stats.FreeObjects_ = header->freeObjects;
+    stats.ObjectsInUse_ = header->objectsInUse;
+    stats.MostObjects_ = header->mostObjects;
+    stats.Allocations_ = header->allocations;
+    stats.Deallocations_ = header->deallocations;
+#endif
+}
+
+/**
+ * @brief   Publishes the stats of a shared allocator and unlocks it 
+ *          (the list heads are published as they change)
+ */
+void ObjectAllocator::UnlockShared() noexcept
+{
+#ifdef OA_HAS_MMAP
+    RegionHeader* header = reinterpret_cast<RegionHeader*>(regionBase);
+
+    header->freeObjects = stats.FreeObjects_;
+    header->objectsInUse = stats.ObjectsInUse_;
+    header->mostObjects = stats.MostObjects_;
+    header->allocations = stats.Allocations_;
+    header->deallocations = stats.Deallocations_;
+    header->inFlightOffset = 0;
+
+    pthread_mutex_unlock(&header->lock);
+#endif
+}
+
+/**
+ * @brief   Records the block a shared Allocate/Free is about to 
+ *          change, so RecoverShared can finish the job if the 
+ *          process dies before UnlockShared
+ * 
+ * @param   block 
+ *          The block, nullptr for none
+ */
+void ObjectAllocator::SetInFlight(const void* block) noexcept
+{
+    reinterpret_cast<RegionHeader*>(regionBase)->inFlightOffset = ToRegionOffset(block);
+}
+
+/**
+ * @brief   Repairs a shared allocator whose last owner died holding 
+ *          the lock, in the spirit of ResumeMappedFile. The bitmaps 
+ *          are taken as the truth:
+ *          - The free list is walked, each block is checked to be a 
+ *            block of a page whose bit is clear and is marked while
+ *            walking, so an allocated block or a cycle is caught. The
+ *            list is cut before the first bad block (the blocks behind
+ *            it stay in use, which leaks them but hands out nothing 
+ *            twice).
+ *          - The block in flight is linked back if its bit is clear
+ *            but it is not on the list: the owner died in Free after
+ *            clearing the bit, or in Allocate after taking the block
+ *            but before setting the bit. With its bit set it stays
+ *            in use (the owner died holding it).
+ *          - FreeObjects/ObjectsInUse are recomputed from the list and
+ *            published. Objects the dead process held, or had given 
+ *            to FreeDeferred, stay in use.
+ */
+void ObjectAllocator::RecoverShared() noexcept
+{
+#ifdef OA_HAS_MMAP
+    RegionHeader* header = reinterpret_cast<RegionHeader*>(regionBase);
+
+    //the word and bit of a block of the segment, nullptr if it is not one
+    const auto bitOf = [this](const void* block, uint64_t& bit) -> uint64_t*
+    {
+        const uint8_t* objBlock = static_cast<const uint8_t*>(block);
+        if (objBlock < regionBase + regionFrames || objBlock >= regionBase + regionSize)
+            return nullptr;
+        const size_t slot = FindPageSlot(objBlock);
+        const size_t index = slot != NO_SLOT ? FindBlockIndex(slot, objBlock) : NO_BLOCK;
+        if (index == NO_BLOCK)
+            return nullptr;
+        bit = uint64_t(1) << (index % 64);
+        return OccupancyOf(slot) + index / 64;
+    };
+
+    freeList = header->freeListOffset ? reinterpret_cast<GenericObject*>(regionBase + header->freeListOffset) : nullptr;
+
+    //mark the listed blocks, stopping at the first that isn't a free block
+    const unsigned blocks = config.MaxPages_ * config.ObjectsPerPage_;
+    unsigned freeObjects = 0;
+    GenericObject* last = nullptr;
+    for (GenericObject* block = freeList; block; )
+    {
+        uint64_t bit = 0;
+        uint64_t* word = freeObjects < blocks ? bitOf(block, bit) : nullptr;
+        if (!word || (*word & bit))
+        {
+            if (last)
+                SetNextFree(last, nullptr);
+            else
+                SetFreeList(nullptr);
+            break;
+        }
+        *word |= bit;
+        ++freeObjects;
+        last = block;
+        block = NextFree(block);
+    }
+
+    //a block in flight that is neither in use nor listed still has its bit clear
+    uint64_t inFlightBit = 0;
+    uint8_t* inFlight = header->inFlightOffset ? regionBase + header->inFlightOffset : nullptr;
+    uint64_t* inFlightWord = inFlight ? bitOf(inFlight, inFlightBit) : nullptr;
+    const bool relink = inFlightWord && !(*inFlightWord & inFlightBit);
+
+    GenericObject* block = freeList;
+    for (unsigned i = 0; i < freeObjects; ++i)
+    {
+        uint64_t bit = 0;
+        *bitOf(block, bit) &= ~bit;
+        block = NextFree(block);
+    }
+
+    if (relink)
+    {
+        memset(inFlight, FREED_PATTERN, stats.ObjectSize_);
+        GenericObject* temp = reinterpret_cast<GenericObject*>(inFlight);
+        SetNextFree(temp, freeList);
+        SetFreeList(temp);
+        UpdateHeaderInfo(inFlight, freedFlag);
+        ++freeObjects;
+    }
+
+    header->freeObjects = freeObjects;
+    header->objectsInUse = blocks - freeObjects;
+    header->mostObjects = std::max(header->mostObjects, header->objectsInUse);
+    header->inFlightOffset = 0;
+#endif
+}
+
+/**
+ * @brief   Occupancy bitmap of the page in a slot
+ * 
+ * @param   slot 
+ *          The page's directory slot
+ * 
+ * @return  The first of its occupancyWords words
+ */
+uint64_t* ObjectAllocator::OccupancyOf(size_t slot)
+{
+    return (sharedOccupancy ? sharedOccupancy : occupancy.data()) + slot * occupancyWords;
+}
+
+/**
+ * @brief   Occupancy bitmap of the page in a slot
+ * 
+ * @param   slot 
+ *          The page's directory slot
+ * 
+ * @return  The first of its occupancyWords words
+ */
+const uint64_t* ObjectAllocator::OccupancyOf(size_t slot) const
+{
+    return (sharedOccupancy ? sharedOccupancy : occupancy.data()) + slot * occupancyWords;
+}
+
+/**
+ * @brief   Gives the physical memory of idle pages back to the system
+ *          while keeping them allocated and on the page list. A page 
+ *          is idle once it has had no objects in use and no 
+ *          allocations since the previous call, so calling this 
+ *          periodically trims pages that stayed empty for a whole 
+ *          period. The blocks of a trimmed page leave the free list 
+ *          and are handed out last, after its patterns are rewritten
+ * 
+ * @param   lazyFree 
+ *          Use MADV_FREE (the system reclaims the memory only under 
+ *          pressure) instead of MADV_DONTNEED where available
+ * 
+ * @return  Number of pages trimmed
+ */
+unsigned ObjectAllocator::TrimIdlePages(bool lazyFree)
+{
+    std::unique_lock<std::mutex> guard = LockThreads();
+    unsigned int counter = 0;
+
+#if defined(OA_HAS_MMAP) && defined(MADV_DONTNEED)
+    //mapped pages must keep their contents, real-time ones must not fault
+    if (config.UseCPPMemManager_ || regionBase || realTimeArena)
+        return 0;
+
+    //pages only count as touched from here on
+    TrackLive();
+    const uintptr_t osPage = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    std::vector<bool> trimming(pageSlots.size(), false);
+
+    for (size_t slot : pageOrder)
+    {
+        PageSlot& pageSlot = pageSlots[slot];
+
+        //give pages used since the last call another period
+        if (pageSlot.touched)
+        {
+            pageSlot.touched = false;
+            continue;
+        }
+        //deferred blocks are off the free list but must stay readable
+        if (pageSlot.trimmed || pageSlot.deferred || std::any_of(OccupancyOf(slot), OccupancyOf(slot) + occupancyWords, [](uint64_t w) { return w != 0; }))
+            continue;
+        //some of its blocks are already on the free list
+        if (pendingBlock && slot == pendingSlots.back())
+            continue;
+
+        //only whole system pages inside the page can be given back (its link stays)
+        const uintptr_t first = (reinterpret_cast<uintptr_t>(pageSlot.page) + ptrSize + osPage - 1) & ~(osPage - 1);
+        const uintptr_t last = (reinterpret_cast<uintptr_t>(pageSlot.page) + stats.PageSize_) & ~(osPage - 1);
+        if (first >= last)
+            continue;
+
+        trimming[slot] = true;
+    }
+
+    //take the blocks of the pages being trimmed off the free list (of every tag)
+    for (unsigned tag = 0; tag < std::max<size_t>(tagFreeLists.size(), 1); ++tag)
+    {
+        SwitchTag(tag);
+        GenericObject* prev = nullptr;
+        for (GenericObject* block = freeList; block; )
+        {
+            GenericObject* next = NextFree(block);
+            if (trimming[FindPageSlot(reinterpret_cast<uint8_t*>(block))])
+            {
+                if (prev)
+                    SetNextFree(prev, next);
+                else
+                    SetFreeList(next);
+            }
+            else
+            {
+                prev = block;
+            }
+            block = next;
+        }
+    }
+
+    int advice = MADV_DONTNEED;
+#ifdef MADV_FREE
+    if (lazyFree)
+        advice = MADV_FREE;
+#else
+    (void)lazyFree;
+#endif
+
+    for (size_t slot = 0; slot < trimming.size(); ++slot)
+    {
+        if (!trimming[slot])
+            continue;
+
+        const uintptr_t first = (reinterpret_cast<uintptr_t>(pageSlots[slot].page) + ptrSize + osPage - 1) & ~(osPage - 1);
+        const uintptr_t last = (reinterpret_cast<uintptr_t>(pageSlots[slot].page) + stats.PageSize_) & ~(osPage - 1);
+        madvise(reinterpret_cast<void*>(first), last - first, advice);
+
+        //handed out after every other free block (room was reserved by AddPageSlot)
+        pageSlots[slot].trimmed = true;
+        if (!pageSlots[slot].pending)
+            pendingSlots.insert(pendingSlots.begin(), slot);
+        pageSlots[slot].pending = true;
+        ++counter;
+    }
+#else
+    (void)lazyFree;
+#endif
+
+    return counter;
+}
+
+/**
+ * @brief   Starts a background thread that keeps at least lowWatermark
+ *          objects free by creating pages ahead of the foreground, and
+ *          frees empty pages while more than highWatermark objects are 
+ *          free. New pages are built outside the lock and join the 
+ *          free list lazily, so Allocate only creates a page itself
+ *          if the worker falls behind. While it runs, calls on the 
+ *          allocator are serialized with it
+ * 
+ * @param   lowWatermark 
+ *          Number of free objects to keep ready
+ * 
+ * @param   highWatermark 
+ *          Number of free objects above which empty pages are freed
+ * 
+ * @param   intervalMs 
+ *          Milliseconds between checks when not woken by Allocate
+ */
+void ObjectAllocator::StartMaintenance(unsigned lowWatermark, unsigned highWatermark, unsigned intervalMs)
+{
+    if (realTimeArena || (threading && threading->maintaining))
+        return;
+    //mapped and reserved pages are handed out by frame, which the worker can't do outside the lock
+    if (config.UseCPPMemManager_ || regionBase || reservedBase)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to start maintenance: only supported for heap pages.");
+
+    try
+    {
+        if (!threading)
+            threading.reset(new Threading);
+        threading->lowWatermark = lowWatermark;
+        threading->highWatermark = std::max(lowWatermark + config.ObjectsPerPage_, highWatermark);
+        threading->interval = std::chrono::milliseconds(intervalMs);
+        threading->stop = false;
+        UpdatePlain();
+        threading->worker = std::thread(&ObjectAllocator::MaintenanceLoop, this);
+        threading->maintaining = true;
+    }
+    catch (const std::exception&)
+    {
+        if (!config.Blocking_)
+            threading.reset();
+        UpdatePlain();
+        throw OAException(OAException::E_NO_MEMORY, "Failed to start maintenance: No system resources available.");
+    }
+}
+
+/**
+ * @brief   Stops the maintenance thread, if running
+ */
+void ObjectAllocator::StopMaintenance()
+{
+    if (!threading || !threading->maintaining)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(threading->lock);
+        threading->stop = true;
+    }
+    threading->wake.notify_one();
+    threading->worker.join();
+    threading->maintaining = false;
+
+    //a Blocking_ allocator keeps its lock for good
+    if (!config.Blocking_)
+        threading.reset();
+    UpdatePlain();
+}
+
+/**
+ * @brief   Locks the allocator against other threads
+ * 
+ * @return  The held lock (empty when the allocator isn't Blocking_ 
+ *          and maintenance is off)
+ */
+std::unique_lock<std::mutex> ObjectAllocator::LockThreads() const
+{
+    if (!threading)
+        return std::unique_lock<std::mutex>();
+
+    return std::unique_lock<std::mutex>(threading->lock);
+}
+
+/**
+ * @brief   Recomputes whether Allocate and Free can skip the locks,
+ *          waiters, tags, hints, debug checks, occupancy bitmaps and 
+ *          index links and work on the free list directly
+ */
+void ObjectAllocator::UpdatePlain() noexcept
+{
+    plain = !threading && !sharedRegion && !regionBase && !waitersHead && tagFreeLists.empty()
+        && !config.PlacementHints_ && !config.UseCPPMemManager_ && !config.DebugOn_ && !config.Compressed_
+        && config.HBlockInfo_.type_ != OAConfig::hbExternal && linkBytes == 0
+        && !trackLive.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief   Body of the maintenance thread
+ */
+void ObjectAllocator::MaintenanceLoop()
+{
+    std::unique_lock<std::mutex> guard(threading->lock);
+
+    while (!threading->stop)
+    {
+        //grow: build each page unlocked, then hand it over to the tag allocated from last
+        while (!threading->stop && stats.FreeObjects_ < threading->lowWatermark
+            && (config.MaxPages_ == 0 || stats.PagesInUse_ < config.MaxPages_)
+            && (slotLimit == 0 || stats.PagesInUse_ < slotLimit))
+        {
+            guard.unlock();
+            uint8_t* rawMem = AcquirePage();
+            if (rawMem)
+                InitPageBlocks(rawMem);
+            guard.lock();
+
+            if (!rawMem)
+                break;
+            if ((config.MaxPages_ != 0 && stats.PagesInUse_ >= config.MaxPages_)
+                || (slotLimit != 0 && stats.PagesInUse_ >= slotLimit) || !AdoptPage(rawMem, currentTag))
+            {
+                ReleasePage(rawMem);
+                break;
+            }
+        }
+
+        //shrink, out of memory is retried at the next check
+        unsigned freed = 0;
+        if (stats.FreeObjects_ > threading->highWatermark)
+            ReclaimEmptyPages(threading->highWatermark, freed);
+
+        threading->wake.wait_for(guard, threading->interval);
+    }
+}
+
+/**
+ * @brief   Adds a page built by InitPageBlocks to the allocator. Its 
+ *          blocks are handed out after every other free block
+ * 
+ * @param   rawMem 
+ *          Start of the page
+ * 
+ * @param   tag 
+ *          The tag the page's blocks are given to
+ * 
+ * @return  true    - page was added
+ * @return  false   - no memory for its bookkeeping
+ */
+bool ObjectAllocator::AdoptPage(uint8_t* rawMem, unsigned tag)
+{
+    GenericObject* newPage = reinterpret_cast<GenericObject*>(rawMem);
+    if (!AddPageSlot(newPage))
+        return false;
+
+    SetNext(newPage, pageList);
+    SetPageList(newPage);
+    //room was reserved by AddPageSlot
+    const size_t slot = FindPageSlot(rawMem);
+    pageSlots[slot].tag = static_cast<unsigned short>(tag);
+    pageSlots[slot].pending = true;
+    pendingSlots.insert(pendingSlots.begin(), slot);
+
+    ++stats.PagesInUse_;
+    stats.FreeObjects_ += config.ObjectsPerPage_;
+    return true;
+}
+
+/**
+ * @brief   Creates all MaxPages_ pages of a real-time allocator in a
+ *          single block, so no page is ever created (or looked up 
+ *          by search) after construction
+ */
+void ObjectAllocator::CreateRealTimePages()
+{
+    if (config.UseCPPMemManager_ || config.MaxPages_ == 0 || config.HBlockInfo_.type_ == OAConfig::hbExternal || config.Compressed_ || config.Tags_ > 1)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to create real-time pages: real-time allocators need MaxPages, no external headers, no Compressed_ and no tags.");
+
+    realTimeStride = (stats.PageSize_ + regionFrameAlign - 1) & ~(regionFrameAlign - 1);
+    realTimeArena = new (std::nothrow) uint8_t[realTimeStride * config.MaxPages_];
+    if (!realTimeArena)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to create real-time pages: No system memory available.");
+
+    for (unsigned page = 0; page < config.MaxPages_; ++page)
+    {
+        OA_STATUS status = CreatePage();
+        if (status != S_OK)
+        {
+            delete[] realTimeArena;
+            realTimeArena = nullptr;
+            ThrowStatus(status);
+        }
+    }
+}
+
+/**
+ * @brief   Reserves (without committing) the address range a Compressed_
+ *          allocator's pages are committed in. Page frames are whole
+ *          system pages so each can be committed and decommitted alone
+ */
+void ObjectAllocator::ReserveAddressRange()
+{
+#ifdef OA_HAS_MMAP
+    if (config.UseCPPMemManager_)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to reserve memory: compressed allocators can't use the C++ memory manager.");
+
+    const size_t systemPage = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    reservedStride = (stats.PageSize_ + systemPage - 1) / systemPage * systemPage;
+
+    uint64_t frames = reservedRangeLimit / reservedStride;
+    if (config.MaxPages_ != 0 && config.MaxPages_ < frames)
+        frames = config.MaxPages_;
+    if (frames == 0)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to reserve memory: a page does not fit in 4 GiB.");
+    reservedSize = static_cast<size_t>(frames * reservedStride);
+
+    void* mem = mmap(nullptr, reservedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED)
+        throw OAException(OAException::E_NO_MEMORY, "Failed to reserve memory: No address space available.");
+    reservedBase = static_cast<uint8_t*>(mem);
+
+    //slot n lives at frame n, so only that many slots exist
+    slotLimit = slotLimit ? std::min(slotLimit, static_cast<size_t>(frames)) : static_cast<size_t>(frames);
+#else
+    throw OAException(OAException::E_NO_MEMORY, "Failed to reserve memory: not supported on this platform.");
+#endif
+}
+
+/**
+ * @brief   Allocates an object, waiting for another thread to free 
+ *          one if the pool is exhausted (MaxPages_ reached). Without
+ *          Blocking_ it is the same as TryAllocate
+ * 
+ * @param   Object
+ *          Receives the ptr to the given memoryblock, nullptr on failure
+ * 
+ * @param   timeoutMs 
+ *          Longest time to wait in milliseconds
+ * 
+ * @param   label 
+ *          The label for external header if in use
+ * 
+ * @return  S_OK on success, S_NO_PAGES if nothing was freed in time, 
+ *          else the reason the object could not be allocated
+ */
+ObjectAllocator::OA_STATUS ObjectAllocator::AllocateWait(void*& Object, unsigned timeoutMs, const char* label) noexcept
+{
+    if (!threading)
+        return TryAllocate(Object, label);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::unique_lock<std::mutex> guard(threading->lock);
+
+    OA_STATUS status = AllocateBlock(Object, label);
+    ++threading->waiting;
+    while (status == S_NO_PAGES
+        && threading->freed.wait_until(guard, deadline) != std::cv_status::timeout)
+    {
+        status = AllocateBlock(Object, label);
+    }
+    //a last try, the wakeup may have raced with the timeout
+    if (status == S_NO_PAGES)
+        status = AllocateBlock(Object, label);
+    --threading->waiting;
+
+    if (threading->maintaining && stats.FreeObjects_ < threading->lowWatermark)
+        threading->wake.notify_one();
+    return status;
+}
+
+/**
+ * @brief   Allocates an object for an AllocateAsync caller, or queues
+ *          it to be given the next object freed if the pool is 
+ *          exhausted
+ * 
+ * @param   waiter 
+ *          The caller's queue entry, receives the object
+ * 
+ * @return  true    - waiter was queued, resume_ is called later
+ * @return  false   - done, object_ holds the object (nullptr on failure)
+ */
+bool ObjectAllocator::AllocateOrEnqueue(OAWaiter& waiter) noexcept
+{
+    std::unique_lock<std::mutex> guard = LockThreads();
+
+    waiter.next_ = nullptr;
+    if (!waitersHead && AllocateBlock(waiter.object_, waiter.label_) != S_NO_PAGES)
+        return false;
+    //no one can free an object into a shared allocator for us
+    if (sharedRegion || config.UseCPPMemManager_)
+        return false;
+
+    if (waitersTail)
+        waitersTail->next_ = &waiter;
+    else
+        waitersHead = &waiter;
+    waitersTail = &waiter;
+    plain = false;
+    return true;
+}
+
+/**
+ * @brief   Allocates objects for the queued AllocateAsync callers, in
+ *          order, for as long as objects are available
+ * 
+ * @return  The callers served, linked by next_, to be resumed by 
+ *          ResumeWaiters once the lock is released
+ */
+OAWaiter* ObjectAllocator::TakeReadyWaiters() noexcept
+{
+    OAWaiter* ready = nullptr;
+    OAWaiter** readyTail = &ready;
+
+    while (waitersHead && AllocateBlock(waitersHead->object_, waitersHead->label_) == S_OK)
+    {
+        OAWaiter* waiter = waitersHead;
+        waitersHead = waiter->next_;
+        waiter->next_ = nullptr;
+        *readyTail = waiter;
+        readyTail = &waiter->next_;
+    }
+    if (!waitersHead)
+    {
+        waitersTail = nullptr;
+        UpdatePlain();
+    }
+
+    return ready;
+}
+
+/**
+ * @brief   Resumes the callers returned by TakeReadyWaiters
+ * 
+ * @param   ready 
+ *          First caller to resume
+ */
+void ObjectAllocator::ResumeWaiters(OAWaiter* ready) noexcept
+{
+    while (ready)
+    {
+        //the waiter lives in the caller's coroutine frame, which may be gone after resuming
+        OAWaiter* next = ready->next_;
+        ready->resume_(ready);
+        ready = next;
+    }
+}
+
+/**
+ * @brief   Hands freed objects to every kind of waiter after a bulk 
+ *          free, then releases the lock
+ * 
+ * @param   guard 
+ *          The held lock (may be empty)
+ */
+void ObjectAllocator::WakeWaiters(std::unique_lock<std::mutex>& guard) noexcept
+{
+    OAWaiter* ready = waitersHead ? TakeReadyWaiters() : nullptr;
+    if (threading && threading->waiting)
+        threading->freed.notify_all();
+
+    if (guard.owns_lock())
+        guard.unlock();
+    ResumeWaiters(ready);
+}
+
+/**
+ * @brief   Constructor for a reclamation domain
+ * 
+ * @param   oa 
+ *          Allocator the retired objects are freed to
+ */
+OAReclaimer::OAReclaimer(ObjectAllocator& oa)
+    : oa_{ oa }, epoch_{ 1 }, participants_{ nullptr }, orphanEpoch_{ 0 }
+{
+}
+
+/**
+ * @brief   Destructor, frees the objects left by participants. Every 
+ *          participant must be gone by now
+ */
+OAReclaimer::~OAReclaimer()
+{
+    oa_.FreeBatch(orphans_.data(), orphans_.size());
+}
+
+/**
+ * @brief   Moves the global epoch on if every reader in a read 
+ *          section has seen the current one
+ * 
+ * @return  true    - epoch was advanced
+ * @return  false   - a reader is still in an older epoch
+ */
+bool OAReclaimer::TryAdvance()
+{
+    uint64_t epoch = epoch_.load(std::memory_order_acquire);
+
+    std::lock_guard<std::mutex> guard(registry_);
+    for (Participant* participant = participants_; participant; participant = participant->next_)
+    {
+        uint64_t seen = participant->active_.load(std::memory_order_seq_cst);
+        if (seen != 0 && seen != epoch)
+            return false;
+    }
+    if (!epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst))
+        return false;
+
+    //orphans retire in the epoch they were handed over in
+    if (!orphans_.empty() && orphanEpoch_ + 2 <= epoch + 1)
+    {
+        oa_.FreeBatch(orphans_.data(), orphans_.size());
+        orphans_.clear();
+    }
+    return true;
+}
+
+/**
+ * @brief   Frees a list of retired objects if no reader can still 
+ *          see them
+ * 
+ * @param   objects 
+ *          The objects, cleared if freed
+ * 
+ * @param   retiredEpoch 
+ *          Epoch they were retired in
+ * 
+ * @param   epoch 
+ *          The current epoch
+ */
+void OAReclaimer::FreeSafe(std::vector<void*>& objects, uint64_t retiredEpoch, uint64_t epoch)
+{
+    //readers in retiredEpoch may remain until the epoch after next
+    if (objects.empty() || retiredEpoch + 2 > epoch)
+        return;
+
+    oa_.FreeBatch(objects.data(), objects.size());
+    objects.clear();
+}
+
+/**
+ * @brief   Constructor, registers the calling thread with a domain
+ * 
+ * @param   reclaimer 
+ *          The reclamation domain
+ */
+OAReclaimer::Participant::Participant(OAReclaimer& reclaimer)
+    : reclaimer_{ reclaimer }, active_{ 0 }, nesting_{ 0 }, retiredCount_{ 0 }, limboEpoch_{ 0, 0, 0 }, next_{ nullptr }
+{
+    std::lock_guard<std::mutex> guard(reclaimer_.registry_);
+    next_ = reclaimer_.participants_;
+    reclaimer_.participants_ = this;
+}
+
+/**
+ * @brief   Destructor, unregisters the thread and hands what it 
+ *          retired to the domain
+ */
+OAReclaimer::Participant::~Participant()
+{
+    active_.store(0, std::memory_order_release);
+
+    std::lock_guard<std::mutex> guard(reclaimer_.registry_);
+    for (Participant** link = &reclaimer_.participants_; *link; link = &(*link)->next_)
+    {
+        if (*link == this)
+        {
+            *link = next_;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        if (limbo_[i].empty())
+            continue;
+        reclaimer_.orphans_.insert(reclaimer_.orphans_.end(), limbo_[i].begin(), limbo_[i].end());
+        reclaimer_.orphanEpoch_ = std::max(reclaimer_.orphanEpoch_, limboEpoch_[i]);
+    }
+}
+
+/**
+ * @brief   Starts a read section. Objects retired from now on stay 
+ *          valid until the matching Exit
+ */
+void OAReclaimer::Participant::Enter()
+{
+    if (nesting_++ != 0)
+        return;
+
+    //publish the epoch before reading any shared pointer
+    active_.store(reclaimer_.epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+}
+
+/**
+ * @brief   Ends a read section
+ */
+void OAReclaimer::Participant::Exit()
+{
+    if (nesting_ == 0 || --nesting_ != 0)
+        return;
+
+    active_.store(0, std::memory_order_release);
+}
+
+/**
+ * @brief   Frees an object once no reader can still see it. The 
+ *          object must already be unreachable for new readers
+ * 
+ * @param   Object 
+ *          The object to retire
+ */
+void OAReclaimer::Participant::Retire(void* Object)
+{
+    const uint64_t epoch = reclaimer_.epoch_.load(std::memory_order_acquire);
+    const size_t bucket = static_cast<size_t>(epoch % 3);
+
+    //the bucket last held epoch-3 (or older), which is safe by now
+    if (limboEpoch_[bucket] != epoch)
+    {
+        reclaimer_.FreeSafe(limbo_[bucket], limboEpoch_[bucket], epoch);
+        limboEpoch_[bucket] = epoch;
+    }
+    limbo_[bucket].push_back(Object);
+
+    if (++retiredCount_ >= BATCH_SIZE)
+        Collect();
+}
+
+/**
+ * @brief   Tries to advance the epoch, then frees every batch of 
+ *          retired objects no reader can see anymore
+ */
+void OAReclaimer::Participant::Collect()
+{
+    retiredCount_ = 0;
+    reclaimer_.TryAdvance();
+
+    const uint64_t epoch = reclaimer_.epoch_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < 3; ++i)
+        reclaimer_.FreeSafe(limbo_[i], limboEpoch_[i], epoch);
+}
+
+/**
+ * @brief   Frees an object at the next FlushDeferred. Until then it 
+ *          stays readable, apart from its first pointer-sized bytes 
+ *          which link it to the deferred list. Only the checks needed
+ *          to link it safely (on a block boundary, not already freed)
+ *          are made here, the rest are batched in FlushDeferred
+ * 
+ * @param   Object
+ *          The object memory pointer
+ */
+void ObjectAllocator::FreeDeferred(void* Object)
+{
+    if (!Object)
+        return;
+
+    //a block from operator new that can't hold a pointer has nowhere to keep the link
+    if (config.UseCPPMemManager_ && stats.ObjectSize_ < ptrSize)
+    {
+        Free(Object);
+        return;
+    }
+
+    if (sharedRegion)
+        LockShared();
+    std::unique_lock<std::mutex> guard = LockThreads();
+
+    OA_STATUS status = S_OK;
+    uint8_t* objBlock = reinterpret_cast<uint8_t*>(Object);
+    if (!config.UseCPPMemManager_)
+    {
+        TrackLive();
+        size_t slot = FindPageSlot(objBlock);
+        size_t block = slot == NO_SLOT ? NO_BLOCK : FindBlockIndex(slot, objBlock);
+
+        if (block == NO_BLOCK)
+            status = S_BAD_BOUNDARY;
+        else if (!(OccupancyOf(slot)[block / 64] & (uint64_t(1) << (block % 64))))
+            status = S_MULTIPLE_FREE;
+        else
+        {
+            OccupancyOf(slot)[block / 64] &= ~(uint64_t(1) << (block % 64));
+            ++pageSlots[slot].deferred;
+        }
+    }
+
+    if (status == S_OK)
+    {
+        GenericObject* node = reinterpret_cast<GenericObject*>(Object);
+        SetNextFree(node, deferredHead);
+        if (!deferredHead)
+            deferredTail = node;
+        deferredHead = node;
+        ++deferredCount;
+    }
+
+    guard = std::unique_lock<std::mutex>();
+    if (sharedRegion)
+        UnlockShared();
+    if (status != S_OK)
+        ThrowStatus(status);
+}
+
+/**
+ * @brief   Puts every object given to FreeDeferred on the free list
+ *          at once. In debug mode their pad bytes are checked in the
+ *          same pass that writes the freed pattern
+ * 
+ * @param   fn 
+ *          Called for each deferred block found corrupted (may be 
+ *          nullptr). Corrupted blocks are freed all the same
+ * 
+ * @return  Number of objects freed
+ */
+unsigned ObjectAllocator::FlushDeferred(VALIDATECALLBACK fn)
+{
+    if (sharedRegion)
+        LockShared();
+    std::unique_lock<std::mutex> guard = LockThreads();
+
+    unsigned int counter = SpliceDeferred(fn);
+
+    if (sharedRegion)
+        UnlockShared();
+    else if (counter)
+        WakeWaiters(guard);
+    return counter;
+}
+
+/**
+ * @brief   FlushDeferred proper, for callers that hold the lock
+ * 
+ * @param   fn 
+ *          Called for each corrupted block (may be nullptr)
+ * 
+ * @return  Number of objects freed
+ */
+unsigned ObjectAllocator::SpliceDeferred(VALIDATECALLBACK fn)
+{
+    if (!deferredHead)
+        return 0;
+
+    const unsigned int counter = deferredCount;
+    const bool headers = config.HBlockInfo_.type_ != OAConfig::hbNone;
+
+    if (config.UseCPPMemManager_)
+    {
+        for (GenericObject* block = deferredHead; block; )
+        {
+            GenericObject* next = block->Next;
+            delete[] reinterpret_cast<uint8_t*>(block);
+            block = next;
+        }
+    }
+    else if (config.DebugOn_ || headers)
+    {
+        GenericObject* prev = nullptr;
+        for (GenericObject* block = deferredHead; block; )
+        {
+            GenericObject* next = NextFree(block);
+            uint8_t* objBlock = reinterpret_cast<uint8_t*>(block);
+
+            if (config.DebugOn_)
+            {
+                if (fn && IsPaddingCorrupted(objBlock))
+                    fn(objBlock, stats.ObjectSize_);
+
+                //clear to freed pattern, keeping the links
+                memset(objBlock, FREED_PATTERN, stats.ObjectSize_);
+                SetNextFree(block, next);
+                if (config.PlacementHints_ && prev)
+                    SetNextFree(prev, block);
+            }
+            prev = block;
+            UpdateHeaderInfo(objBlock, freedFlag);
+            if (config.HBlockInfo_.type_ == OAConfig::hbExternal)
+                FreeExternalHeader(objBlock);
+
+            block = next;
+        }
+    }
+
+    //splice the whole list in front of the free list
+    if (!config.UseCPPMemManager_ && tagFreeLists.empty())
+    {
+        SetNextFree(deferredTail, freeList);
+        SetFreeList(deferredHead);
+    }
+    else if (!config.UseCPPMemManager_)
+    {
+        //each block goes to the free list of its page's tag
+        const unsigned tag = currentTag;
+        for (GenericObject* block = deferredHead; block; )
+        {
+            GenericObject* next = NextFree(block);
+            SwitchTag(pageSlots[FindPageSlot(reinterpret_cast<uint8_t*>(block))].tag);
+            SetNextFree(block, freeList);
+            SetFreeList(block);
+            block = next;
+        }
+        SwitchTag(tag);
+    }
+    deferredHead = nullptr;
+    deferredTail = nullptr;
+    deferredCount = 0;
+    for (size_t slot : pageOrder)
+        pageSlots[slot].deferred = 0;
+
+    //update stats
+    stats.FreeObjects_ += counter;
+    stats.Deallocations_ += counter;
+    stats.ObjectsInUse_ -= counter;
+
+    return counter;
+}
+
+/**
+ * @brief   Empties the deferred list without putting its objects on 
+ *          the free list, for Reset and Release which free every 
+ *          block at once (the stats already count them as in use).
+ *          They are cleared the way ClearLiveBlocks clears live ones
+ */
+void ObjectAllocator::DropDeferred()
+{
+    const bool external = config.HBlockInfo_.type_ == OAConfig::hbExternal;
+    if (config.DebugOn_ || external)
+    {
+        for (GenericObject* block = deferredHead; block; )
+        {
+            GenericObject* next = NextFree(block);
+            uint8_t* objBlock = reinterpret_cast<uint8_t*>(block);
+            if (config.DebugOn_)
+            {
+                memset(objBlock, FREED_PATTERN, stats.ObjectSize_);
+                UpdateHeaderInfo(objBlock, freedFlag);
+            }
+            if (external)
+                FreeExternalHeader(objBlock);
+            block = next;
+        }
+    }
+
+    deferredHead = nullptr;
+    deferredTail = nullptr;
+    deferredCount = 0;
+    for (size_t slot : pageOrder)
+        pageSlots[slot].deferred = 0;
+}
+
+// OAPageCache: empty heap pages shared by the allocators with SharePages_ set,
+// kept in size buckets on the shelves and in a small front per thread
+static constexpr unsigned pageCacheBuckets = 240;    // 4 buckets per power of two up to 2^64
+
+/*!
+  Pages of the shared OAPageCache. Cached pages are linked through their
+  first pointer-sized bytes, so caching a page never allocates
+*/
+struct PageCacheShelves
+{
+    std::mutex lock;                              //!< guards heads
+    uint8_t* heads[pageCacheBuckets] = {};        //!< cached pages of each bucket
+    std::atomic<size_t> cachedBytes{ 0 };         //!< bytes held by the shelves and every front
+    std::atomic<size_t> capacity{ OAPageCache::DEFAULT_CAPACITY }; //!< cap on cachedBytes
+};
+
+static PageCacheShelves pageCacheShelves;
+
+static uint8_t* CachedNext(uint8_t* page)
+{
+    uint8_t* next;
+    memcpy(&next, page, sizeof(next));
+    return next;
+}
+
+static void SetCachedNext(uint8_t* page, uint8_t* next)
+{
+    memcpy(page, &next, sizeof(next));
+}
+
+// Size of the pages in a bucket (the inverse of OAPageCache::Bucket)
+static size_t PageCacheBucketSize(unsigned bucket)
+{
+    if (bucket == 0)
+        return 64;
+    const unsigned log = 6 + (bucket - 1) / 4;
+    return static_cast<size_t>((bucket - 1) % 4 + 5) << (log - 2);
+}
+
+/*!
+  The pages a thread keeps for itself, returned to the shelves when
+  the thread exits
+*/
+struct PageCacheFront
+{
+    uint8_t* pages[OAPageCache::FRONT_PAGES] = {};  //!< cached pages, the first count are in use
+    unsigned buckets[OAPageCache::FRONT_PAGES] = {}; //!< bucket of each page
+    unsigned count = 0;
+
+    ~PageCacheFront()
+    {
+        std::lock_guard<std::mutex> guard(pageCacheShelves.lock);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            SetCachedNext(pages[i], pageCacheShelves.heads[buckets[i]]);
+            pageCacheShelves.heads[buckets[i]] = pages[i];
+        }
+        count = 0;
+    }
+};
+
+static thread_local PageCacheFront pageCacheFront;
+
+/**
+ * @brief   Sets the most bytes of pages the cache keeps. Pages 
+ *          given back while it is full are freed to the system
+ * 
+ * @param   bytes 
+ *          The cap in bytes (0 disables caching)
+ */
+void OAPageCache::SetCapacity(size_t bytes)
+{
+    pageCacheShelves.capacity = bytes;
+}
+
+/**
+ * @brief   Bytes of pages currently cached by every thread
+ * 
+ * @return  The cached bytes
+ */
+size_t OAPageCache::GetCachedBytes()
+{
+    return pageCacheShelves.cachedBytes;
+}
+
+/**
+ * @brief   Frees the shared pages and the calling thread's front to
+ *          the system. Other threads' fronts are kept
+ */
+void OAPageCache::Trim()
+{
+    PageCacheFront& front = pageCacheFront;
+    for (unsigned i = 0; i < front.count; ++i)
+    {
+        pageCacheShelves.cachedBytes -= PageCacheBucketSize(front.buckets[i]);
+        delete[] front.pages[i];
+    }
+    front.count = 0;
+
+    std::lock_guard<std::mutex> guard(pageCacheShelves.lock);
+    for (unsigned bucket = 0; bucket < pageCacheBuckets; ++bucket)
+    {
+        while (uint8_t* page = pageCacheShelves.heads[bucket])
+        {
+            pageCacheShelves.heads[bucket] = CachedNext(page);
+            pageCacheShelves.cachedBytes -= PageCacheBucketSize(bucket);
+            delete[] page;
+        }
+    }
+}
+
+/**
+ * @brief   Gets a page from the calling thread's front, else from 
+ *          the shelves, else from the system
+ * 
+ * @param   pageSize 
+ *          The size the page needs
+ * 
+ * @return  A page of the bucket of pageSize, nullptr if out of memory
+ */
+uint8_t* OAPageCache::Acquire(size_t pageSize) noexcept
+{
+    size_t bucketSize;
+    const unsigned bucket = Bucket(pageSize, bucketSize);
+
+    PageCacheFront& front = pageCacheFront;
+    for (unsigned i = front.count; i-- > 0;)
+    {
+        if (front.buckets[i] == bucket)
+        {
+            uint8_t* page = front.pages[i];
+            --front.count;
+            front.pages[i] = front.pages[front.count];
+            front.buckets[i] = front.buckets[front.count];
+            pageCacheShelves.cachedBytes -= bucketSize;
+            return page;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(pageCacheShelves.lock);
+        if (uint8_t* page = pageCacheShelves.heads[bucket])
+        {
+            pageCacheShelves.heads[bucket] = CachedNext(page);
+            pageCacheShelves.cachedBytes -= bucketSize;
+            return page;
+        }
+    }
+
+    return new (std::nothrow) uint8_t[bucketSize];
+}
+
+/**
+ * @brief   Keeps a page in the calling thread's front, else on the 
+ *          shelves, or frees it if the cache is full
+ * 
+ * @param   page 
+ *          A page from Acquire
+ * 
+ * @param   pageSize 
+ *          The size given to Acquire
+ */
+void OAPageCache::Release(uint8_t* page, size_t pageSize) noexcept
+{
+    size_t bucketSize;
+    const unsigned bucket = Bucket(pageSize, bucketSize);
+
+    if (pageCacheShelves.cachedBytes.fetch_add(bucketSize) + bucketSize > pageCacheShelves.capacity)
+    {
+        pageCacheShelves.cachedBytes -= bucketSize;
+        delete[] page;
+        return;
+    }
+
+    PageCacheFront& front = pageCacheFront;
+    if (front.count < FRONT_PAGES)
+    {
+        front.pages[front.count] = page;
+        front.buckets[front.count] = bucket;
+        ++front.count;
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(pageCacheShelves.lock);
+    SetCachedNext(page, pageCacheShelves.heads[bucket]);
+    pageCacheShelves.heads[bucket] = page;
+}
+
+/**
+ * @brief   Bucket of a page size. There are 4 buckets per power of 
+ *          two, so a page wastes less than a quarter of its bucket
+ * 
+ * @param   pageSize 
+ *          The size of the page
+ * 
+ * @param   bucketSize 
+ *          Receives the size of the pages in the bucket
+ * 
+ * @return  The bucket index
+ */
+unsigned OAPageCache::Bucket(size_t pageSize, size_t& bucketSize) noexcept
+{
+    if (pageSize <= 64)
+    {
+        bucketSize = 64;
+        return 0;
+    }
+
+    unsigned log = 6;
+    while ((pageSize - 1) >> (log + 1))
+        ++log;
+    const unsigned shift = log - 2;
+    const size_t steps = ((pageSize - 1) >> shift) + 1; //5 to 8 quarters of 2^log
+
+    bucketSize = steps << shift;
+    return (log - 6) * 4 + static_cast<unsigned>(steps - 4);
+}
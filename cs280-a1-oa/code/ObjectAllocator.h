@@ -18,6 +18,27 @@
 //---------------------------------------------------------------------------
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <new>
+#include <iterator>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+#include <cassert>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define OA_HAS_COROUTINES
+#endif
+#endif
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 // If the client doesn't specify these:
 static const int DEFAULT_OBJECTS_PER_PAGE = 4;  
@@ -168,6 +189,15 @@ struct OAConfig
     HBlockInfo_ = HBInfo;
     LeftAlignSize_ = 0;  
     InterAlignSize_ = 0;
+    RealTime_ = false;
+    Blocking_ = false;
+    Compressed_ = false;
+    LazyFirstPage_ = false;
+    SharePages_ = false;
+    Coloring_ = false;
+    PlacementHints_ = false;
+    Tags_ = 0;
+    TrackLive_ = false;
   }
 
   bool UseCPPMemManager_;      //!< by-pass the functionality of the OA and use new/delete
@@ -179,6 +209,15 @@ struct OAConfig
   unsigned Alignment_;         //!< address alignment of each block
   unsigned LeftAlignSize_;     //!< number of alignment bytes required to align first block
   unsigned InterAlignSize_;    //!< number of alignment bytes required between remaining blocks
+  bool RealTime_;              //!< create all MaxPages_ up front, bounded Allocate/Free with no heap use after construction
+  bool Blocking_;              //!< shared by threads, AllocateWait/AllocateAsync wait for a Free when MaxPages_ is reached
+  bool Compressed_;            //!< pages are committed on demand in one reserved range of at most 4 GiB, objects can be stored as 32-bit references (Encode/Decode)
+  bool LazyFirstPage_;         //!< the first page is created by the first Allocate instead of the constructor
+  bool SharePages_;            //!< heap pages are taken from and freed to the process-wide OAPageCache
+  bool Coloring_;              //!< heap pages start at rotating cache-line offsets (slab coloring) so their first objects use different cache sets
+  bool PlacementHints_;        //!< free blocks are also linked backwards, AllocateNear finds a block on the hint's page without walking the free list (objects must hold two pointers, ignored with UseCPPMemManager_)
+  unsigned Tags_;              //!< number of allocation tags (0 = untagged), each tag has its own pages (see AllocateTagged)
+  bool TrackLive_;             //!< keep the occupancy bitmaps from the start, so Free refuses pointers off the blocks outside debug too (else they are built by the first call that reads them)
 };
 
 
@@ -211,6 +250,107 @@ struct GenericObject
   GenericObject *Next; //!< The next object in the list
 };
 
+/*!
+  A generational reference to an allocated object. Packs (from the low bits)
+  the block's use counter, the block index within its page, the page slot and
+  the slot's reuse count. 0 is never a valid handle.
+*/
+typedef uint64_t OAHandle;
+
+/*!
+  A point in an allocator's lifetime that ObjectAllocator::Rollback can
+  return to (see ObjectAllocator::Mark)
+*/
+struct OAMark
+{
+  unsigned allocations_;               //!< Allocations_ count when the mark was taken
+  std::vector<GenericObject*> pages_;  //!< the page in each directory slot (nullptr if vacant)
+  std::vector<unsigned short> epochs_; //!< the reuse count of each directory slot
+  std::vector<uint64_t> occupancy_;    //!< the occupancy bitmaps of every slot
+};
+
+/*!
+  Position of a walk over the live objects of an allocator
+  (see ObjectAllocator::FirstLive/NextLive)
+*/
+struct OALiveCursor
+{
+  size_t page_;    //!< index of the page in address order
+  size_t word_;    //!< the occupancy word being walked
+  uint64_t unvisited_; //!< blocks of that word not visited yet (the word itself is re-read)
+  uint8_t *data_;  //!< first block of the page
+  size_t stride_;  //!< distance between blocks
+  void *object_;   //!< the current object, nullptr past the last one
+};
+
+static const uint64_t OA_SNAPSHOT_MAGIC = 0x313050414E53414Full; //!< "OASNAP01"
+static const uint32_t OA_SNAPSHOT_VERSION = 1;                   //!< layout of the records below
+
+/*!
+  Start of a heap snapshot file (see ObjectAllocator::WriteSnapshot). Followed
+  by pageCount_ pages in address order, each an OASnapshotPage, occupancyWords_
+  words of the occupancy bitmap (1 = in use), occupancyWords_ words of the
+  in-use flags read from the block headers (all 0 without headers) and
+  liveCount_ OASnapshotBlocks. Then labelCount_ labels, each a uint32_t length
+  and that many bytes. Fields are in the writer's byte order.
+*/
+struct OASnapshotHeader
+{
+  uint64_t magic_;          //!< OA_SNAPSHOT_MAGIC
+  uint32_t version_;        //!< OA_SNAPSHOT_VERSION
+  uint32_t headerType_;     //!< OAConfig::HBLOCK_TYPE of the blocks
+  uint64_t objectSize_;     //!< size of each object
+  uint64_t pageSize_;       //!< size of a page including all headers, padding, etc.
+  uint64_t dataOffset_;     //!< offset of the first object from the start of its page
+  uint64_t objectStride_;   //!< distance between objects on a page
+  uint64_t overheadBytes_;  //!< bytes of pages not holding objects, plus external header records
+  uint32_t objectsPerPage_; //!< number of objects on each page
+  uint32_t occupancyWords_; //!< 64-bit words per page bitmap
+  uint32_t pageCount_;      //!< number of page records
+  uint32_t labelCount_;     //!< number of labels at the end
+  uint32_t allocations_;    //!< OAStats at the time of the snapshot
+  uint32_t deallocations_;
+  uint32_t mostObjects_;
+  uint32_t objectsInUse_;
+  uint32_t freeObjects_;
+  uint32_t reserved_;       //!< 0
+};
+
+/*!
+  A page of a heap snapshot
+*/
+struct OASnapshotPage
+{
+  uint64_t address_;   //!< where the page was
+  uint32_t liveCount_; //!< number of OASnapshotBlocks that follow its bitmaps
+  uint32_t tag_;       //!< the allocation tag of the page
+};
+
+/*!
+  A block in use on a page of a heap snapshot, in block order
+*/
+struct OASnapshotBlock
+{
+  uint32_t index_;    //!< block index within the page
+  uint32_t allocNum_; //!< allocation number from the header (0 without headers)
+  uint32_t label_;    //!< index of its label + 1 (0 = no label)
+};
+
+/*!
+  Queue entry of a caller waiting for an object (see ObjectAllocator::AllocateAsync)
+*/
+struct OAWaiter
+{
+  void (*resume_)(OAWaiter *); //!< called once object_ is allocated (outside the allocator's lock)
+  void *object_;               //!< the object allocated for the caller
+  const char *label_;          //!< the label for external header if in use
+  OAWaiter *next_;             //!< the next caller in the queue
+};
+
+#ifdef OA_HAS_COROUTINES
+class OAAllocation;
+#endif
+
 /*!
   This is used with external headers
 */
@@ -238,10 +378,42 @@ class ObjectAllocator
     static const unsigned char PAD_PATTERN =         0xDD; //!< Pad signature to detect buffer over/under flow
     static const unsigned char ALIGN_PATTERN =       0xEE; //!< For the alignment bytes
 
+    /*!
+      Status codes returned by the non-throwing TryAllocate/TryFree.
+      Apart from S_OK, each maps onto the OAException code of the same name.
+    */
+    enum OA_STATUS
+    {
+      S_OK,             //!< the operation succeeded
+      S_NO_MEMORY,      //!< out of physical memory (operator new fails)
+      S_NO_PAGES,       //!< out of logical memory (max pages has been reached)
+      S_BAD_BOUNDARY,   //!< block address is on a page, but not on any block-boundary
+      S_MULTIPLE_FREE,  //!< block has already been freed
+      S_CORRUPTED_BLOCK //!< block has been corrupted (pad bytes have been overwritten)
+    };
+
     // Creates the ObjectManager per the specified values
     // Throws an exception if the construction fails. (Memory allocation problem)
     ObjectAllocator(size_t ObjectSize, const OAConfig& config);
 
+    /*!
+      Where the pages of a mapped allocator live
+    */
+    enum MAPPING_TYPE
+    {
+      mtFile,  //!< a file, so the allocator can be resumed after a restart
+      mtShared //!< a POSIX shared memory object, so processes can share the allocator
+    };
+
+    // Creates (or resumes/attaches to) an ObjectManager whose pages live in a memory mapping
+    // Throws an exception if it can't be mapped or fails its consistency check
+    ObjectAllocator(size_t ObjectSize, const OAConfig& config, const char *name, MAPPING_TYPE type = mtFile);
+
+    // Removes the name of a shared allocator (attached processes are unaffected)
+    // If a process dies holding the lock, the next one to lock repairs the free list and stats from
+    // the bitmaps (Linux, robust mutex). Objects the dead process held or had deferred stay in use
+    static void UnlinkShared(const char *name);
+
     // Destroys the ObjectManager (never throws)
     ~ObjectAllocator();
 
@@ -253,15 +425,151 @@ class ObjectAllocator
     // Throws an exception if the the object can't be freed. (Invalid object)
     void Free(void *Object);
 
+    // Same as Allocate, but reports failure through the returned status (never throws)
+    OA_STATUS TryAllocate(void *&Object, const char *label = 0) noexcept;
+
+    // Same as Free, but reports failure through the returned status (never throws)
+    OA_STATUS TryFree(void *Object) noexcept;
+
+    // Frees many objects under one lock, returns how many were freed (invalid ones are skipped)
+    unsigned FreeBatch(void *const *Objects, size_t Count) noexcept;
+
+    // Frees Object at the next FlushDeferred, it stays readable until then except for its
+    // first pointer-sized bytes (used as the link, two pointers with PlacementHints_)
+    // Throws if it isn't an allocated object
+    void FreeDeferred(void *Object);
+
+    // Moves every deferred object onto the free list at once, running the debug checks in
+    // one pass (fn is called for each corrupted block). Returns the number of objects freed
+    // FreeEmptyPages, TrimIdlePages and AllocateNear leave pages holding deferred objects
+    // alone; Reset and Release free deferred objects along with the rest
+    unsigned FlushDeferred(VALIDATECALLBACK fn = 0);
+
+    // Same as Allocate, but the object is zero-filled with a single write instead of being
+    // patterned first. Blocks of pages committed fresh from the reserved range (Compressed_,
+    // no debug, no pad bytes) are known to be zero and are not written at all
+    void *AllocateZeroed(const char *label = 0);
+
+    // Same as AllocateZeroed, but reports failure through the returned status (never throws)
+    OA_STATUS TryAllocateZeroed(void *&Object, const char *label = 0) noexcept;
+
+    // Same as Allocate, but prefers a free block on the page of hint (an object of this allocator)
+    // so related objects share pages. Falls back to any free block. With PlacementHints_ the
+    // block is found by scanning the hint page's occupancy words (a page still pending after
+    // Reset is moved up the pending queue instead), else only the first few blocks of the
+    // free list are searched
+    void *AllocateNear(const void *hint, const char *label = 0);
+
+    // Same as AllocateNear, but reports failure through the returned status (never throws)
+    OA_STATUS TryAllocateNear(void *&Object, const void *hint, const char *label = 0) noexcept;
+
+    // Same as Allocate, but the object comes from the pages of tag (0 to Tags_ - 1) only, so
+    // objects of similar lifetime share pages and those pages empty out together
+    // Allocate and AllocateNear use tag 0
+    void *AllocateTagged(unsigned tag, const char *label = 0);
+
+    // Same as AllocateTagged, but reports failure through the returned status (never throws)
+    // S_BAD_BOUNDARY if tag is out of range (AllocateTagged throws E_BAD_BOUNDARY for it)
+    OA_STATUS TryAllocateTagged(void *&Object, unsigned tag, const char *label = 0) noexcept;
+
+    // Same as TryAllocate, but waits up to timeoutMs for a Free when MaxPages is reached (Blocking_)
+    // Returns S_NO_PAGES on timeout
+    OA_STATUS AllocateWait(void *&Object, unsigned timeoutMs, const char *label = 0) noexcept;
+
+#ifdef OA_HAS_COROUTINES
+    // Awaitable for an object: void *p = co_await oa.AllocateAsync();
+    // When the pool is exhausted the coroutine resumes on the thread that frees an object
+    OAAllocation AllocateAsync(const char *label = 0) noexcept;
+#endif
+
+    // Compressed_ mode: 32-bit reference to an object of this allocator (0 for nullptr) and back
+    // Both are a single add/subtract, references stay valid until the object is freed
+    uint32_t Encode(const void *Object) const;
+    void *Decode(uint32_t Reference) const;
+
+    // Returns a handle to an allocated object (requires hbExtended headers, 0 on failure)
+    OAHandle GetHandle(const void *Object) const;
+
+    // Returns the object a handle refers to, or nullptr if it was freed since (O(1))
+    void *Resolve(OAHandle handle) const;
+
+    // Calls fn(void *) for each block still in use, in address order
+    template <typename F>
+    void ForEachLive(F&& fn) const;
+
+    // Same as ForEachLive, but only visits chunk ChunkIndex of ChunkCount page ranges
+    // Chunks are disjoint, so each can be run on its own thread while nothing allocates/frees
+    template <typename F>
+    void ForEachLiveChunk(size_t ChunkIndex, size_t ChunkCount, F&& fn) const;
+
+    // The same walk one object at a time: FirstLive starts it, NextLive moves on, the
+    // cursor's object_ is nullptr past the last one. Objects may be freed during the walk
+    // (they are not visited), objects allocated during it may or may not be visited
+    void FirstLive(OALiveCursor &cursor) const;
+    void NextLive(OALiveCursor &cursor) const;
+
     // Calls the callback fn for each block still in use
     unsigned DumpMemoryInUse(DUMPCALLBACK fn) const;
 
     // Calls the callback fn for each block that is potentially corrupted
     unsigned ValidatePages(VALIDATECALLBACK fn) const;
 
+    // Writes a heap snapshot (see OASnapshotHeader) to the file at path for offline analysis
+    // (oa-snapshot). The state is copied in one pass under the lock and written out after
+    // it is released. Returns false if the file can't be written
+    bool WriteSnapshot(const char *path) const;
+
     // Frees all empty page
     unsigned FreeEmptyPages();
 
+    // Frees every object at once but keeps the pages (free list is rebuilt lazily, except in
+    // mapped file mode where the file must always list every free block)
+    void Reset();
+
+    // Frees every object and returns all pages to the system
+    void Release();
+
+    // Returns the memory of pages that stayed empty since the last call to the
+    // system (madvise), keeping the pages themselves (heap pages only)
+    unsigned TrimIdlePages(bool lazyFree = false);
+
+    // Starts a background thread that creates pages ahead of time so at least lowWatermark
+    // objects are free, and frees empty pages while more than highWatermark are free
+    // (heap pages only, throws for mapped and Compressed_ allocators)
+    // While it runs, calls are serialized with it, except ForEachLive/ForEachLiveChunk
+    void StartMaintenance(unsigned lowWatermark, unsigned highWatermark, unsigned intervalMs = 10);
+
+    // Stops the maintenance thread (also done on destruction)
+    void StopMaintenance();
+
+    // Note: a shared allocator never frees its pages, so FreeEmptyPages/Reset/Release do nothing
+    // Neither does a real-time one (FreeEmptyPages/Release/TrimIdlePages/StartMaintenance do nothing);
+    // use TryAllocate/TryFree there, they take constant time and never throw or touch the heap
+
+    // Mapped file mode: flushes the allocator state to the file
+    void Sync();
+
+    // Mapped file mode: records/returns the object to start from after a restart
+    void SetRoot(const void *Object);
+    void *GetRoot() const;
+
+    // Mapped file mode: start of the mapping (nullptr for heap pages)
+    // Links on the free/page lists are stored as offsets from this address
+    const void *GetRegionBase() const;
+
+    // Compressed_ mode: start and size in bytes of the reserved range (nullptr/0 otherwise)
+    // Every page of the allocator lies in it, so whether an address is owned is one compare
+    const void *GetReservedBase() const;
+    size_t GetReservedSize() const;
+
+    // Records the current set of live objects
+    OAMark Mark() const;
+
+    // Frees every object allocated since the mark was taken. Without headers there is no
+    // allocation number, so a block live at the mark that was freed and allocated again
+    // since then is not freed
+    unsigned Rollback(const OAMark &mark) noexcept;
+
     // Testing/Debugging/Statistic methods
     void SetDebugState(bool State);   // true=enable, false=disable
     const void *GetFreeList() const;  // returns a pointer to the internal free list
@@ -276,12 +584,178 @@ class ObjectAllocator
       
   //private functions
   private:    
+      // Computes the alignment bytes and page size
+      void InitLayout(size_t ObjectSize);
+
       // Creates a new page in allocator
-      void CreatePage();
+      OA_STATUS CreatePage() noexcept;
+
+      // Writes the patterns of every block on a page
+      void InitPageBlocks(uint8_t* rawMem);
+
+      // Creates every page of a real-time allocator in one block
+      void CreateRealTimePages();
+
+      // Copies the state into a snapshot image, for callers holding the lock
+      void CaptureSnapshot(std::vector<uint8_t> &image) const;
+
+      // Reserves the address range of a Compressed_ allocator (pages are committed by AcquirePage)
+      void ReserveAddressRange();
+
+      // Adds a page built by InitPageBlocks to the pages of tag, its blocks are handed out last
+      bool AdoptPage(uint8_t* rawMem, unsigned tag);
+
+      // FreeEmptyPages proper, stops before fewer than keepFree objects would be free (never throws)
+      OA_STATUS ReclaimEmptyPages(unsigned keepFree, unsigned &freed) noexcept;
+
+      // Locks out the maintenance thread (empty lock if it isn't running)
+      std::unique_lock<std::mutex> LockThreads() const;
+
+      // Recomputes plain after threading, the waiters, debug or occupancy tracking change
+      void UpdatePlain() noexcept;
+
+      // Body of the maintenance thread
+      void MaintenanceLoop();
+
+      // FlushDeferred proper, for callers holding the lock
+      unsigned SpliceDeferred(VALIDATECALLBACK fn);
+
+      // Forgets the deferred objects when Reset or Release frees every block anyway
+      void DropDeferred();
+
+      // AllocateAsync support: allocate or join the queue, serve the queue, resume the served
+      bool AllocateOrEnqueue(OAWaiter &waiter) noexcept;
+      OAWaiter *TakeReadyWaiters() noexcept;
+      static void ResumeWaiters(OAWaiter *ready) noexcept;
+
+      // Serves every kind of waiter after objects were freed in bulk, then unlocks
+      void WakeWaiters(std::unique_lock<std::mutex> &guard) noexcept;
+
+#ifdef OA_HAS_COROUTINES
+      friend class OAAllocation;
+#endif
+
+      // TryAllocate/TryAllocateNear/TryAllocateTagged proper, takes the locks
+      OA_STATUS TryAllocateFrom(void *&Object, unsigned tag, const void *hint, const char *label, bool zeroed = false) noexcept;
+
+      // Moves a free block on the page of hint to the head of the free list of tag (if one is found)
+      void PreferNear(const void *hint, unsigned tag);
+
+      // Makes freeList the free list of the given tag (the current one is kept in tagFreeLists)
+      void SwitchTag(unsigned tag);
+
+      // Allocate/Free proper, shared by the public entry points
+      OA_STATUS AllocateBlock(void *&Object, const char *label, unsigned tag = 0, bool zeroed = false) noexcept;
+      OA_STATUS FreeBlock(void *Object) noexcept;
+
+      // Gets/returns the memory of a page (heap or mapped file)
+      uint8_t* AcquirePage() noexcept;
+      void ReleasePage(uint8_t* page) noexcept;
+
+      // Bytes of heap memory behind each page (PageSize_ plus the coloring slack)
+      size_t PageFootprint() const;
+
+      // Reads/writes the link of a list node (offsets in mapped file mode)
+      GenericObject* NextOf(const GenericObject* node) const;
+      void SetNext(GenericObject* node, GenericObject* next);
+
+      // Reads/writes the link of a free block (a block index if objects are smaller than a pointer)
+      // With PlacementHints_ writing a link also sets the back link of next
+      GenericObject* NextFree(const GenericObject* block) const;
+      void SetNextFree(GenericObject* block, GenericObject* next);
+
+      // The block index links of NextFree/SetNextFree, kept apart so the pointer case inlines
+      GenericObject* NextFreeByIndex(const GenericObject* block) const;
+      void SetNextFreeByIndex(GenericObject* block, GenericObject* next);
+
+      // Reads the back link of a free block (PlacementHints_ only)
+      GenericObject* PrevFree(const GenericObject* block) const;
+
+      // Sets the list heads, keeping the mapped file's copy in sync
+      void SetFreeList(GenericObject* head);
+      void SetPageList(GenericObject* head);
+
+      // Offset of a pointer from the start of the mapping (0 for nullptr)
+      uint64_t ToRegionOffset(const void* ptr) const;
+
+      // Maps the backing file, returns true if an existing allocator was resumed
+      bool OpenMappedFile(const char* path);
+
+      // Rebuilds and checks the allocator state from the mapped file
+      void ResumeMappedFile();
+
+      // Syncs and unmaps the backing file
+      void CloseMappedFile();
+
+      // Writes/checks the layout recorded in the mapping's header
+      void WriteRegionLayout();
+      bool IsRegionLayoutValid() const;
+
+      // Creates or attaches to a shared memory pool
+      void OpenSharedMemory(const char* name);
+
+      // Takes/releases the cross-process lock of a shared allocator
+      void LockShared() noexcept;
+      void UnlockShared() noexcept;
+
+      // Records the block a shared operation is changing / repairs the state a dead owner left
+      void SetInFlight(const void* block) noexcept;
+      void RecoverShared() noexcept;
+
+      // Occupancy bitmap words of the page in a slot
+      uint64_t* OccupancyOf(size_t slot);
+      const uint64_t* OccupancyOf(size_t slot) const;
+
+      // Throws the OAException matching a failed status
+      // When allocating, S_BAD_BOUNDARY can only mean a tag out of range and says so
+      void ThrowStatus(OA_STATUS status, bool allocating = false) const;
 
       // Finds the page the given object located
       GenericObject* FindPage(uint8_t *objBlock) const;
 
+      // Finds the slot of the page the given object located
+      size_t FindPageSlot(const uint8_t *objBlock) const;
+
+      // Adds/removes a page to/from the page index
+      // Indexing can only fail if ReservePageIndex wasn't called first
+      void IndexPage(size_t slot);
+      void UnindexPage(size_t slot);
+
+      // Grows the page index so one more page can be indexed without allocating
+      // Throws std::bad_alloc if out of memory
+      void ReservePageIndex();
+
+      // First entry of the page index to probe for a granule
+      size_t PageIndexHome(uintptr_t granule) const;
+
+      // Registers a newly created page in the page directory
+      bool AddPageSlot(GenericObject* page);
+
+      // Removes a page from the page directory
+      void RemovePageSlot(GenericObject* page);
+
+      // Offset from the start of a page to its first object
+      size_t PageToDataOffset() const;
+
+      // Offset from one object to the next on the same page
+      size_t ObjectStride() const;
+
+      // Index of an object within the page in the given slot (NO_BLOCK if not on a boundary)
+      size_t FindBlockIndex(size_t slot, const uint8_t *objBlock) const;
+
+      // Builds the occupancy bitmaps from the free lists the first time they are needed
+      // Tracking stays on from then on (it is on from the start in debug, with TrackLive_,
+      // PlacementHints_, Blocking_ and for mapped allocators)
+      void TrackLive() const;
+      void RebuildOccupancy();
+
+      // Marks an object block as in use / free in its page's occupancy bitmap
+      // Returns S_BAD_BOUNDARY (and changes nothing) if it is not a block of a page
+      OA_STATUS SetOccupied(const uint8_t *objBlock, bool inUse);
+
+      // Index of the lowest set bit of a non-zero word
+      static unsigned LowestSetBit(uint64_t bits);
+
       // Enquire whether the given object block has been freed previously
       bool IsMemoryFreed(uint8_t* objBlock) const;
 
@@ -298,22 +772,866 @@ class ObjectAllocator
       void UpdateHeaderInfo(uint8_t* objBlock,uint8_t flag);
 
       // Helper function to allocate memory & copy string buffer for external headers
-      void AllocateExternalHeader(uint8_t* objBlock , const char* label);
+      OA_STATUS AllocateExternalHeader(uint8_t* objBlock , const char* label) noexcept;
 
       // Helper function to free memory allocated by AllocateExternalHeader function
       void FreeExternalHeader(uint8_t* objBlock);
 
       // Helper function to free a page in the allocator
-      void FreePage(GenericObject*& page,GenericObject* prevPage);
+      void FreePage(GenericObject*& page,GenericObject* prevPage, size_t listed);
+
+      // Gives the next block of the pages left behind by Reset to the free list
+      bool RefillFromPending();
+
+      // Puts every block still left behind by Reset on the free list
+      void FlushPending();
+
+      // Releases the external headers and (in debug) clears every live block
+      void ClearLiveBlocks();
+
+      // Reads the allocation number from a block's header (0 if no header)
+      unsigned GetAllocationNumber(const uint8_t *objBlock) const;
 
   private:
+    /*!
+      Bookkeeping kept beside each page (rather than inside it) so the
+      page layout seen by the client is unchanged
+    */
+    struct PageSlot
+    {
+      GenericObject *page;  //!< the page using this slot (nullptr if unused)
+      unsigned short epoch; //!< number of times this slot has been reused
+      bool touched;         //!< an object was allocated since the last TrimIdlePages
+      bool trimmed;         //!< memory was given back, patterns are rewritten on reuse
+      bool pending;         //!< the page is on pendingSlots, not all its free blocks are listed
+      unsigned short tag;   //!< the allocation tag the page's blocks are given to
+      unsigned deferred;    //!< objects of the page waiting on the deferred list
+    };
+
+    /*!
+      Entry of the page index: the pages touching one granule of the
+      address space. Granules are no bigger than a page, so at most two
+      pages touch each
+    */
+    struct PageGranule
+    {
+      uintptr_t granule; //!< address >> granuleShift (0 = unused entry)
+      uint32_t slots[2]; //!< slot + 1 of each page touching the granule (0 = none)
+    };
+
+    static const size_t NO_SLOT = static_cast<size_t>(-1);  //!< FindPageSlot's not found value
+    static const size_t NO_BLOCK = static_cast<size_t>(-1); //!< FindBlockIndex's not found value
+
     // Some "suggested" members (only a suggestion!)
     GenericObject *pageList = nullptr; //!< the beginning of the list of pages
     GenericObject *freeList = nullptr; //!< the beginning of the list of objects
     // Lots of other private stuff... 
     OAConfig config;
     OAStats stats;
+    std::vector<PageSlot> pageSlots; //!< page directory, indexed by the slot stored in handles
+    std::vector<size_t> pageOrder;   //!< slots sorted by page address, the order pages are walked in
+    std::vector<PageGranule> pageIndex; //!< open-addressed by granule, finds a block's page in O(1)
+    size_t pageIndexUsed = 0;        //!< entries of pageIndex in use
+    unsigned granuleShift = 0;       //!< log2 of the granule size, the largest power of two not above PageSize_
+    uint64_t strideReciprocal = 0;   //!< 2^64 / ObjectStride() rounded up, so FindBlockIndex multiplies (0 if the stride is 1)
+    std::vector<uint64_t> occupancy; //!< one bit per block (1=in use), occupancyWords per slot
+    std::atomic<bool> trackLive{ false }; //!< the occupancy bitmaps are kept by Allocate/Free
+    std::once_flag liveOnce;         //!< builds the bitmaps once, readers may start in parallel (ForEachLiveChunk)
+    std::vector<uint64_t> pristine;  //!< one bit per block (1=still zero past its links), like occupancy (reserved range only)
+    size_t occupancyWords = 0;       //!< number of 64-bit bitmap words per page
+    unsigned linkBytes = 0;          //!< 2 or 4 if free blocks link by index (objects smaller than a pointer), 0 for pointers
+    size_t slotLimit = 0;            //!< number of page slots index links or the reserved range can reach (0 = no limit)
+    std::vector<size_t> pendingSlots; //!< pages emptied by Reset/trimmed that are not yet on the free list
+    size_t pendingBlock = 0;          //!< next block to hand out from pendingSlots.back()
+    uint8_t *regionBase = nullptr;    //!< start of the mapped file (nullptr = pages come from the heap)
+    size_t regionSize = 0;            //!< size of the mapping in bytes
+    size_t regionStride = 0;          //!< distance between page frames in the mapping
+    size_t regionFrames = 0;          //!< offset of the first page frame in the mapping
+    bool sharedRegion = false;        //!< mapping is shared with other processes
+    uint64_t *sharedOccupancy = nullptr; //!< occupancy bitmaps inside a shared mapping
+    std::vector<bool> regionFrameUsed; //!< which page frames of the mapping hold a page
+    uint8_t *realTimeArena = nullptr;  //!< pages of a real-time allocator, back to back in slot order
+    size_t realTimeStride = 0;         //!< distance between pages in realTimeArena
+    uint8_t *reservedBase = nullptr;   //!< address range of a Compressed_ allocator, the page in slot n is at frame n
+    size_t reservedSize = 0;           //!< size of the reserved range in bytes
+    size_t reservedStride = 0;         //!< distance between page frames in the reserved range (whole system pages)
+    size_t colorStep = 0;              //!< distance between page colors (0 = Coloring_ off)
+    unsigned colorCount = 1;           //!< number of page colors
+    std::atomic<unsigned> nextColor{ 0 }; //!< color of the next heap page (the maintenance thread takes colors unlocked)
+    struct Threading;
+    std::unique_ptr<Threading> threading;  //!< locking for Blocking_ and the maintenance worker (nullptr when off)
+    GenericObject *deferredHead = nullptr; //!< objects given to FreeDeferred, newest first
+    GenericObject *deferredTail = nullptr; //!< the oldest deferred object
+    unsigned deferredCount = 0;            //!< number of deferred objects
+    OAWaiter *waitersHead = nullptr;  //!< AllocateAsync callers waiting for a Free, oldest first
+    OAWaiter *waitersTail = nullptr;  //!< the newest waiting AllocateAsync caller
+    std::vector<GenericObject*> tagFreeLists; //!< free list of each tag, except currentTag's which is in freeList (empty if untagged)
+    unsigned currentTag = 0;                  //!< the tag whose free list is in freeList
+    bool plain = false;                       //!< none of the optional features is on, Allocate/Free pop/push the free list directly (see UpdatePlain)
+
+};
+
+/*!
+  Process-wide cache of empty pages, shared by the allocators with
+  SharePages_ set. Pages are kept in size buckets (4 per power of two), so
+  allocators with similar page sizes reuse each other's pages. Each thread
+  keeps a few pages in its own front that are handed out without locking.
+*/
+class OAPageCache
+{
+  public:
+    static const size_t DEFAULT_CAPACITY = 64u << 20; //!< default cap on cached bytes (64 MiB)
+    static const unsigned FRONT_PAGES = 8;           //!< pages kept by each thread's front
+
+    // Sets the most bytes of pages kept (all threads), pages beyond it go back to the system
+    static void SetCapacity(size_t bytes);
+
+    // Bytes of pages currently cached (all threads)
+    static size_t GetCachedBytes();
+
+    // Returns the shared pages and the calling thread's front to the system
+    static void Trim();
+
+  private:
+    friend class ObjectAllocator;
+
+    // Gets a page of at least pageSize bytes (nullptr if out of memory)
+    static uint8_t *Acquire(size_t pageSize) noexcept;
 
+    // Gives back a page obtained by Acquire with the same pageSize
+    static void Release(uint8_t *page, size_t pageSize) noexcept;
+
+    // Bucket of a page size, and the size of the pages in it
+    static unsigned Bucket(size_t pageSize, size_t &bucketSize) noexcept;
+};
+
+/*!
+  Frees everything allocated within its lifetime when it goes out of scope
+*/
+class OAArenaScope
+{
+  public:
+    /*!
+      Constructor. Marks the current state of the allocator.
+
+      \param oa
+        The allocator to roll back on destruction
+    */
+    explicit OAArenaScope(ObjectAllocator &oa) : oa_(oa), mark_(oa.Mark()) {}
+
+    /*!
+      Destructor. Frees every object allocated since construction.
+    */
+    ~OAArenaScope() { oa_.Rollback(mark_); }
+
+    OAArenaScope(const OAArenaScope &) = delete;            //!< Do not implement!
+    OAArenaScope &operator=(const OAArenaScope &) = delete; //!< Do not implement!
+
+  private:
+    ObjectAllocator &oa_; //!< The allocator being scoped
+    OAMark mark_;         //!< Its state on construction
+};
+
+/*!
+  Epoch-based reclamation for objects reachable by lock-free readers.
+  Objects are retired instead of freed and go back to the allocator in
+  batches once every reader that could have seen them has left its 
+  read section. The allocator should be Blocking_ if several threads
+  use it.
+*/
+class OAReclaimer
+{
+  public:
+    /*!
+      A thread taking part in reclamation. Each thread that reads or
+      retires objects owns one.
+    */
+    class Participant
+    {
+      public:
+        explicit Participant(OAReclaimer &reclaimer);
+        ~Participant();
+
+        void Enter();               // starts a read section (may be nested)
+        void Exit();                // ends a read section
+        void Retire(void *Object);  // frees Object once no reader can see it
+        void Collect();             // frees what is safe now (also done every BATCH_SIZE retires)
+
+        Participant(const Participant &) = delete;            //!< Do not implement!
+        Participant &operator=(const Participant &) = delete; //!< Do not implement!
+
+      private:
+        friend class OAReclaimer;
+
+        OAReclaimer &reclaimer_;          //!< The domain this thread belongs to
+        std::atomic<uint64_t> active_;    //!< epoch seen on entering a read section (0 = outside)
+        unsigned nesting_;                //!< depth of nested read sections
+        unsigned retiredCount_;           //!< objects retired since the last Collect
+        std::vector<void *> limbo_[3];    //!< objects retired in each of the last three epochs
+        uint64_t limboEpoch_[3];          //!< the epoch each limbo_ list was filled in
+        Participant *next_;               //!< next registered participant
+    };
+
+    static const unsigned BATCH_SIZE = 64; //!< retires between automatic Collects
+
+    explicit OAReclaimer(ObjectAllocator &oa);
+    ~OAReclaimer(); // frees every retired object (no reader may be left)
+
+    OAReclaimer(const OAReclaimer &) = delete;            //!< Do not implement!
+    OAReclaimer &operator=(const OAReclaimer &) = delete; //!< Do not implement!
+
+  private:
+    bool TryAdvance();
+    void FreeSafe(std::vector<void *> &objects, uint64_t retiredEpoch, uint64_t epoch);
+
+    ObjectAllocator &oa_;                //!< Where retired objects go back to
+    std::atomic<uint64_t> epoch_;        //!< the global epoch (starts at 1)
+    std::mutex registry_;                //!< guards participants_ and orphans_
+    Participant *participants_;          //!< registered participants
+    std::vector<void *> orphans_;        //!< retired objects left by participants that went away
+    uint64_t orphanEpoch_;               //!< the latest epoch any orphan was retired in
 };
 
+/*!
+  Read section of a participant for the duration of a scope
+*/
+class OAReadGuard
+{
+  public:
+    /*!
+      Constructor. Enters a read section.
+
+      \param participant
+        The calling thread's participant
+    */
+    explicit OAReadGuard(OAReclaimer::Participant &participant) : participant_(participant) { participant_.Enter(); }
+
+    /*!
+      Destructor. Exits the read section.
+    */
+    ~OAReadGuard() { participant_.Exit(); }
+
+    OAReadGuard(const OAReadGuard &) = delete;            //!< Do not implement!
+    OAReadGuard &operator=(const OAReadGuard &) = delete; //!< Do not implement!
+
+  private:
+    OAReclaimer::Participant &participant_; //!< The participant in a read section
+};
+
+/*!
+  Configuration helpers shared by the typed wrappers (Pooled, ObjectPool)
+*/
+template <typename T>
+struct OATypedConfig
+{
+  // Pages of about 64 KiB (at least DEFAULT_OBJECTS_PER_PAGE objects), no page limit, no debugging
+  static OAConfig Default();
+
+  // The configuration with Alignment_ raised to T's alignment if T needs more than a pointer's
+  static OAConfig Aligned(OAConfig config);
+};
+
+/*!
+  CRTP mixin that gives T class-level operator new/delete backed by an
+  ObjectAllocator of its own, so existing new T / delete code is pooled
+  without edits:
+
+    struct Employee : Pooled<Employee> { ... };
+
+  The pool is created by the first new T with T::PoolConfig() (T can hide
+  the default one with its own) and is never destroyed, so objects can be
+  deleted at any time from any thread. With PerThread, each thread gets an
+  unlocked pool instead. Objects from that pool must be deleted by the
+  same thread before it exits (delete asserts otherwise). Sizes other
+  than sizeof(T) (classes derived from T) and arrays use the global
+  operator new. new (std::nothrow) T is hidden, and a failure is reported
+  by std::bad_alloc.
+*/
+template <typename T, bool PerThread = false>
+class Pooled
+{
+  public:
+    static void *operator new(size_t size);
+    static void operator delete(void *Object, size_t size) noexcept;
+
+    // Placement forms, hidden by the ones above otherwise
+    static void *operator new(size_t, void *place) noexcept { return place; }
+    static void operator delete(void *, void *) noexcept {}
+
+    // Configuration of the pool: pages of about 64 KiB, no page limit, no debugging
+    // A shared pool is always made Blocking_ so threads can use it
+    static OAConfig PoolConfig();
+
+    // The pool of T (the calling thread's with PerThread), created on first use
+    // Throws an exception if it can't be created
+    static ObjectAllocator &Pool();
+
+  protected:
+    Pooled() = default;
+    ~Pooled() = default;
+};
+
+/*!
+  Container of T with stable addresses, backed by an ObjectAllocator: one
+  block per element instead of one heap allocation, and iteration over the
+  live elements in page (address) order from the occupancy bitmaps. Pointers
+  stay valid until their element is erased. Iterators are forward iterators,
+  they stay valid across erase of other elements (not across emplace). T
+  can't be aligned past __STDCPP_DEFAULT_NEW_ALIGNMENT__.
+*/
+template <typename T>
+class ObjectPool
+{
+  public:
+    /*!
+      Forward iterator over the live elements (V is T or const T)
+    */
+    template <typename V>
+    class Iterator
+    {
+      public:
+        typedef std::forward_iterator_tag iterator_category; //!< iterator traits
+        typedef T value_type;                                //!< iterator traits
+        typedef std::ptrdiff_t difference_type;              //!< iterator traits
+        typedef V *pointer;                                  //!< iterator traits
+        typedef V &reference;                                //!< iterator traits
+
+        Iterator() : oa_(nullptr), cursor_() {}
+
+        /*!
+          Converts an iterator to a const_iterator
+        */
+        template <typename W>
+        Iterator(const Iterator<W> &other) : oa_(other.oa_), cursor_(other.cursor_)
+        {
+          static_assert(std::is_const<V>::value || !std::is_const<W>::value, "const_iterator can't become an iterator");
+        }
+
+        V &operator*() const { return *static_cast<V *>(cursor_.object_); }
+        V *operator->() const { return static_cast<V *>(cursor_.object_); }
+        Iterator &operator++() { oa_->NextLive(cursor_); return *this; }
+        Iterator operator++(int) { Iterator old = *this; oa_->NextLive(cursor_); return old; }
+        bool operator==(const Iterator &rhs) const { return cursor_.object_ == rhs.cursor_.object_; }
+        bool operator!=(const Iterator &rhs) const { return cursor_.object_ != rhs.cursor_.object_; }
+
+      private:
+        friend class ObjectPool;
+        template <typename> friend class Iterator;
+
+        const ObjectAllocator *oa_; //!< The allocator walked
+        OALiveCursor cursor_;       //!< Position in the walk
+    };
+
+    typedef Iterator<T> iterator;             //!< iterator over the live elements
+    typedef Iterator<const T> const_iterator; //!< iterator over the live elements
+
+    // Creates an empty pool with pages of about 64 KiB and no page limit
+    ObjectPool();
+
+    // Creates an empty pool with the given configuration (not the C++ memory manager)
+    // Throws an exception if the allocator can't be created
+    explicit ObjectPool(const OAConfig &config);
+
+    // Destroys every element
+    ~ObjectPool();
+
+    // Constructs an element in place, returns its stable address
+    // Throws an exception if no block is left or the constructor throws
+    template <typename... Args>
+    T *emplace(Args&&... args);
+
+    // Destroys an element, returns the iterator to the next one
+    iterator erase(iterator it);
+
+    // Destroys an element of this pool
+    void erase(T *element);
+
+    // Destroys every element, keeping the pages
+    void clear();
+
+    size_t size() const { return oa_.GetStats().ObjectsInUse_; } //!< number of elements
+    bool empty() const { return size() == 0; }                   //!< whether there are no elements
+
+    iterator begin() { return First<T>(); }                            //!< first element in page order
+    iterator end() { return iterator(); }                              //!< past the last element
+    const_iterator begin() const { return First<const T>(); }          //!< first element in page order
+    const_iterator end() const { return const_iterator(); }            //!< past the last element
+    const_iterator cbegin() const { return First<const T>(); }         //!< first element in page order
+    const_iterator cend() const { return const_iterator(); }           //!< past the last element
+
+    ObjectAllocator &allocator() { return oa_; }             //!< the underlying allocator
+    const ObjectAllocator &allocator() const { return oa_; } //!< the underlying allocator
+
+    ObjectPool(const ObjectPool &) = delete;            //!< Do not implement!
+    ObjectPool &operator=(const ObjectPool &) = delete; //!< Do not implement!
+
+  private:
+    // Starts a walk over the live elements
+    template <typename V>
+    Iterator<V> First() const;
+
+    // The configuration adjusted for T's alignment
+    static OAConfig Checked(OAConfig config);
+
+    ObjectAllocator oa_; //!< Where the elements live
+};
+
+#ifdef OA_HAS_COROUTINES
+/*!
+  Awaitable returned by ObjectAllocator::AllocateAsync. Resumes the
+  coroutine with the object (nullptr if it could not be allocated for 
+  any reason other than an exhausted pool).
+*/
+class OAAllocation : private OAWaiter
+{
+  public:
+    /*!
+      Constructor
+
+      \param oa
+        The allocator to take the object from
+
+      \param label
+        The label for external header if in use
+    */
+    OAAllocation(ObjectAllocator &oa, const char *label) noexcept : OAWaiter{&Resume, nullptr, label, nullptr}, oa_(oa) {}
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) noexcept { handle_ = handle; return oa_.AllocateOrEnqueue(*this); }
+    void *await_resume() const noexcept { return object_; }
+
+  private:
+    static void Resume(OAWaiter *waiter) { static_cast<OAAllocation *>(waiter)->handle_.resume(); }
+
+    ObjectAllocator &oa_;            //!< The allocator waited on
+    std::coroutine_handle<> handle_; //!< The suspended coroutine
+};
+
+inline OAAllocation ObjectAllocator::AllocateAsync(const char *label) noexcept
+{
+  return OAAllocation(*this, label);
+}
+#endif
+
+/*!
+  Compressed_ mode: the 32-bit reference to an object
+
+  \param Object
+    An object of this allocator, or nullptr
+
+  \return
+    Its offset from the start of the reserved range (0 for nullptr)
+*/
+inline uint32_t ObjectAllocator::Encode(const void *Object) const
+{
+  return Object ? static_cast<uint32_t>(static_cast<const uint8_t *>(Object) - reservedBase) : 0;
+}
+
+/*!
+  Compressed_ mode: the object a 32-bit reference refers to
+
+  \param Reference
+    A reference returned by Encode
+
+  \return
+    The object (nullptr for 0)
+*/
+inline void *ObjectAllocator::Decode(uint32_t Reference) const
+{
+  return Reference ? reservedBase + Reference : nullptr;
+}
+
+/*!
+  Index of the lowest set bit of a non-zero word
+
+  \param bits
+    The word to scan (must not be 0)
+
+  \return
+    The bit index (0-63)
+*/
+inline unsigned ObjectAllocator::LowestSetBit(uint64_t bits)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+}
+
+/*!
+  Calls fn(void *) for each block still in use, visiting pages and the
+  blocks on them in address order. Liveness comes from the occupancy
+  bitmaps, so no headers or free lists are read.
+
+  \param fn
+    Function (object) called with a pointer to each live object
+*/
+template <typename F>
+void ObjectAllocator::ForEachLive(F&& fn) const
+{
+  ForEachLiveChunk(0, 1, fn);
+}
+
+/*!
+  Calls fn(void *) for each block still in use on one contiguous range of
+  pages. The ChunkCount ranges cover every page exactly once.
+
+  \param ChunkIndex
+    Which range to visit (0 to ChunkCount - 1)
+
+  \param ChunkCount
+    Number of ranges the pages are split into
+
+  \param fn
+    Function (object) called with a pointer to each live object
+*/
+template <typename F>
+void ObjectAllocator::ForEachLiveChunk(size_t ChunkIndex, size_t ChunkCount, F&& fn) const
+{
+  if (ChunkCount == 0 || ChunkIndex >= ChunkCount)
+    return;
+  TrackLive();
+
+  const size_t pages = pageOrder.size();
+  const size_t first = pages * ChunkIndex / ChunkCount;
+  const size_t last = pages * (ChunkIndex + 1) / ChunkCount;
+  const size_t dataOffset = PageToDataOffset();
+  const size_t stride = ObjectStride();
+
+  for (size_t i = first; i < last; ++i)
+  {
+    const size_t slot = pageOrder[i];
+    uint8_t *dataStart = reinterpret_cast<uint8_t *>(pageSlots[slot].page) + dataOffset;
+    const uint64_t *words = OccupancyOf(slot);
+
+    for (size_t w = 0; w < occupancyWords; ++w)
+    {
+      uint64_t bits = words[w];
+      while (bits)
+      {
+        const size_t block = w * 64 + LowestSetBit(bits);
+        bits &= bits - 1;
+        fn(static_cast<void *>(dataStart + block * stride));
+      }
+    }
+  }
+}
+
+/*!
+  Starts a walk over the live objects in address order
+
+  \param cursor
+    Receives the position of the first live object (object_ is nullptr if none)
+*/
+inline void ObjectAllocator::FirstLive(OALiveCursor &cursor) const
+{
+  cursor.page_ = 0;
+  cursor.word_ = 0;
+  cursor.object_ = nullptr;
+  TrackLive();
+  if (pageOrder.empty())
+    return;
+
+  cursor.unvisited_ = ~uint64_t(0);
+  cursor.data_ = reinterpret_cast<uint8_t *>(pageSlots[pageOrder[0]].page) + PageToDataOffset();
+  cursor.stride_ = ObjectStride();
+  NextLive(cursor);
+}
+
+/*!
+  Moves a walk over the live objects on to the next one. The occupancy
+  word is read again each time, so objects freed since the last step
+  are not visited.
+
+  \param cursor
+    A position from FirstLive/NextLive, receives the next live object
+    (object_ is nullptr past the last one)
+*/
+inline void ObjectAllocator::NextLive(OALiveCursor &cursor) const
+{
+  const size_t pages = pageOrder.size();
+  uint64_t bits = 0;
+  while (cursor.page_ < pages && !(bits = OccupancyOf(pageOrder[cursor.page_])[cursor.word_] & cursor.unvisited_))
+  {
+    cursor.unvisited_ = ~uint64_t(0);
+    if (++cursor.word_ == occupancyWords)
+    {
+      cursor.word_ = 0;
+      if (++cursor.page_ < pages)
+        cursor.data_ = reinterpret_cast<uint8_t *>(pageSlots[pageOrder[cursor.page_]].page) + PageToDataOffset();
+    }
+  }
+  if (!bits)
+  {
+    cursor.object_ = nullptr;
+    return;
+  }
+
+  //the lowest live block and every block below it are visited
+  const unsigned bit = LowestSetBit(bits);
+  cursor.unvisited_ = bit == 63 ? 0 : ~uint64_t(0) << (bit + 1);
+  cursor.object_ = cursor.data_ + (cursor.word_ * 64 + bit) * cursor.stride_;
+}
+
+/*!
+  Default configuration for objects of T
+
+  \return
+    Pages of about 64 KiB (at least DEFAULT_OBJECTS_PER_PAGE objects), no
+    page limit, no debugging
+*/
+template <typename T>
+OAConfig OATypedConfig<T>::Default()
+{
+  const unsigned objects = static_cast<unsigned>(65536 / sizeof(T));
+  return OAConfig(false, objects < DEFAULT_OBJECTS_PER_PAGE ? DEFAULT_OBJECTS_PER_PAGE : objects, 0);
+}
+
+/*!
+  Raises the alignment of a configuration to T's
+
+  \param config
+    The configuration asked for
+
+  \return
+    The configuration with Alignment_ raised to T's alignment if needed
+*/
+template <typename T>
+OAConfig OATypedConfig<T>::Aligned(OAConfig config)
+{
+  //Alignment_ is counted from the start of a page, which is only as aligned as new[] makes it
+  static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "T can't be aligned past operator new's alignment");
+
+  if (alignof(T) > sizeof(void *) && config.Alignment_ < alignof(T))
+    config.Alignment_ = static_cast<unsigned>(alignof(T));
+  return config;
+}
+
+/*!
+  Class-level operator new of a Pooled type
+
+  \param size
+    Size of the object being created
+
+  \return
+    An object of the pool, or of the global operator new for other sizes
+*/
+template <typename T, bool PerThread>
+void *Pooled<T, PerThread>::operator new(size_t size)
+{
+  if (size != sizeof(T))
+    return ::operator new(size);
+
+  void *Object = nullptr;
+  try
+  {
+    if (Pool().TryAllocate(Object) == ObjectAllocator::S_OK)
+      return Object;
+  }
+  catch (const OAException &)
+  {
+  }
+  throw std::bad_alloc();
+}
+
+/*!
+  Class-level operator delete of a Pooled type. Asserts that the pool took
+  the object back (with PerThread, an object deleted by another thread
+  would otherwise leak)
+
+  \param Object
+    An object created by operator new (or nullptr)
+
+  \param size
+    Size of the object's dynamic type
+*/
+template <typename T, bool PerThread>
+void Pooled<T, PerThread>::operator delete(void *Object, size_t size) noexcept
+{
+  if (!Object)
+    return;
+
+  if (size != sizeof(T))
+    ::operator delete(Object, size);
+  else
+  {
+    //S_BAD_BOUNDARY: deleted by a thread other than the one whose PerThread pool created it
+    const ObjectAllocator::OA_STATUS status = Pool().TryFree(Object);
+    assert(status == ObjectAllocator::S_OK && "Pooled object deleted from the wrong pool, or deleted twice");
+    (void)status;
+  }
+}
+
+/*!
+  Default configuration of the pool of a Pooled type
+
+  \return
+    Pages of about 64 KiB (at least 4 objects), no page limit, no debugging
+*/
+template <typename T, bool PerThread>
+OAConfig Pooled<T, PerThread>::PoolConfig()
+{
+  return OATypedConfig<T>::Default();
+}
+
+/*!
+  The pool of a Pooled type, created by the first call
+
+  \return
+    The process-wide pool, or the calling thread's with PerThread. Its
+    Alignment_ is raised to T's alignment if needed
+*/
+template <typename T, bool PerThread>
+ObjectAllocator &Pooled<T, PerThread>::Pool()
+{
+  if (PerThread)
+  {
+    thread_local std::unique_ptr<ObjectAllocator> local;
+    if (!local)
+      local.reset(new ObjectAllocator(sizeof(T), OATypedConfig<T>::Aligned(T::PoolConfig())));
+    return *local;
+  }
+
+  //never destroyed, objects may still be deleted by other static destructors
+  static ObjectAllocator *shared = []
+  {
+    OAConfig config = OATypedConfig<T>::Aligned(T::PoolConfig());
+    config.Blocking_ = true;
+    return new ObjectAllocator(sizeof(T), config);
+  }();
+  return *shared;
+}
+
+/*!
+  Constructor. Pages of about 64 KiB (at least 4 elements), no page limit.
+*/
+template <typename T>
+ObjectPool<T>::ObjectPool()
+  : ObjectPool(OATypedConfig<T>::Default())
+{
+}
+
+/*!
+  Constructor
+
+  \param config
+    Configuration of the allocator. Alignment_ is raised to T's alignment
+    if T needs more than a pointer's
+*/
+template <typename T>
+ObjectPool<T>::ObjectPool(const OAConfig &config) : oa_(sizeof(T), Checked(config))
+{
+}
+
+/*!
+  Destructor. Destroys every element (the allocator frees the pages).
+*/
+template <typename T>
+ObjectPool<T>::~ObjectPool()
+{
+  oa_.ForEachLive([](void *element) { static_cast<T *>(element)->~T(); });
+}
+
+/*!
+  Constructs an element in place
+
+  \param args
+    Arguments for T's constructor
+
+  \return
+    The address of the element, valid until it is erased
+*/
+template <typename T>
+template <typename... Args>
+T *ObjectPool<T>::emplace(Args&&... args)
+{
+  void *block = oa_.Allocate();
+  try
+  {
+    return new (block) T(std::forward<Args>(args)...);
+  }
+  catch (...)
+  {
+    oa_.Free(block);
+    throw;
+  }
+}
+
+/*!
+  Destroys an element
+
+  \param it
+    An iterator to the element
+
+  \return
+    An iterator to the next element in page order
+*/
+template <typename T>
+typename ObjectPool<T>::iterator ObjectPool<T>::erase(iterator it)
+{
+  T *element = &*it;
+  ++it;
+  erase(element);
+  return it;
+}
+
+/*!
+  Destroys an element
+
+  \param element
+    The address returned by emplace
+*/
+template <typename T>
+void ObjectPool<T>::erase(T *element)
+{
+  element->~T();
+  oa_.Free(element);
+}
+
+/*!
+  Destroys every element. The pages are kept and reused by later emplaces.
+*/
+template <typename T>
+void ObjectPool<T>::clear()
+{
+  oa_.ForEachLive([](void *element) { static_cast<T *>(element)->~T(); });
+  oa_.Reset();
+}
+
+/*!
+  Starts a walk over the live elements
+
+  \return
+    An iterator to the first element in page order
+*/
+template <typename T>
+template <typename V>
+typename ObjectPool<T>::template Iterator<V> ObjectPool<T>::First() const
+{
+  Iterator<V> it;
+  it.oa_ = &oa_;
+  oa_.FirstLive(it.cursor_);
+  return it;
+}
+
+/*!
+  Checks the configuration of a pool
+
+  \param config
+    The configuration asked for
+
+  \return
+    The configuration with Alignment_ raised to T's alignment if needed
+*/
+template <typename T>
+OAConfig ObjectPool<T>::Checked(OAConfig config)
+{
+  if (config.UseCPPMemManager_)
+    throw OAException(OAException::E_NO_MEMORY, "Failed to create pool: the C++ memory manager keeps no pages to iterate.");
+  return OATypedConfig<T>::Aligned(config);
+}
+
 #endif
@@ -0,0 +1,595 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <list>
+#include <memory>
+
+using std::cout;
+using std::endl;
+using std::printf;
+
+#include "ObjectAllocator.h"
+#include "PRNG.h"
+
+struct Student
+{
+    int Age;
+    float GPA;
+    long Year;
+    long ID;
+};
+
+struct Employee
+{
+    Employee* Next;
+    char lastName[12];
+    char firstName[12];
+    float salary;
+    int years;
+};
+
+// the same Employee with class-level operator new/delete from a pool
+struct PooledEmployee : Employee, Pooled<PooledEmployee> {};
+struct ThreadPooledEmployee : Employee, Pooled<ThreadPooledEmployee, true> {};
+
+struct Particle
+{
+    float Position[3];
+    float Velocity[3];
+    long Id;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+unsigned OPERATIONS = 4000000;
+
+// Support functions
+uint64_t ElapsedNs(Clock::time_point start, Clock::time_point end);
+void PrintLatency(const char* label, std::vector<uint64_t>& samples);
+
+void BenchRealTimeLatency(bool realTime); // debug, padding=2, header, random alloc/free mix
+void BenchColoring(bool coloring);        // large pages, first object of every page is hot
+void BenchNearTraversal(bool near);       // chains built in a churned pool, then traversed
+void BenchPreload(bool preload);          // driver-malloc with the C library's malloc or oa-malloc.so
+template <typename E>
+void BenchNewEmployee();                  // random new E/delete mix around a live set
+void BenchObjectPool();                   // build, churn and iterate Particles in an ObjectPool
+void BenchUniquePtrVector();              // the same in a std::vector<std::unique_ptr>
+void BenchList();                         // the same in a std::list
+void PrintContainer(unsigned elements, uint64_t buildNs, unsigned passes, uint64_t walkNs, double sum);
+
+uint64_t ElapsedNs(Clock::time_point start, Clock::time_point end)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+void PrintLatency(const char* label, std::vector<uint64_t>& samples)
+{
+    if (samples.empty())
+        return;
+
+    std::sort(samples.begin(), samples.end());
+
+    double total = 0;
+    for (uint64_t ns : samples)
+        total += ns;
+
+    printf("%-10s ops: %9u  mean: %7.1f ns  p99: %6llu ns  p99.99: %7llu ns  max: %8llu ns\n",
+        label, static_cast<unsigned>(samples.size()), total / samples.size(),
+        static_cast<unsigned long long>(samples[samples.size() * 99 / 100]),
+        static_cast<unsigned long long>(samples[samples.size() * 9999 / 10000]),
+        static_cast<unsigned long long>(samples.back()));
+}
+
+void BenchRealTimeLatency(bool realTime)
+{
+    const unsigned objects = 256;
+    const unsigned pages = 64;
+    const unsigned maxLive = objects * pages;
+
+    try
+    {
+        OAConfig config(false, objects, realTime ? pages : 0, true, 2, OAConfig::HeaderBlockInfo(OAConfig::hbBasic));
+        config.RealTime_ = realTime;
+
+        Clock::time_point start = Clock::now();
+        ObjectAllocator oa(sizeof(Student), config);
+        printf("construction: %llu us\n", static_cast<unsigned long long>(ElapsedNs(start, Clock::now()) / 1000));
+
+        std::vector<void*> live;
+        std::vector<uint64_t> allocs;
+        std::vector<uint64_t> frees;
+        live.reserve(maxLive);
+        allocs.reserve(OPERATIONS);
+        frees.reserve(OPERATIONS);
+
+        Digipen::Utils::srand(8, 3);
+        for (unsigned i = 0; i < OPERATIONS; ++i)
+        {
+            //grow towards a full pool for the first half, then hover
+            const bool allocate = live.empty()
+                || (live.size() < maxLive && Digipen::Utils::Random(0, 99) < (i < OPERATIONS / 2 ? 60 : 50));
+
+            if (allocate)
+            {
+                void* p = nullptr;
+                Clock::time_point t0 = Clock::now();
+                ObjectAllocator::OA_STATUS status = oa.TryAllocate(p);
+                Clock::time_point t1 = Clock::now();
+                if (status != ObjectAllocator::S_OK)
+                {
+                    cout << "Allocation failed in BenchRealTimeLatency." << endl;
+                    return;
+                }
+                allocs.push_back(ElapsedNs(t0, t1));
+                live.push_back(p);
+            }
+            else
+            {
+                size_t index = static_cast<size_t>(Digipen::Utils::Random(0, static_cast<int>(live.size()) - 1));
+                void* p = live[index];
+                live[index] = live.back();
+                live.pop_back();
+
+                Clock::time_point t0 = Clock::now();
+                ObjectAllocator::OA_STATUS status = oa.TryFree(p);
+                Clock::time_point t1 = Clock::now();
+                if (status != ObjectAllocator::S_OK)
+                {
+                    cout << "Free failed in BenchRealTimeLatency." << endl;
+                    return;
+                }
+                frees.push_back(ElapsedNs(t0, t1));
+            }
+        }
+
+        PrintLatency("Allocate", allocs);
+        PrintLatency("Free", frees);
+        printf("pages in use: %u\n", oa.GetStats().PagesInUse_);
+    }
+    catch (const OAException& e)
+    {
+        cout << e.what() << endl;
+    }
+}
+
+void BenchColoring(bool coloring)
+{
+    //pages this big come from mmap, so without coloring every page (and 
+    //its first object) starts at the same offset in a system page
+    const unsigned objects = 4096;
+    const unsigned pages = 64;
+
+    try
+    {
+        OAConfig config(false, objects, 0, false, 0);
+        config.Coloring_ = coloring;
+        ObjectAllocator oa(64, config);
+
+        std::vector<void*> live;
+        live.reserve(objects * pages);
+        for (unsigned i = 0; i < objects * pages; ++i)
+            live.push_back(oa.Allocate());
+
+        //the hot set: the first object of each page
+        std::vector<long*> hot;
+        for (const GenericObject* page = static_cast<const GenericObject*>(oa.GetPageList()); page; page = page->Next)
+            hot.push_back(reinterpret_cast<long*>(reinterpret_cast<uintptr_t>(page) + sizeof(void*)));
+
+        const unsigned passes = std::max(OPERATIONS / pages, 1u);
+        Clock::time_point start = Clock::now();
+        for (unsigned pass = 0; pass < passes; ++pass)
+        {
+            for (long* object : hot)
+            {
+                volatile long* counter = object;
+                const long value = *counter;
+                *counter = value + 1;
+            }
+        }
+        Clock::time_point end = Clock::now();
+
+        printf("pages: %u  hot objects: %u  accesses: %u  %.2f ns/access\n",
+            oa.GetStats().PagesInUse_, static_cast<unsigned>(hot.size()), passes * pages,
+            static_cast<double>(ElapsedNs(start, end)) / (static_cast<double>(passes) * pages));
+
+        for (void* p : live)
+            oa.Free(p);
+    }
+    catch (const OAException& e)
+    {
+        cout << e.what() << endl;
+    }
+}
+
+struct ChainNode
+{
+    ChainNode* Next;
+    long Value;
+    char Payload[48];
+};
+
+void BenchNearTraversal(bool near)
+{
+    const unsigned objects = 256;
+    const unsigned pages = 4096;
+    const unsigned chainLength = 32;
+
+    try
+    {
+        OAConfig config(false, objects, 0, false, 0);
+        config.PlacementHints_ = near;
+        ObjectAllocator oa(sizeof(ChainNode), config);
+
+        //fill the pool, then free a random half so the free list is scattered over every page
+        std::vector<void*> live;
+        live.reserve(objects * pages);
+        for (unsigned i = 0; i < objects * pages; ++i)
+            live.push_back(oa.Allocate());
+
+        Digipen::Utils::srand(8, 3);
+        for (size_t i = live.size(); i > 1; --i)
+            std::swap(live[i - 1], live[static_cast<size_t>(Digipen::Utils::Random(0, static_cast<int>(i) - 1))]);
+        for (size_t i = live.size() / 2; i < live.size(); ++i)
+            oa.Free(live[i]);
+        live.resize(live.size() / 2);
+
+        //build chains, each node allocated after (and near) its parent
+        std::vector<ChainNode*> chains;
+        Clock::time_point start = Clock::now();
+        for (unsigned built = 0; built + chainLength <= objects * pages / 2; built += chainLength)
+        {
+            ChainNode* head = static_cast<ChainNode*>(oa.Allocate());
+            head->Value = built;
+            ChainNode* tail = head;
+            for (unsigned i = 1; i < chainLength; ++i)
+            {
+                ChainNode* node = static_cast<ChainNode*>(near ? oa.AllocateNear(tail) : oa.Allocate());
+                node->Value = built + i;
+                tail->Next = node;
+                tail = node;
+            }
+            tail->Next = nullptr;
+            chains.push_back(head);
+        }
+        const uint64_t buildNs = ElapsedNs(start, Clock::now());
+        const unsigned nodes = static_cast<unsigned>(chains.size()) * chainLength;
+
+        const unsigned passes = std::max(OPERATIONS / nodes, 1u);
+        long sum = 0;
+        start = Clock::now();
+        for (unsigned pass = 0; pass < passes; ++pass)
+        {
+            for (ChainNode* node : chains)
+            {
+                for (; node; node = node->Next)
+                    sum += node->Value;
+            }
+        }
+        const uint64_t walkNs = ElapsedNs(start, Clock::now());
+
+        printf("nodes: %u  build: %.1f ns/node  traversal: %.2f ns/node  (sum %ld)\n",
+            nodes, static_cast<double>(buildNs) / nodes,
+            static_cast<double>(walkNs) / (static_cast<double>(passes) * nodes), sum);
+
+        for (ChainNode* node : chains)
+        {
+            while (node)
+            {
+                ChainNode* next = node->Next;
+                oa.Free(node);
+                node = next;
+            }
+        }
+        for (void* p : live)
+            oa.Free(p);
+    }
+    catch (const OAException& e)
+    {
+        cout << e.what() << endl;
+    }
+}
+
+void BenchPreload(bool preload)
+{
+    //driver-malloc and oa-malloc.so are expected in the current directory (see oa-malloc.cpp)
+    const std::string command = std::string(preload ? "LD_PRELOAD=./oa-malloc.so " : "")
+        + "./driver-malloc " + std::to_string(OPERATIONS);
+
+    std::fflush(stdout);
+    Clock::time_point start = Clock::now();
+    if (std::system(command.c_str()) != 0)
+    {
+        cout << "Failed to run: " << command << endl;
+        return;
+    }
+    printf("total: %.1f ms\n", static_cast<double>(ElapsedNs(start, Clock::now())) / 1e6);
+}
+
+template <typename E>
+void BenchNewEmployee()
+{
+    const unsigned maxLive = 16384;
+
+    std::vector<E*> live;
+    live.reserve(maxLive);
+
+    Digipen::Utils::srand(8, 3);
+    Clock::time_point start = Clock::now();
+    for (unsigned i = 0; i < OPERATIONS; ++i)
+    {
+        if (live.empty() || (live.size() < maxLive && Digipen::Utils::Random(0, 1) == 0))
+        {
+            E* employee = new E;
+            employee->years = static_cast<int>(i);
+            live.push_back(employee);
+        }
+        else
+        {
+            size_t index = static_cast<size_t>(Digipen::Utils::Random(0, static_cast<int>(live.size()) - 1));
+            delete live[index];
+            live[index] = live.back();
+            live.pop_back();
+        }
+    }
+    const uint64_t elapsed = ElapsedNs(start, Clock::now());
+
+    for (E* employee : live)
+        delete employee;
+
+    printf("new/delete: %u  %.1f ns/op\n", OPERATIONS, static_cast<double>(elapsed) / OPERATIONS);
+}
+
+// Containers get CONTAINER_ELEMENTS Particles, then half of them (picked at random) are erased
+// and as many are added back, so the heap's elements are scattered, then all are iterated
+const unsigned CONTAINER_ELEMENTS = 1 << 18;
+
+void PrintContainer(unsigned elements, uint64_t buildNs, unsigned passes, uint64_t walkNs, double sum)
+{
+    printf("elements: %u  build: %.1f ns/element  iteration: %.2f ns/element  (sum %.0f)\n",
+        elements, static_cast<double>(buildNs) / elements,
+        static_cast<double>(walkNs) / (static_cast<double>(passes) * elements), sum);
+}
+
+void BenchObjectPool()
+{
+    try
+    {
+        ObjectPool<Particle> pool;
+        std::vector<Particle*> order;
+        order.reserve(CONTAINER_ELEMENTS);
+
+        Digipen::Utils::srand(8, 3);
+        Clock::time_point start = Clock::now();
+        for (unsigned i = 0; i < CONTAINER_ELEMENTS; ++i)
+            order.push_back(pool.emplace(Particle{ { 0, 0, 0 }, { 1, 1, 1 }, static_cast<long>(i) }));
+        for (unsigned i = 0; i < CONTAINER_ELEMENTS / 2; ++i)
+        {
+            size_t index = static_cast<size_t>(Digipen::Utils::Random(0, static_cast<int>(order.size()) - 1));
+            pool.erase(order[index]);
+            order[index] = order.back();
+            order.pop_back();
+        }
+        for (unsigned i = 0; i < CONTAINER_ELEMENTS / 2; ++i)
+            order.push_back(pool.emplace(Particle{ { 0, 0, 0 }, { 1, 1, 1 }, static_cast<long>(i) }));
+        const uint64_t buildNs = ElapsedNs(start, Clock::now());
+
+        const unsigned passes = std::max(OPERATIONS / CONTAINER_ELEMENTS, 1u);
+        double sum = 0;
+        start = Clock::now();
+        for (unsigned pass = 0; pass < passes; ++pass)
+        {
+            for (Particle& particle : pool)
+            {
+                particle.Position[0] += particle.Velocity[0];
+                sum += particle.Position[0];
+            }
+        }
+        PrintContainer(static_cast<unsigned>(pool.size()), buildNs, passes, ElapsedNs(start, Clock::now()), sum);
+    }
+    catch (const OAException& e)
+    {
+        cout << e.what() << endl;
+    }
+}
+
+void BenchUniquePtrVector()
+{
+    std::vector<std::unique_ptr<Particle>> particles;
+    particles.reserve(CONTAINER_ELEMENTS);
+
+    Digipen::Utils::srand(8, 3);
+    Clock::time_point start = Clock::now();
+    for (unsigned i = 0; i < CONTAINER_ELEMENTS; ++i)
+        particles.emplace_back(new Particle{ { 0, 0, 0 }, { 1, 1, 1 }, static_cast<long>(i) });
+    for (unsigned i = 0; i < CONTAINER_ELEMENTS / 2; ++i)
+    {
+        size_t index = static_cast<size_t>(Digipen::Utils::Random(0, static_cast<int>(particles.size()) - 1));
+        particles[index] = std::move(particles.back());
+        particles.pop_back();
+    }
+    for (unsigned i = 0; i < CONTAINER_ELEMENTS / 2; ++i)
+        particles.emplace_back(new Particle{ { 0, 0, 0 }, { 1, 1, 1 }, static_cast<long>(i) });
+    const uint64_t buildNs = ElapsedNs(start, Clock::now());
+
+    const unsigned passes = std::max(OPERATIONS / CONTAINER_ELEMENTS, 1u);
+    double sum = 0;
+    start = Clock::now();
+    for (unsigned pass = 0; pass < passes; ++pass)
+    {
+        for (std::unique_ptr<Particle>& particle : particles)
+        {
+            particle->Position[0] += particle->Velocity[0];
+            sum += particle->Position[0];
+        }
+    }
+    PrintContainer(static_cast<unsigned>(particles.size()), buildNs, passes, ElapsedNs(start, Clock::now()), sum);
+}
+
+void BenchList()
+{
+    std::list<Particle> particles;
+    std::vector<std::list<Particle>::iterator> order;
+    order.reserve(CONTAINER_ELEMENTS);
+
+    Digipen::Utils::srand(8, 3);
+    Clock::time_point start = Clock::now();
+    for (unsigned i = 0; i < CONTAINER_ELEMENTS; ++i)
+        order.push_back(particles.insert(particles.end(), Particle{ { 0, 0, 0 }, { 1, 1, 1 }, static_cast<long>(i) }));
+    for (unsigned i = 0; i < CONTAINER_ELEMENTS / 2; ++i)
+    {
+        size_t index = static_cast<size_t>(Digipen::Utils::Random(0, static_cast<int>(order.size()) - 1));
+        particles.erase(order[index]);
+        order[index] = order.back();
+        order.pop_back();
+    }
+    for (unsigned i = 0; i < CONTAINER_ELEMENTS / 2; ++i)
+        order.push_back(particles.insert(particles.end(), Particle{ { 0, 0, 0 }, { 1, 1, 1 }, static_cast<long>(i) }));
+    const uint64_t buildNs = ElapsedNs(start, Clock::now());
+
+    const unsigned passes = std::max(OPERATIONS / CONTAINER_ELEMENTS, 1u);
+    double sum = 0;
+    start = Clock::now();
+    for (unsigned pass = 0; pass < passes; ++pass)
+    {
+        for (Particle& particle : particles)
+        {
+            particle.Position[0] += particle.Velocity[0];
+            sum += particle.Position[0];
+        }
+    }
+    PrintContainer(static_cast<unsigned>(particles.size()), buildNs, passes, ElapsedNs(start, Clock::now()), sum);
+}
+
+int main(int argc, char** argv)
+{
+    int bench = 0;
+    if (argc > 1)
+        bench = std::atoi(argv[1]);
+    if (argc > 2)
+        OPERATIONS = static_cast<unsigned>(std::atoi(argv[2]));
+
+    switch (bench)
+    {
+    case 1:
+        cout << "============================== Latency, default mode..." << endl;
+        BenchRealTimeLatency(false);
+        cout << endl;
+        break;
+    case 2:
+        cout << "============================== Latency, real-time mode..." << endl;
+        BenchRealTimeLatency(true);
+        cout << endl;
+        break;
+    case 3:
+        cout << "============================== Hot first objects, no coloring..." << endl;
+        BenchColoring(false);
+        cout << endl;
+        break;
+    case 4:
+        cout << "============================== Hot first objects, coloring..." << endl;
+        BenchColoring(true);
+        cout << endl;
+        break;
+    case 5:
+        cout << "============================== Chain traversal, Allocate..." << endl;
+        BenchNearTraversal(false);
+        cout << endl;
+        break;
+    case 6:
+        cout << "============================== Chain traversal, AllocateNear..." << endl;
+        BenchNearTraversal(true);
+        cout << endl;
+        break;
+    case 7:
+        cout << "============================== Unmodified program, C library malloc..." << endl;
+        BenchPreload(false);
+        cout << endl;
+        break;
+    case 8:
+        cout << "============================== Unmodified program, oa-malloc.so..." << endl;
+        BenchPreload(true);
+        cout << endl;
+        break;
+    case 9:
+        cout << "============================== new Employee, default..." << endl;
+        BenchNewEmployee<Employee>();
+        cout << endl;
+        break;
+    case 10:
+        cout << "============================== new Employee, Pooled..." << endl;
+        BenchNewEmployee<PooledEmployee>();
+        cout << endl;
+        break;
+    case 11:
+        cout << "============================== new Employee, Pooled per thread..." << endl;
+        BenchNewEmployee<ThreadPooledEmployee>();
+        cout << endl;
+        break;
+    case 12:
+        cout << "============================== Particles, ObjectPool..." << endl;
+        BenchObjectPool();
+        cout << endl;
+        break;
+    case 13:
+        cout << "============================== Particles, vector of unique_ptr..." << endl;
+        BenchUniquePtrVector();
+        cout << endl;
+        break;
+    case 14:
+        cout << "============================== Particles, std::list..." << endl;
+        BenchList();
+        cout << endl;
+        break;
+    default:
+        cout << "============================== Latency, default mode..." << endl;
+        BenchRealTimeLatency(false);
+        cout << endl;
+        cout << "============================== Latency, real-time mode..." << endl;
+        BenchRealTimeLatency(true);
+        cout << endl;
+        cout << "============================== Hot first objects, no coloring..." << endl;
+        BenchColoring(false);
+        cout << endl;
+        cout << "============================== Hot first objects, coloring..." << endl;
+        BenchColoring(true);
+        cout << endl;
+        cout << "============================== Chain traversal, Allocate..." << endl;
+        BenchNearTraversal(false);
+        cout << endl;
+        cout << "============================== Chain traversal, AllocateNear..." << endl;
+        BenchNearTraversal(true);
+        cout << endl;
+        cout << "============================== Unmodified program, C library malloc..." << endl;
+        BenchPreload(false);
+        cout << endl;
+        cout << "============================== Unmodified program, oa-malloc.so..." << endl;
+        BenchPreload(true);
+        cout << endl;
+        cout << "============================== new Employee, default..." << endl;
+        BenchNewEmployee<Employee>();
+        cout << endl;
+        cout << "============================== new Employee, Pooled..." << endl;
+        BenchNewEmployee<PooledEmployee>();
+        cout << endl;
+        cout << "============================== new Employee, Pooled per thread..." << endl;
+        BenchNewEmployee<ThreadPooledEmployee>();
+        cout << endl;
+        cout << "============================== Particles, ObjectPool..." << endl;
+        BenchObjectPool();
+        cout << endl;
+        cout << "============================== Particles, vector of unique_ptr..." << endl;
+        BenchUniquePtrVector();
+        cout << endl;
+        cout << "============================== Particles, std::list..." << endl;
+        BenchList();
+        cout << endl;
+        break;
+    }
+
+    return 0;
+}
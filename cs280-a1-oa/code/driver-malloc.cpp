@@ -0,0 +1,130 @@
+// An ordinary program that knows nothing of ObjectAllocator, for timing
+// oa-malloc.so against the C library's allocator:
+//   ./driver-malloc
+//   LD_PRELOAD=./oa-malloc.so ./driver-malloc
+// (driver-bench runs both)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <map>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+unsigned OPERATIONS = 4000000;
+const unsigned THREADS = 4;
+
+// Support functions
+unsigned NextRandom(unsigned& state);
+double ElapsedMs(Clock::time_point start);
+
+unsigned ChurnSmallBlocks(unsigned seed, unsigned operations); // random malloc/free/realloc of 8..512 bytes
+unsigned ChurnMap(unsigned operations);                        // std::map<int, std::string> insert/erase
+unsigned ChurnThreads();                                       // ChurnSmallBlocks on THREADS threads
+
+unsigned NextRandom(unsigned& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+double ElapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+unsigned ChurnSmallBlocks(unsigned seed, unsigned operations)
+{
+    const unsigned slots = 16384;
+    std::vector<char*> blocks(slots, nullptr);
+    unsigned checksum = 0;
+
+    for (unsigned i = 0; i < operations; ++i)
+    {
+        char*& block = blocks[NextRandom(seed) % slots];
+        const unsigned size = 8 + NextRandom(seed) % 505;
+        if (!block)
+        {
+            block = static_cast<char*>(std::malloc(size));
+            block[0] = static_cast<char>(size);
+        }
+        else if (NextRandom(seed) % 8 == 0)
+        {
+            block = static_cast<char*>(std::realloc(block, size));
+            block[size - 1] = 1;
+        }
+        else
+        {
+            checksum += static_cast<unsigned char>(block[0]);
+            std::free(block);
+            block = nullptr;
+        }
+    }
+
+    for (char* block : blocks)
+        std::free(block);
+    return checksum;
+}
+
+unsigned ChurnMap(unsigned operations)
+{
+    std::map<int, std::string> table;
+    unsigned seed = 2022;
+    unsigned checksum = 0;
+
+    for (unsigned i = 0; i < operations; ++i)
+    {
+        const int key = static_cast<int>(NextRandom(seed) % 65536);
+        std::map<int, std::string>::iterator it = table.find(key);
+        if (it == table.end())
+            table.emplace(key, std::string(16 + key % 48, 'x'));
+        else
+        {
+            checksum += static_cast<unsigned>(it->second.size());
+            table.erase(it);
+        }
+    }
+    return checksum;
+}
+
+unsigned ChurnThreads()
+{
+    std::vector<std::thread> threads;
+    std::vector<unsigned> checksums(THREADS, 0);
+    for (unsigned t = 0; t < THREADS; ++t)
+        threads.emplace_back([t, &checksums] { checksums[t] = ChurnSmallBlocks(7919 * (t + 1), OPERATIONS); });
+
+    unsigned checksum = 0;
+    for (unsigned t = 0; t < THREADS; ++t)
+    {
+        threads[t].join();
+        checksum += checksums[t];
+    }
+    return checksum;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        OPERATIONS = static_cast<unsigned>(std::atoi(argv[1]));
+
+    Clock::time_point start = Clock::now();
+    unsigned checksum = ChurnSmallBlocks(1, OPERATIONS);
+    printf("small blocks: %8.1f ms  (checksum %u)\n", ElapsedMs(start), checksum);
+
+    start = Clock::now();
+    checksum = ChurnMap(OPERATIONS);
+    printf("map:          %8.1f ms  (checksum %u)\n", ElapsedMs(start), checksum);
+
+    start = Clock::now();
+    checksum = ChurnThreads();
+    printf("%u threads:    %8.1f ms  (checksum %u)\n", THREADS, ElapsedMs(start), checksum);
+
+    return 0;
+}
@@ -2,6 +2,15 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 using std::cout;
 using std::endl;
@@ -57,6 +66,32 @@ void TestFreeEmptyPages2(void);       // debug, padding=2, header, align=16
 void TestFreeEmptyPages3(void);       // debug, padding=6
 void StressFreeChecking(void);        //
 void Stress(bool UseNewDelete);       // 
+void TestHandles(void);               // debug, padding=2, extended header, align=8
+void TestForEachLive(void);           // debug, align=8
+void TestArena(void);                 // debug, padding=2, header, align=8
+void TestMappedFile(void);            // debug, padding=2, header, align=8
+void TestSharedMemory(void);          // debug, header, align=8
+void TestSharedOwnerDeath(void);      // debug, padding=2, header, align=8, a process dies holding the lock
+void TestTrimIdlePages(void);         // debug, padding=2, align=8
+void TestReclamation(void);           // debug, align=8
+void TestFreeDeferred(void);          // debug, padding=2, header, align=8
+void TestIndexLinks(size_t size);     // debug, objects of 2 or 4 bytes
+void TestLazyFirstPage(void);         // debug, padding=2, header, align=8
+void TestTaggedPages(void);           // debug, padding=2, header, align=8
+void TestTryStatus(bool debug);       // padding=2, header, align=8, with and without debug
+void TestColoring(void);              // debug, 170 objects per page, align=8
+void TestAllocateNear(bool hints);    // debug, align=8
+void TestWatermarks(void);            // debug, padding=2, header, align=8
+void TestRealTime(void);              // debug, padding=2, header, align=8
+void TestAllocateWait(void);          // debug, padding=2, header, align=8, MaxPages=1
+void TestAllocateAsync(void);         // debug, padding=2, header, align=8, MaxPages=1 (C++20 only)
+void TestCompressed(void);            // align=8, no debug
+void TestPageCache(void);             // no debug, shared pages
+void TestAllocateZeroed(bool compressed); // debug, padding=2, header, align=8, or compressed
+void TestPooled(void);                // debug, padding=2, header, align=8, MaxPages=2, and PerThread
+void TestObjectPool(void);            // debug, padding=2, header, align=8
+void TestSnapshot(void);              // debug, padding=2, external header, align=8
+void TestSnapshotDiff(void);          // debug, padding=2, external header, align=8, keeps two snapshots
 
 struct Person
 {
@@ -1734,195 +1769,2663 @@ void TestAlignment(void)
 }
 
 
-void PrintCounts(const ObjectAllocator* nm)
+void TestHandles(void)
 {
-    OAStats stats = nm->GetStats();
-    cout << "Pages in use: " << stats.PagesInUse_;
-    cout << ", Objects in use: " << stats.ObjectsInUse_;
-    cout << ", Available objects: " << stats.FreeObjects_;
-    cout << ", Allocs: " << stats.Allocations_;
-    cout << ", Frees: " << stats.Deallocations_ << endl;
-}
+    ObjectAllocator* oa;
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbExtended, 2);
+        unsigned alignment = 8;
 
-void PrintCounts2(const ObjectAllocator* nm)
-{
-    OAStats stats = nm->GetStats();
-    cout << "Allocs: " << stats.Allocations_;
-    cout << ", Frees: " << stats.Deallocations_ << endl;
-}
+        OAConfig config(newdel, 4, 2, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
 
-void PrintConfig(const ObjectAllocator* oa)
-{
-    cout << "Object size = " << oa->GetStats().ObjectSize_;
-    cout << ", Page size = " << oa->GetStats().PageSize_;
-    cout << ", Pad bytes = " << oa->GetConfig().PadBytes_;
-    cout << ", ObjectsPerPage = " << oa->GetConfig().ObjectsPerPage_;
-    cout << ", MaxPages = " << oa->GetConfig().MaxPages_;
-    cout << ", MaxObjects = " << oa->GetConfig().ObjectsPerPage_ * oa->GetConfig().MaxPages_;
-    cout << endl;
-    cout << "Alignment = " << oa->GetConfig().Alignment_;
-    cout << ", LeftAlign = " << oa->GetConfig().LeftAlignSize_;
-    cout << ", InterAlign = " << oa->GetConfig().InterAlignSize_;
-    cout << ", HeaderBlocks = ";
-    if (oa->GetConfig().HBlockInfo_.type_ == OAConfig::hbNone)
-        cout << "None";
-    else if (oa->GetConfig().HBlockInfo_.type_ == OAConfig::hbBasic)
-        cout << "Basic";
-    else if (oa->GetConfig().HBlockInfo_.type_ == OAConfig::hbExtended)
-        cout << "Extended";
-    else if (oa->GetConfig().HBlockInfo_.type_ == OAConfig::hbExternal)
-        cout << "External";
-    cout << ", Header size = " << oa->GetConfig().HBlockInfo_.size_;
-    cout << endl;
-}
+        Student* s1 = static_cast<Student*>(oa->Allocate());
+        Student* s2 = static_cast<Student*>(oa->Allocate());
+        s1->ID = 1;
+        s2->ID = 2;
 
-void DumpPages(const ObjectAllocator* nm, unsigned width)
-{
-    const unsigned char* pages = static_cast<const unsigned char*>(nm->GetPageList());
-    const unsigned char* realpage = pages;
+        OAHandle h1 = oa->GetHandle(s1);
+        OAHandle h2 = oa->GetHandle(s2);
+        PrintCounts(oa);
+        printf("Handle 1 valid: %d, resolves to its object: %d\n", h1 != 0, oa->Resolve(h1) == s1);
+        printf("Handle 2 valid: %d, resolves to its object: %d\n", h2 != 0, oa->Resolve(h2) == s2);
+        printf("Handles differ: %d\n", h1 != h2);
 
-    size_t header_size = nm->GetConfig().HBlockInfo_.size_;
+        //****************************************************************************
+        // the block is freed, then reused for another object
+        oa->Free(s1);
+        printf("After Free: handle 1 resolves: %d, handle of a freed object: %llu\n",
+            oa->Resolve(h1) != 0, static_cast<unsigned long long>(oa->GetHandle(s1)));
 
-    while (pages)
-    {
-        unsigned count = 0;
+        Student* s3 = static_cast<Student*>(oa->Allocate());
+        OAHandle h3 = oa->GetHandle(s3);
+        printf("Block reused: %d, handle 1 resolves: %d, new handle resolves: %d, handles differ: %d\n",
+            s3 == s1, oa->Resolve(h1) != 0, oa->Resolve(h3) == s3, h1 != h3);
+        printf("Handle 2 still resolves: %d\n", oa->Resolve(h2) == s2);
 
-        if (SHOWREAL)
-            printf("%p\n", pages);
-        else
-            printf("XXXXXXXX\n");
+        //****************************************************************************
+        // every page goes back to the system, then is created again
+        oa->Release();
+        PrintCounts(oa);
+        printf("After Release: handle 2 resolves: %d, handle 3 resolves: %d\n", oa->Resolve(h2) != 0, oa->Resolve(h3) != 0);
 
-        // print column header
-        for (unsigned j = 0; j < width; j++)
-            printf(" %2i", j);
-        printf("\n");
+        Student* s4 = static_cast<Student*>(oa->Allocate());
+        OAHandle h4 = oa->GetHandle(s4);
+        PrintCounts(oa);
+        printf("After reallocating: handle 2 resolves: %d, handle 3 resolves: %d, new handle resolves: %d\n",
+            oa->Resolve(h2) != 0, oa->Resolve(h3) != 0, oa->Resolve(h4) == s4);
+        printf("Handle 0 resolves: %d, garbage handle resolves: %d\n", oa->Resolve(0) != 0, oa->Resolve(~OAHandle(0)) != 0);
 
-        // "Next page" pointer in the page
-        if (SHOWREAL)
-        {
-            for (unsigned i = 0; i < sizeof(void*); i++, count++)
-                printf(" %02X", *pages++);
-        }
+        oa->Free(s4);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
         else
-        {
-            for (unsigned j = 0; j < sizeof(void*); pages++, count++, j++)
-                printf(" %s", "XX");
-        }
+            cout << "Exception thrown during TestHandles." << endl;
 
+        return;
+    }
 
-        // Left leading alignment bytes
-        if (nm->GetConfig().Alignment_ > 1)
-        {
-            // leading alignment block (if any)
-            for (unsigned j = 0; j < nm->GetConfig().LeftAlignSize_; count++, j++)
-            {
-                if (count >= width)
-                {
-                    printf("\n");
-                    count = 0;
-                }
-                printf(" %02X", *pages++);
-            }
-        }
+    //handles need extended headers
+    try
+    {
+        OAConfig config(false, 4, 2, false, 0, OAConfig::HeaderBlockInfo(OAConfig::hbBasic), 0);
+        oa = new ObjectAllocator(sizeof(Student), config);
+        void* p = oa->Allocate();
+        printf("Handle with basic headers: %llu\n", static_cast<unsigned long long>(oa->GetHandle(p)));
+        oa->Free(p);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestHandles." << endl;
+    }
 
-        // Dump each object and its associated info
-        for (unsigned int i = 0; i < nm->GetConfig().ObjectsPerPage_; i++)
-        {
-            // inter-block alignment (not on first block)
-            if (i > 0)
-            {
-                for (unsigned j = 0; j < nm->GetConfig().InterAlignSize_; count++, j++)
-                {
-                    if (count >= width)
-                    {
-                        printf("\n");
-                        count = 0;
-                    }
-                    printf(" %02X", *pages++);
-                }
-            }
+    //the use counter wraps after 65536 uses of a block, but never to the invalid handle 0
+    try
+    {
+        OAConfig config(false, 1, 1, false, 0, OAConfig::HeaderBlockInfo(OAConfig::hbExtended), 0);
+        oa = new ObjectAllocator(sizeof(Student), config);
+        for (unsigned i = 1; i < 65536; i++)
+            oa->Free(oa->Allocate());
+        void* p = oa->Allocate();
+        OAHandle h = oa->GetHandle(p);
+        printf("Handle after the use counter wraps: valid: %d, resolves to its object: %d\n", h != 0, oa->Resolve(h) == p);
+        oa->Free(p);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestHandles." << endl;
+    }
+}
 
-            // header block bytes
-            for (unsigned j = 0; j < header_size; count++, j++)
-            {
-                if (count >= width)
-                {
-                    printf("\n");
-                    count = 0;
-                }
-                printf(" %02X", *pages++);
-            }
+void TestForEachLive(void)
+{
+    ObjectAllocator* oa;
+    const unsigned objects = 4;
+    const unsigned pages = 3;
+    const unsigned total = objects * pages;
+    Student* ptrs[total];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 0;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbNone);
+        unsigned alignment = 8;
 
-            // left padding
-            for (unsigned j = 0; j < nm->GetConfig().PadBytes_; count++, j++)
-            {
-                if (count >= width)
-                {
-                    printf("\n");
-                    count = 0;
-                }
-                printf(" %02X", *pages++);
-            }
+        OAConfig config(newdel, objects, pages, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
 
-            // possible next pointer (zero it out)
-            for (unsigned j = 0; j < sizeof(void*); count++, pages++, j++)
-            {
-                if (count >= width)
-                {
-                    printf("\n");
-                    count = 0;
-                }
-                if (SHOWREAL)
-                    printf(" %02X", *pages);
-                else
-                    printf(" %s", "XX");
-            }
+        for (unsigned i = 0; i < total; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i);
+        }
+        oa->Free(ptrs[1]);
+        oa->Free(ptrs[6]);
+        oa->Free(ptrs[10]);
+        oa->Free(ptrs[11]);
+        PrintCounts(oa);
 
-            // remaining bytes
-            for (unsigned j = 0; j < nm->GetStats().ObjectSize_ - sizeof(void*); count++, j++)
+        //****************************************************************************
+        // every live object once, in address order
+        unsigned count = 0;
+        bool ordered = true;
+        const void* previous = 0;
+        printf("Live IDs:");
+        oa->ForEachLive([&](void* object)
             {
-                if (count >= width)
-                {
-                    printf("\n");
-                    count = 0;
-                }
-                printf(" %02X", *pages++);
-            }
+                printf(" %ld", static_cast<Student*>(object)->ID);
+                ordered = ordered && object > previous;
+                previous = object;
+                ++count;
+            });
+        printf("\n");
+        printf("Visited: %u, in use: %u, address order: %d\n", count, oa->GetStats().ObjectsInUse_, ordered);
 
-            // right pad bytes
-            for (unsigned j = 0; j < nm->GetConfig().PadBytes_; count++, j++)
-            {
-                if (count >= width)
-                {
-                    printf("\n");
-                    count = 0;
-                }
-                printf(" %02X", *pages++);
-            }
+        //****************************************************************************
+        // the chunks cover each page exactly once
+        unsigned chunkTotal = 0;
+        for (size_t chunk = 0; chunk < pages; chunk++)
+        {
+            unsigned chunkCount = 0;
+            oa->ForEachLiveChunk(chunk, pages, [&chunkCount](void*) { ++chunkCount; });
+            printf("Chunk %u of %u: %u objects\n", static_cast<unsigned>(chunk), pages, chunkCount);
+            chunkTotal += chunkCount;
+        }
+        unsigned outOfRange = 0;
+        oa->ForEachLiveChunk(pages, pages, [&outOfRange](void*) { ++outOfRange; });
+        printf("All chunks: %u, chunk out of range: %u\n", chunkTotal, outOfRange);
 
+        //****************************************************************************
+        // a cursor walk that frees the object after the current one (skipped)
+        OALiveCursor cursor;
+        count = 0;
+        printf("Walk freeing every other object:");
+        for (oa->FirstLive(cursor); cursor.object_; oa->NextLive(cursor))
+        {
+            Student* student = static_cast<Student*>(cursor.object_);
+            printf(" %ld", student->ID);
+            ++count;
+
+            OALiveCursor next = cursor;
+            oa->NextLive(next);
+            if (next.object_)
+                oa->Free(next.object_);
         }
-        printf("\n\n");
+        printf("\n");
+        printf("Visited: %u, in use: %u\n", count, oa->GetStats().ObjectsInUse_);
 
-        pages = reinterpret_cast<const unsigned char*>((reinterpret_cast<const GenericObject*>(realpage))->Next);
-        realpage = pages;
+        count = 0;
+        oa->ForEachLive([&count](void*) { ++count; });
+        printf("Visited after the walk: %u\n", count);
+        PrintCounts(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestForEachLive." << endl;
+
+        return;
     }
 }
 
-void DumpExternalHeaders(const ObjectAllocator* oa, const unsigned char* p)
+void TestArena(void)
 {
-    unsigned char* page = const_cast<unsigned char*>(p);
+    ObjectAllocator* oa;
+    Student* ptrs[8];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
 
-    unsigned padbytes = oa->GetConfig().PadBytes_;
-    size_t header_size = oa->GetConfig().HBlockInfo_.size_;
-    unsigned leftalign = oa->GetConfig().LeftAlignSize_;
-    unsigned interalign = oa->GetConfig().InterAlignSize_;
-    unsigned count = oa->GetConfig().ObjectsPerPage_;
-    size_t offset = padbytes * 2 + header_size + interalign + oa->GetStats().ObjectSize_;
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
 
-    page += sizeof(void*); // the 'next' pointer
-    page += leftalign;      // the left alignment bytes (if any)
+        for (unsigned i = 0; i < 6; i++)
+            oa->Allocate();
+        PrintCounts(oa);
 
-      // We're now pointing at the beginning of the header block
+        //****************************************************************************
+        // Reset frees everything but keeps the pages
+        oa->Reset();
+        PrintCounts(oa);
+        for (unsigned i = 0; i < 3; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i + 1);
+        }
+        PrintCounts(oa);
+        DumpPages(oa, 32);
+
+        //****************************************************************************
+        // Rollback frees what was allocated after the mark
+        OAMark mark = oa->Mark();
+        for (unsigned i = 3; i < 8; i++)
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+        PrintCounts(oa);
+        printf("Rollback freed: %u\n", oa->Rollback(mark));
+        PrintCounts(oa);
+        printf("Objects before the mark: %ld %ld %ld\n", ptrs[0]->ID, ptrs[1]->ID, ptrs[2]->ID);
+        printf("Rollback again freed: %u\n", oa->Rollback(mark));
+
+        //****************************************************************************
+        // a scope frees what was allocated within it
+        {
+            OAArenaScope scope(*oa);
+            for (unsigned i = 0; i < 4; i++)
+                oa->Allocate();
+            PrintCounts(oa);
+        }
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // Release frees everything and gives the pages back
+        oa->Release();
+        PrintCounts(oa);
+        oa->Allocate();
+        PrintCounts(oa);
+        DumpPages(oa, 32);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestArena." << endl;
+
+        return;
+    }
+
+    //without headers only blocks that were free at the mark are freed, so a block
+    //freed and reused since then survives the rollback
+    try
+    {
+        OAConfig config(false, 4, 0, false, 0, OAConfig::HeaderBlockInfo(OAConfig::hbNone), 8);
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        for (unsigned i = 0; i < 3; i++)
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+        OAMark mark = oa->Mark();
+        oa->Free(ptrs[1]);
+        ptrs[3] = static_cast<Student*>(oa->Allocate());
+        ptrs[4] = static_cast<Student*>(oa->Allocate());
+        printf("Freed block reused: %d\n", ptrs[3] == ptrs[1]);
+        PrintCounts(oa);
+        printf("Rollback freed: %u\n", oa->Rollback(mark));
+        PrintCounts(oa);
+
+        oa->Free(ptrs[0]);
+        oa->Free(ptrs[2]);
+        oa->Free(ptrs[3]);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestArena." << endl;
+    }
+}
+
+void TestMappedFile(void)
+{
+    const char* path = "oa-driver-sample.map";
+    ObjectAllocator* oa;
+    Student* ptrs[6];
+    std::remove(path);
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 3, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config, path, ObjectAllocator::mtFile);
+        PrintCounts(oa);
+
+        for (unsigned i = 0; i < 6; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(100 + i);
+        }
+        oa->Free(ptrs[2]);
+        oa->Free(ptrs[4]);
+        oa->SetRoot(ptrs[5]);
+        oa->Sync();
+        PrintCounts(oa);
+        delete oa;
+
+        //****************************************************************************
+        // the same file resumes with every object and the stats intact
+        oa = new ObjectAllocator(sizeof(Student), config, path, ObjectAllocator::mtFile);
+        PrintCounts(oa);
+        Student* root = static_cast<Student*>(oa->GetRoot());
+        printf("Root: %ld\n", root ? root->ID : -1L);
+
+        long sum = 0;
+        unsigned count = 0;
+        oa->ForEachLive([&](void* object) { sum += static_cast<Student*>(object)->ID; ++count; });
+        printf("Live objects: %u, sum of IDs: %ld\n", count, sum);
+
+        // the free blocks are reused before a new page is made
+        for (unsigned i = 0; i < 3; i++)
+            oa->Allocate();
+        PrintCounts(oa);
+        delete oa;
+
+        //****************************************************************************
+        // and once more after the allocations above
+        oa = new ObjectAllocator(sizeof(Student), config, path, ObjectAllocator::mtFile);
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // the file holds every free block after a Reset, even if the process dies before Sync
+        // (a copy of the file taken while it is still mapped stands in for the crash)
+        oa->Reset();
+        oa->Allocate();
+        const char* copy = "oa-driver-sample-copy.map";
+        FILE* in = fopen(path, "rb");
+        FILE* out = fopen(copy, "wb");
+        char buffer[4096];
+        for (size_t n; in && out && (n = fread(buffer, 1, sizeof(buffer), in)) != 0; )
+            fwrite(buffer, 1, n, out);
+        if (in)
+            fclose(in);
+        if (out)
+            fclose(out);
+        delete oa;
+
+        oa = new ObjectAllocator(sizeof(Student), config, copy, ObjectAllocator::mtFile);
+        unsigned allocated = 0;
+        void* object = 0;
+        while (oa->TryAllocate(object) == ObjectAllocator::S_OK)
+            ++allocated;
+        printf("Allocated after the crash: %u\n", allocated);
+        delete oa;
+        std::remove(copy);
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestMappedFile." << endl;
+
+        std::remove(path);
+        return;
+    }
+
+    //a file made with another layout is refused
+    try
+    {
+        OAConfig config(false, 8, 3, true, 2, OAConfig::HeaderBlockInfo(OAConfig::hbBasic), 8);
+        oa = new ObjectAllocator(sizeof(Student), config, path, ObjectAllocator::mtFile);
+        cout << "Opened with another layout." << endl;
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (e.code() == OAException::E_CORRUPTED_BLOCK)
+            cout << "Other layout refused: E_CORRUPTED_BLOCK" << endl;
+        else
+            cout << "Exception thrown during TestMappedFile." << endl;
+    }
+    std::remove(path);
+}
+
+void TestSharedMemory(void)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    char name[64];
+    snprintf(name, sizeof(name), "/oa-driver-sample-%d", static_cast<int>(getpid()));
+    ObjectAllocator* oa;
+    Student* ptrs[6];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 0;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 3, debug, padbytes, header, alignment);
+        ObjectAllocator::UnlinkShared(name);
+        oa = new ObjectAllocator(sizeof(Student), config, name, ObjectAllocator::mtShared);
+        PrintCounts(oa);
+
+        for (unsigned i = 0; i < 6; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i + 1);
+        }
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // another process attaches by name and frees half of the objects; its
+        // copy of our mapping is in the way, so objects are passed as offsets
+        cout.flush();
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            int status = 0;
+            try
+            {
+                ObjectAllocator* other = new ObjectAllocator(sizeof(Student), config, name, ObjectAllocator::mtShared);
+                const uint8_t* base = static_cast<const uint8_t*>(oa->GetRegionBase());
+                uint8_t* otherBase = static_cast<uint8_t*>(const_cast<void*>(other->GetRegionBase()));
+                printf("Child: attached at the same address: %d\n", otherBase == base);
+
+                printf("Child: IDs seen:");
+                for (unsigned i = 0; i < 6; i++)
+                    printf(" %ld", reinterpret_cast<Student*>(otherBase + (reinterpret_cast<uint8_t*>(ptrs[i]) - base))->ID);
+                printf("\n");
+
+                for (unsigned i = 0; i < 6; i += 2)
+                    other->Free(otherBase + (reinterpret_cast<uint8_t*>(ptrs[i]) - base));
+                printf("Child: ");
+                PrintCounts(other);
+                delete other;
+            }
+            catch (const OAException& e)
+            {
+                if (SHOW_EXCEPTIONS)
+                    cout << e.what() << endl;
+                else
+                    cout << "Exception thrown during TestSharedMemory (child)." << endl;
+                status = 1;
+            }
+            cout.flush();
+            fflush(stdout);
+            _exit(status);
+        }
+
+        int status = 1;
+        if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            cout << "Child process failed." << endl;
+
+        //****************************************************************************
+        // the blocks freed by the child are ours to reuse, not to free again
+        PrintCounts(oa);
+        try
+        {
+            oa->Free(ptrs[0]);
+            cout << "Freed a block the child had freed." << endl;
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_MULTIPLE_FREE)
+                cout << "Double free caught: E_MULTIPLE_FREE" << endl;
+            else
+                cout << "Exception thrown during TestSharedMemory." << endl;
+        }
+
+        unsigned reused = 0;
+        for (unsigned i = 0; i < 3; i++)
+        {
+            void* p = oa->Allocate();
+            if (p == ptrs[0] || p == ptrs[2] || p == ptrs[4])
+                ++reused;
+        }
+        printf("Blocks freed by the child reused: %u\n", reused);
+        PrintCounts(oa);
+
+        delete oa;
+        ObjectAllocator::UnlinkShared(name);
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestSharedMemory." << endl;
+
+        ObjectAllocator::UnlinkShared(name);
+        return;
+    }
+#else
+    cout << "Shared memory pools need POSIX shared memory." << endl;
+#endif
+}
+
+void DieHoldingLock(const void*, size_t)
+{
+    fflush(stdout);
+    _exit(0);
+}
+
+void TestSharedOwnerDeath(void)
+{
+#ifdef __linux__
+    char name[64];
+    snprintf(name, sizeof(name), "/oa-driver-sample-dead-%d", static_cast<int>(getpid()));
+    ObjectAllocator* oa;
+    Student* ptrs[6];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 3, debug, padbytes, header, alignment);
+        ObjectAllocator::UnlinkShared(name);
+        oa = new ObjectAllocator(sizeof(Student), config, name, ObjectAllocator::mtShared);
+
+        for (unsigned i = 0; i < 6; i++)
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+        oa->Free(ptrs[5]);
+        oa->Free(ptrs[4]);
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // another process overwrites the link of the first free block, then dies
+        // inside FlushDeferred (the corrupted pad bytes call back into it) with the lock held
+        cout.flush();
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            try
+            {
+                ObjectAllocator* other = new ObjectAllocator(sizeof(Student), config, name, ObjectAllocator::mtShared);
+                const uint8_t* base = static_cast<const uint8_t*>(oa->GetRegionBase());
+                uint8_t* otherBase = static_cast<uint8_t*>(const_cast<void*>(other->GetRegionBase()));
+
+                uintptr_t badLink = 1;
+                memcpy(otherBase + (reinterpret_cast<uint8_t*>(ptrs[4]) - base), &badLink, sizeof(badLink));
+
+                uint8_t* deferred = otherBase + (reinterpret_cast<uint8_t*>(ptrs[0]) - base);
+                other->FreeDeferred(deferred);
+                deferred[-1] = 0;
+                printf("Child: dying in FlushDeferred\n");
+                other->FlushDeferred(DieHoldingLock);
+                printf("Child: still alive\n");
+            }
+            catch (const OAException& e)
+            {
+                if (SHOW_EXCEPTIONS)
+                    cout << e.what() << endl;
+                else
+                    cout << "Exception thrown during TestSharedOwnerDeath (child)." << endl;
+            }
+            cout.flush();
+            fflush(stdout);
+            _exit(1);
+        }
+
+        int status = 1;
+        if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            cout << "Child process failed." << endl;
+
+        //****************************************************************************
+        // the next lock repairs the state: the free list is cut after the block
+        // with the bad link, and the block the child had deferred stays in use
+        void* p = oa->Allocate();
+        printf("Allocated the first free block: %d\n", p == ptrs[4]);
+        PrintCounts(oa);
+
+        try
+        {
+            oa->Allocate();
+            cout << "Allocated past the cut." << endl;
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_NO_PAGES)
+                cout << "Out of blocks: E_NO_PAGES" << endl;
+            else
+                cout << "Exception thrown during TestSharedOwnerDeath." << endl;
+        }
+
+        //****************************************************************************
+        // blocks freed from now on are reused as usual
+        oa->Free(ptrs[1]);
+        printf("Freed block reused: %d\n", oa->Allocate() == ptrs[1]);
+        PrintCounts(oa);
+
+        delete oa;
+        ObjectAllocator::UnlinkShared(name);
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestSharedOwnerDeath." << endl;
+
+        ObjectAllocator::UnlinkShared(name);
+        return;
+    }
+#else
+    cout << "Recovering from a dead owner needs a robust mutex." << endl;
+#endif
+}
+
+void TestTrimIdlePages(void)
+{
+    ObjectAllocator* oa;
+    const unsigned objects = 512;
+    const unsigned total = objects * 3;
+    Student** ptrs = new Student*[total];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbNone);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, objects, 0, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        for (unsigned i = 0; i < total; i++)
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+        for (unsigned i = 0; i < objects * 2; i++)
+            oa->Free(ptrs[i]);
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // a page must stay empty for a whole period before it is trimmed
+        printf("Trimmed (pages used this period): %u\n", oa->TrimIdlePages());
+        printf("Trimmed (idle for a period): %u\n", oa->TrimIdlePages());
+        printf("Trimmed (already trimmed): %u\n", oa->TrimIdlePages(true));
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // trimmed pages are reused, with their patterns rewritten
+        for (unsigned i = 0; i < objects * 2; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i);
+        }
+        PrintCounts(oa);
+        printf("Corrupted blocks: %u\n", oa->ValidatePages(ValidateCallback));
+
+        long sum = 0;
+        for (unsigned i = 0; i < objects * 2; i++)
+            sum += ptrs[i]->ID;
+        printf("Sum of IDs: %ld\n", sum);
+        printf("Trimmed (pages in use): %u\n", oa->TrimIdlePages());
+
+        for (unsigned i = 0; i < total; i++)
+            oa->Free(ptrs[i]);
+        printf("Trimmed (empty, no allocations since the last call): %u\n", oa->TrimIdlePages());
+        printf("Trimmed (already trimmed): %u\n", oa->TrimIdlePages());
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // empty trimmed pages are freed as they are, whether partly refilled or not
+        oa->Free(oa->Allocate());
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        PrintCounts(oa);
+        ptrs[0] = static_cast<Student*>(oa->Allocate());
+        PrintCounts(oa);
+        printf("Corrupted blocks: %u\n", oa->ValidatePages(ValidateCallback));
+        oa->Free(ptrs[0]);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestTrimIdlePages." << endl;
+    }
+    delete[] ptrs;
+}
+
+void TestReclamation(void)
+{
+    ObjectAllocator* oa;
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 0;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbNone);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 16, 0, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
+        Student* ptrs[8];
+        for (unsigned i = 0; i < 8; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i + 1);
+        }
+
+        {
+            OAReclaimer reclaimer(*oa);
+            OAReclaimer::Participant reader(reclaimer);
+            OAReclaimer::Participant writer(reclaimer);
+
+            //****************************************************************************
+            // retired objects outlive the read section that could see them
+            reader.Enter();
+            for (unsigned i = 0; i < 4; i++)
+                writer.Retire(ptrs[i]);
+            writer.Collect();
+            writer.Collect();
+            PrintCounts(oa);
+            printf("Reader still sees IDs: %ld %ld %ld %ld\n", ptrs[0]->ID, ptrs[1]->ID, ptrs[2]->ID, ptrs[3]->ID);
+
+            reader.Exit();
+            writer.Collect();
+            PrintCounts(oa);
+
+            //****************************************************************************
+            // nested sections end with the outermost Exit
+            {
+                OAReadGuard outer(reader);
+                OAReadGuard inner(reader);
+                writer.Retire(ptrs[4]);
+                writer.Collect();
+                writer.Collect();
+            }
+            PrintCounts(oa);
+            writer.Collect();
+            writer.Collect();
+            PrintCounts(oa);
+
+            //****************************************************************************
+            // a batch of BATCH_SIZE retires collects by itself
+            unsigned before = oa->GetStats().Deallocations_;
+            for (unsigned i = 0; i < OAReclaimer::BATCH_SIZE * 3; i++)
+                writer.Retire(oa->Allocate());
+            printf("Freed without calling Collect: %d\n", oa->GetStats().Deallocations_ > before);
+
+            // what is left when the writer goes away goes back with the reclaimer
+            writer.Retire(ptrs[5]);
+        }
+        PrintCounts(oa);
+
+        oa->Free(ptrs[6]);
+        oa->Free(ptrs[7]);
+        PrintCounts(oa);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestReclamation." << endl;
+    }
+}
+
+void TestFreeDeferred(void)
+{
+    ObjectAllocator* oa;
+    Student* ptrs[4];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        for (unsigned i = 0; i < 4; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i + 1);
+        }
+
+        //****************************************************************************
+        // deferred objects stay readable (past their link) until the flush
+        for (unsigned i = 0; i < 3; i++)
+            oa->FreeDeferred(ptrs[i]);
+        PrintCounts(oa);
+        printf("Deferred IDs: %ld %ld %ld\n", ptrs[0]->ID, ptrs[1]->ID, ptrs[2]->ID);
+
+        try
+        {
+            oa->FreeDeferred(ptrs[0]);
+            cout << "Deferred the same object twice." << endl;
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_MULTIPLE_FREE)
+                cout << "Second FreeDeferred caught: E_MULTIPLE_FREE" << endl;
+            else
+                cout << "Exception thrown during TestFreeDeferred." << endl;
+        }
+        try
+        {
+            oa->Free(ptrs[1]);
+            cout << "Freed a deferred object." << endl;
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_MULTIPLE_FREE)
+                cout << "Free of a deferred object caught: E_MULTIPLE_FREE" << endl;
+            else
+                cout << "Exception thrown during TestFreeDeferred." << endl;
+        }
+
+        //****************************************************************************
+        // the flush frees them all and checks their pad bytes in one pass
+        reinterpret_cast<unsigned char*>(ptrs[2])[sizeof(Student)] = 0;
+        printf("Flushed: %u\n", oa->FlushDeferred(ValidateCallback));
+        PrintCounts(oa);
+        printf("Flushed again: %u\n", oa->FlushDeferred(ValidateCallback));
+        DumpPages(oa, 32);
+
+        // the last object emptying the page is deferred, FreeEmptyPages leaves the page alone
+        oa->FreeDeferred(ptrs[3]);
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        printf("Deferred ID: %ld\n", ptrs[3]->ID);
+        PrintCounts(oa);
+        printf("Flushed: %u\n", oa->FlushDeferred());
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // Reset frees deferred objects along with the rest
+        ptrs[0] = static_cast<Student*>(oa->Allocate());
+        ptrs[1] = static_cast<Student*>(oa->Allocate());
+        oa->FreeDeferred(ptrs[0]);
+        oa->Reset();
+        PrintCounts(oa);
+        printf("Flushed after Reset: %u\n", oa->FlushDeferred());
+        DumpPages(oa, 32);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestFreeDeferred." << endl;
+
+        return;
+    }
+
+    //objects from new/delete that can hold one link but not two
+    try
+    {
+        OAConfig config(true, 4, 0, false, 0, OAConfig::HeaderBlockInfo(OAConfig::hbNone), 0);
+        config.PlacementHints_ = true;
+        oa = new ObjectAllocator(12, config);
+
+        void* p[4];
+        for (unsigned i = 0; i < 4; i++)
+            p[i] = oa->Allocate();
+        for (unsigned i = 0; i < 4; i++)
+            oa->FreeDeferred(p[i]);
+        printf("Flushed (new/delete): %u\n", oa->FlushDeferred());
+        PrintCounts2(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestFreeDeferred." << endl;
+    }
+}
+
+void TestIndexLinks(size_t size)
+{
+    ObjectAllocator* oa;
+    const unsigned objects = 8;
+    const unsigned total = objects * 3;
+    unsigned char* ptrs[total];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 0;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbNone);
+        unsigned alignment = 0;
+
+        OAConfig config(newdel, objects, 0, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(size, config);
+        PrintConfig(oa);
+
+        for (unsigned i = 0; i < total; i++)
+        {
+            ptrs[i] = static_cast<unsigned char*>(oa->Allocate());
+            unsigned value = i + 1;
+            memcpy(ptrs[i], &value, size);
+        }
+
+        //****************************************************************************
+        // freed blocks hold a link of `size` bytes and leave their neighbors alone
+        for (unsigned i = total; i > 0; i -= 2)
+            oa->Free(ptrs[i - 1]);
+        PrintCounts(oa);
+
+        unsigned intact = 0;
+        for (unsigned i = 0; i < total; i += 2)
+        {
+            unsigned value = 0;
+            memcpy(&value, ptrs[i], size);
+            if (value == i + 1)
+                ++intact;
+        }
+        printf("Live objects intact: %u of %u\n", intact, total / 2);
+
+        try
+        {
+            oa->Free(ptrs[total - 1]);
+            cout << "Freed an object twice." << endl;
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_MULTIPLE_FREE)
+                cout << "Double free caught: E_MULTIPLE_FREE" << endl;
+            else
+                cout << "Exception thrown during TestIndexLinks." << endl;
+        }
+
+        //****************************************************************************
+        // the free list is followed back through every page
+        unsigned reused = 0;
+        unsigned char* first = static_cast<unsigned char*>(oa->Allocate());
+        bool lifo = first == ptrs[1];
+        for (unsigned i = 1; i < total / 2; i++)
+        {
+            unsigned char* p = static_cast<unsigned char*>(oa->Allocate());
+            for (unsigned j = 1; j < total; j += 2)
+                if (p == ptrs[j])
+                    ++reused;
+        }
+        printf("First block is the last freed: %d, others reused: %u of %u\n", lifo, reused, total / 2 - 1);
+        PrintCounts(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestIndexLinks." << endl;
+
+        return;
+    }
+
+    if (size != sizeof(uint16_t))
+        return;
+
+    //2-byte links count blocks, so they reach only 65535 blocks' worth of pages
+    try
+    {
+        OAConfig config(false, 16384, 0, false, 0, OAConfig::HeaderBlockInfo(OAConfig::hbNone), 0);
+        oa = new ObjectAllocator(size, config);
+        unsigned allocated = 0;
+        try
+        {
+            for (;;)
+            {
+                oa->Allocate();
+                ++allocated;
+            }
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_NO_PAGES)
+                printf("Page limit: %u pages (%u objects)\n", oa->GetStats().PagesInUse_, allocated);
+            else
+                cout << "Exception thrown during TestIndexLinks." << endl;
+        }
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestIndexLinks." << endl;
+    }
+
+    //a single byte can't hold a link
+    try
+    {
+        oa = new ObjectAllocator(1, OAConfig(false, 8, 0));
+        cout << "Created an allocator of 1-byte objects." << endl;
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (e.code() == OAException::E_NO_MEMORY)
+            cout << "1-byte objects refused: E_NO_MEMORY" << endl;
+        else
+            cout << "Exception thrown during TestIndexLinks." << endl;
+    }
+}
+
+void TestLazyFirstPage(void)
+{
+    ObjectAllocator* oa;
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 2, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
+        printf("Eager: ");
+        PrintCounts(oa);
+        delete oa;
+
+        //****************************************************************************
+        // no page until the first Allocate
+        config.LazyFirstPage_ = true;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        printf("Lazy: ");
+        PrintCounts(oa);
+        printf("Page list empty: %d, empty pages freed: %u\n", oa->GetPageList() == 0, oa->FreeEmptyPages());
+
+        void* ptrs[8];
+        ptrs[0] = oa->Allocate();
+        PrintCounts(oa);
+        DumpPages(oa, 32);
+
+        oa->Free(ptrs[0]);
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        PrintCounts(oa);
+        ptrs[0] = oa->Allocate();
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // the first page counts towards MaxPages like any other
+        for (unsigned i = 1; i < 8; i++)
+            ptrs[i] = oa->Allocate();
+        PrintCounts(oa);
+        void* extra = 0;
+        printf("Past MaxPages: %s\n", oa->TryAllocate(extra) == ObjectAllocator::S_NO_PAGES ? "S_NO_PAGES" : "allocated");
+
+        for (unsigned i = 0; i < 8; i++)
+            oa->Free(ptrs[i]);
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        PrintCounts(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestLazyFirstPage." << endl;
+    }
+}
+
+// Whether two objects lie on the same page of an allocator
+bool SamePage(const ObjectAllocator* oa, const void* a, const void* b)
+{
+    const unsigned char* pa = static_cast<const unsigned char*>(a);
+    const unsigned char* pb = static_cast<const unsigned char*>(b);
+    for (const GenericObject* page = static_cast<const GenericObject*>(oa->GetPageList()); page; page = page->Next)
+    {
+        const unsigned char* start = reinterpret_cast<const unsigned char*>(page);
+        const unsigned char* end = start + oa->GetStats().PageSize_;
+        if (pa >= start && pa < end)
+            return pb >= start && pb < end;
+    }
+    return false;
+}
+
+// Waits up to 5 seconds for the maintenance thread to bring the free objects of an allocator into [low, high]
+bool WaitForFreeObjects(const ObjectAllocator* oa, unsigned low, unsigned high)
+{
+    for (unsigned ms = 0; ms < 5000; ms++)
+    {
+        const unsigned free = oa->GetStats().FreeObjects_;
+        if (free >= low && free <= high)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+void TestTaggedPages(void)
+{
+    ObjectAllocator* oa;
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        config.Tags_ = 3;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // each tag gets pages of its own
+        void* untagged = oa->Allocate();
+        void* tag1[3];
+        void* tag2[5];
+        for (unsigned i = 0; i < 3; i++)
+            tag1[i] = oa->AllocateTagged(1);
+        for (unsigned i = 0; i < 4; i++)
+            tag2[i] = oa->AllocateTagged(2);
+        PrintCounts(oa);
+
+        printf("Tag 1 objects share a page: %d, apart from tag 0: %d\n",
+            SamePage(oa, tag1[0], tag1[1]) && SamePage(oa, tag1[0], tag1[2]), !SamePage(oa, tag1[0], untagged));
+        printf("Tag 2 objects share a page: %d, apart from tags 0 and 1: %d\n",
+            SamePage(oa, tag2[0], tag2[1]) && SamePage(oa, tag2[0], tag2[2]) && SamePage(oa, tag2[0], tag2[3]),
+            !SamePage(oa, tag2[0], untagged) && !SamePage(oa, tag2[0], tag1[0]));
+
+        // a full tag makes a new page even though other tags have free blocks
+        tag2[4] = oa->AllocateTagged(2);
+        printf("Tag 2 overflow on a new page: %d\n",
+            !SamePage(oa, tag2[4], tag2[0]) && !SamePage(oa, tag2[4], untagged) && !SamePage(oa, tag2[4], tag1[0]));
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // a tag's pages empty out together
+        for (unsigned i = 0; i < 3; i++)
+            oa->Free(tag1[i]);
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        PrintCounts(oa);
+
+        // the tag then starts a new page rather than take another tag's free blocks
+        tag1[0] = oa->AllocateTagged(1);
+        printf("Tag 1 on a new page: %d\n",
+            !SamePage(oa, tag1[0], untagged) && !SamePage(oa, tag1[0], tag2[0]) && !SamePage(oa, tag1[0], tag2[4]));
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // tags past Tags_ are a bad argument, not an exhausted allocator
+        void* bad = 0;
+        printf("TryAllocateTagged(3): %s\n", oa->TryAllocateTagged(bad, 3) == ObjectAllocator::S_BAD_BOUNDARY ? "S_BAD_BOUNDARY" : "other");
+        try
+        {
+            oa->AllocateTagged(5);
+            cout << "Allocated with tag 5." << endl;
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_BAD_BOUNDARY)
+                cout << "AllocateTagged(5): E_BAD_BOUNDARY: " << e.what() << endl;
+            else
+                cout << "Exception thrown during TestTaggedPages." << endl;
+        }
+
+        oa->Free(untagged);
+        oa->Free(tag1[0]);
+        for (unsigned i = 0; i < 5; i++)
+            oa->Free(tag2[i]);
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        PrintCounts(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestTaggedPages." << endl;
+    }
+
+    //pages made ahead by the maintenance thread go to the tag allocated from last
+    try
+    {
+        OAConfig config(false, 4, 0, false, 0, OAConfig::HeaderBlockInfo(OAConfig::hbNone), 0);
+        config.Tags_ = 3;
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        void* tagged[11];
+        tagged[0] = oa->AllocateTagged(2);
+        oa->StartMaintenance(12, 100, 1);
+        bool grown = WaitForFreeObjects(oa, 12, 100);
+        oa->StopMaintenance();
+        const unsigned pages = oa->GetStats().PagesInUse_;
+        printf("Pages made ahead: %d\n", grown);
+        PrintCounts(oa);
+
+        for (unsigned i = 1; i < 11; i++)
+            tagged[i] = oa->AllocateTagged(2);
+        printf("Tag 2 allocations took the pages made ahead: %d\n", oa->GetStats().PagesInUse_ == pages);
+
+        for (unsigned i = 0; i < 11; i++)
+            oa->Free(tagged[i]);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestTaggedPages." << endl;
+    }
+}
+
+// Name of a status code returned by the Try* functions
+const char* StatusName(ObjectAllocator::OA_STATUS status)
+{
+    switch (status)
+    {
+    case ObjectAllocator::S_OK:
+        return "S_OK";
+    case ObjectAllocator::S_NO_MEMORY:
+        return "S_NO_MEMORY";
+    case ObjectAllocator::S_NO_PAGES:
+        return "S_NO_PAGES";
+    case ObjectAllocator::S_BAD_BOUNDARY:
+        return "S_BAD_BOUNDARY";
+    case ObjectAllocator::S_MULTIPLE_FREE:
+        return "S_MULTIPLE_FREE";
+    case ObjectAllocator::S_CORRUPTED_BLOCK:
+        return "S_CORRUPTED_BLOCK";
+    }
+    return "unknown";
+}
+
+void TestTryStatus(bool debug)
+{
+    ObjectAllocator* oa;
+    try
+    {
+        bool newdel = false;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 2, debug, padbytes, header, alignment);
+        config.TrackLive_ = true;   // bad pointers are refused outside debug too
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        //****************************************************************************
+        // allocate until the pages run out, which is a status and not an exception
+        void* ptrs[8];
+        ObjectAllocator::OA_STATUS status = ObjectAllocator::S_OK;
+        unsigned allocated = 0;
+        while (allocated < 8 && (status = oa->TryAllocate(ptrs[allocated])) == ObjectAllocator::S_OK)
+            allocated++;
+        void* extra = 0;
+        status = oa->TryAllocate(extra);
+        printf("Allocated: %u, then: %s, object returned: %d\n", allocated, StatusName(status), extra != 0);
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // bad pointers are refused without touching the allocator
+        Student local;
+        printf("TryFree(misaligned): %s\n", StatusName(oa->TryFree(static_cast<char*>(ptrs[0]) + 4)));
+        printf("TryFree(not a page): %s\n", StatusName(oa->TryFree(&local)));
+        printf("TryFree(nullptr): %s\n", StatusName(oa->TryFree(0)));
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // debug checks report through the status too
+        printf("TryFree: %s\n", StatusName(oa->TryFree(ptrs[0])));
+        if (debug)
+        {
+            printf("TryFree again: %s\n", StatusName(oa->TryFree(ptrs[0])));
+            static_cast<unsigned char*>(ptrs[1])[sizeof(Student)] = 0;
+            printf("TryFree(corrupted): %s\n", StatusName(oa->TryFree(ptrs[1])));
+            static_cast<unsigned char*>(ptrs[1])[sizeof(Student)] = ObjectAllocator::PAD_PATTERN;
+        }
+        PrintCounts(oa);
+
+        for (unsigned i = 1; i < allocated; i++)
+            oa->Free(ptrs[i]);
+        PrintCounts(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestTryStatus." << endl;
+    }
+}
+
+// Color of a heap page of a Coloring_ allocator, kept in the byte before the page
+unsigned PageColor(const void* page)
+{
+    return static_cast<const unsigned char*>(page)[-1];
+}
+
+void TestColoring(void)
+{
+    ObjectAllocator* oa;
+    const unsigned objects = 170;
+    const unsigned pages = 10;
+    Student* ptrs[objects * pages];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 0;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbNone);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, objects, 0, debug, padbytes, header, alignment);
+        config.Coloring_ = true;
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        //****************************************************************************
+        // each new page takes the next color, back to 0 after the last
+        bool aligned = true;
+        for (unsigned i = 0; i < objects * pages - 1; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i);
+            aligned = aligned && reinterpret_cast<size_t>(ptrs[i]) % alignment == 0;
+        }
+        PrintCounts(oa);
+
+        const GenericObject* list[pages];
+        unsigned count = 0;
+        for (const GenericObject* page = static_cast<const GenericObject*>(oa->GetPageList()); page && count < pages; page = page->Next)
+            list[count++] = page;
+        printf("Page colors, oldest first:");
+        for (unsigned i = count; i-- > 0;)
+            printf(" %u", PageColor(list[i]));
+        printf("\n");
+        printf("Objects aligned: %d, corrupted blocks: %u\n", aligned, oa->ValidatePages(0));
+
+        bool intact = true;
+        for (unsigned i = 0; i < objects * pages - 1; i++)
+        {
+            intact = intact && ptrs[i]->ID == static_cast<long>(i);
+            oa->Free(ptrs[i]);
+        }
+        printf("Objects intact: %d, empty pages freed: %u\n", intact, oa->FreeEmptyPages());
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // the maintenance thread takes colors while this thread makes pages too, 
+        // every page still gets a color of its own in turn
+        oa->StartMaintenance(objects * 4, objects * 100, 1);
+        for (unsigned i = 0; i < objects * pages; i++)
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+        bool grown = WaitForFreeObjects(oa, objects * 4, objects * 100);
+        oa->StopMaintenance();
+
+        unsigned colors[8] = { 0 };
+        unsigned made = 0;
+        bool valid = true;
+        for (const GenericObject* page = static_cast<const GenericObject*>(oa->GetPageList()); page; page = page->Next, made++)
+        {
+            valid = valid && PageColor(page) < 8;
+            if (PageColor(page) < 8)
+                colors[PageColor(page)]++;
+        }
+        unsigned least = colors[0];
+        unsigned most = colors[0];
+        for (unsigned i = 1; i < 8; i++)
+        {
+            least = colors[i] < least ? colors[i] : least;
+            most = colors[i] > most ? colors[i] : most;
+        }
+        printf("Pages made ahead: %d, more than %u pages: %d, colors valid: %d, balanced: %d\n",
+            grown, pages, made > pages, valid, most - least <= 1);
+
+        for (unsigned i = 0; i < objects * pages; i++)
+            oa->Free(ptrs[i]);
+        oa->FreeEmptyPages();
+        PrintCounts(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestColoring." << endl;
+    }
+}
+
+void TestAllocateNear(bool hints)
+{
+    ObjectAllocator* oa;
+    Student* ptrs[24];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 0;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbNone);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 8, 0, debug, padbytes, header, alignment);
+        config.PlacementHints_ = hints;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        printf("PlacementHints_: %d\n", hints);
+
+        for (unsigned i = 0; i < 24; i++)
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+        for (unsigned i = 1; i < 24; i += 2)
+            oa->Free(ptrs[i]);
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // the free list starts on the last page, the object goes on the hint's page
+        Student* near = static_cast<Student*>(oa->AllocateNear(ptrs[0]));
+        printf("Near the first page: %d, same as Allocate: %d\n", SamePage(oa, near, ptrs[0]), SamePage(oa, near, ptrs[23]));
+        near = static_cast<Student*>(oa->AllocateNear(ptrs[8]));
+        printf("Near the second page: %d\n", SamePage(oa, near, ptrs[8]));
+        PrintCounts(oa);
+
+        // a page holding deferred objects is searched only without PlacementHints_
+        oa->FreeDeferred(ptrs[2]);
+        near = static_cast<Student*>(oa->AllocateNear(ptrs[0]));
+        printf("Near the first page with a deferred object: %d\n", SamePage(oa, near, ptrs[0]));
+        printf("Flushed: %u\n", oa->FlushDeferred());
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // after Reset, PlacementHints_ refills the hint's page first
+        oa->Reset();
+        near = static_cast<Student*>(oa->AllocateNear(ptrs[23]));
+        printf("Near the last page after Reset: %d\n", SamePage(oa, near, ptrs[23]));
+        near = static_cast<Student*>(oa->AllocateNear(ptrs[23]));
+        printf("Near the last page again: %d\n", SamePage(oa, near, ptrs[23]));
+        PrintCounts(oa);
+        printf("Corrupted blocks: %u\n", oa->ValidatePages(ValidateCallback));
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestAllocateNear." << endl;
+    }
+}
+
+void TestWatermarks(void)
+{
+    ObjectAllocator* oa;
+    Student* ptrs[20];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
+        oa->StartMaintenance(8, 16, 1);
+
+        //****************************************************************************
+        // the worker keeps at least 8 objects free as objects are taken
+        printf("Grown to the low watermark: %d\n", WaitForFreeObjects(oa, 8, 16));
+        for (unsigned i = 0; i < 20; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i + 1);
+        }
+        printf("Grown again after 20 allocations: %d\n", WaitForFreeObjects(oa, 8, 1000));
+
+        //****************************************************************************
+        // above the high watermark empty pages are freed, but not those of deferred objects
+        for (unsigned i = 0; i < 12; i++)
+            oa->Free(ptrs[i]);
+        for (unsigned i = 12; i < 20; i++)
+            oa->FreeDeferred(ptrs[i]);
+        printf("Shrunk to the high watermark: %d\n", WaitForFreeObjects(oa, 16, 19));
+        long sum = 0;
+        for (unsigned i = 12; i < 20; i++)
+            sum += ptrs[i]->ID;
+        printf("Sum of deferred IDs: %ld\n", sum);
+        printf("Objects in use: %u\n", oa->GetStats().ObjectsInUse_);
+
+        // once flushed, empty pages are freed down to the high watermark
+        printf("Flushed: %u\n", oa->FlushDeferred());
+        printf("Shrunk to the high watermark: %d\n", WaitForFreeObjects(oa, 16, 19));
+        printf("Corrupted blocks: %u\n", oa->ValidatePages(ValidateCallback));
+
+        oa->StopMaintenance();
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestWatermarks." << endl;
+    }
+}
+
+void TestRealTime(void)
+{
+    ObjectAllocator* oa;
+    void* ptrs[12];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 3, debug, padbytes, header, alignment);
+        config.RealTime_ = true;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // every page exists after construction and the same pages serve everything below
+        const void* pages[3] = {};
+        unsigned count = 0;
+        for (const GenericObject* page = static_cast<const GenericObject*>(oa->GetPageList()); page && count < 3; page = page->Next)
+            pages[count++] = page;
+
+        // (the Try calls never throw, whose message would allocate)
+        unsigned allocated = 0;
+        while (allocated < 12 && oa->TryAllocate(ptrs[allocated]) == ObjectAllocator::S_OK)
+            ++allocated;
+        void* extra = 0;
+        printf("Allocated: %u, then %s\n", allocated, StatusName(oa->TryAllocate(extra)));
+        for (unsigned i = 0; i < allocated; i++)
+            oa->TryFree(ptrs[i]);
+        PrintCounts(oa);
+
+        // pages are never given back
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        oa->Release();
+        PrintCounts(oa);
+        oa->Reset();
+        for (unsigned i = 0; i < 12; i++)
+            oa->TryAllocate(ptrs[i]);
+        PrintCounts(oa);
+
+        unsigned same = 0;
+        for (const GenericObject* page = static_cast<const GenericObject*>(oa->GetPageList()); page; page = page->Next)
+            same += page == pages[0] || page == pages[1] || page == pages[2];
+        bool inPages = true;
+        for (unsigned i = 0; i < 12; i++)
+            inPages = inPages && (SamePage(oa, ptrs[i], pages[0]) || SamePage(oa, ptrs[i], pages[1]) || SamePage(oa, ptrs[i], pages[2]));
+        printf("Pages from construction: %u, objects on them: %d\n", same, inPages);
+        printf("Corrupted blocks: %u\n", oa->ValidatePages(ValidateCallback));
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestRealTime." << endl;
+    }
+
+    //pages of a real-time allocator come from one block, which needs a page limit
+    try
+    {
+        OAConfig config(false, 4, 0, false, 0, OAConfig::HeaderBlockInfo(OAConfig::hbNone), 8);
+        config.RealTime_ = true;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        cout << "Created without MaxPages_." << endl;
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (e.code() == OAException::E_NO_MEMORY)
+            cout << "No MaxPages_ refused: E_NO_MEMORY" << endl;
+        else
+            cout << "Exception thrown during TestRealTime." << endl;
+    }
+}
+
+void TestAllocateWait(void)
+{
+    ObjectAllocator* oa;
+    void* ptrs[4];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 1, debug, padbytes, header, alignment);
+        config.Blocking_ = true;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        for (unsigned i = 0; i < 4; i++)
+            ptrs[i] = oa->Allocate();
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // nothing is freed, the wait times out
+        void* object = 0;
+        printf("AllocateWait (no Free): %s\n", StatusName(oa->AllocateWait(object, 20)));
+
+        // another thread's Free wakes the waiter, which gets the freed object
+        std::thread freer([oa, &ptrs]()
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                oa->Free(ptrs[2]);
+            });
+        ObjectAllocator::OA_STATUS status = oa->AllocateWait(object, 5000);
+        freer.join();
+        printf("AllocateWait (Free on another thread): %s, got the freed object: %d\n", StatusName(status), object == ptrs[2]);
+        PrintCounts(oa);
+
+        for (unsigned i = 0; i < 4; i++)
+            oa->Free(ptrs[i]);
+        printf("AllocateWait (objects free): %s\n", StatusName(oa->AllocateWait(object, 0)));
+        oa->Free(object);
+        PrintCounts(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestAllocateWait." << endl;
+    }
+}
+
+#ifdef OA_HAS_COROUTINES
+// A coroutine that starts at once and is never awaited, it just takes an object
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+DetachedTask TakeObject(ObjectAllocator* oa, void** object, unsigned* order, unsigned* resumed)
+{
+    *object = co_await oa->AllocateAsync();
+    *order = ++*resumed;
+}
+#endif
+
+// Needs C++20 coroutines: output-sample-async-LP64.txt is the output of a -std=c++20
+// build, older standards print the notice in output-sample-async-cpp17-LP64.txt
+void TestAllocateAsync(void)
+{
+#ifdef OA_HAS_COROUTINES
+    ObjectAllocator* oa;
+    void* ptrs[4];
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 1, debug, padbytes, header, alignment);
+        config.Blocking_ = true;
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        //****************************************************************************
+        // with objects free the coroutine doesn't suspend
+        void* objects[3] = {};
+        unsigned order[3] = {};
+        unsigned resumed = 0;
+        TakeObject(oa, &objects[0], &order[0], &resumed);
+        printf("Allocated at once: %d\n", objects[0] != 0);
+        ptrs[0] = objects[0];
+        for (unsigned i = 1; i < 4; i++)
+            ptrs[i] = oa->Allocate();
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // exhausted, the coroutines queue up and resume in order on the thread that frees
+        TakeObject(oa, &objects[1], &order[1], &resumed);
+        TakeObject(oa, &objects[2], &order[2], &resumed);
+        printf("Suspended: %d %d\n", objects[1] == 0, objects[2] == 0);
+
+        oa->Free(ptrs[3]);
+        printf("After one Free: first got it: %d, second still waiting: %d\n", objects[1] == ptrs[3], objects[2] == 0);
+        oa->Free(ptrs[1]);
+        printf("After another: second got it: %d, resume order: %u %u\n", objects[2] == ptrs[1], order[1], order[2]);
+        PrintCounts(oa);
+
+        oa->Free(ptrs[0]);
+        oa->Free(ptrs[2]);
+        oa->Free(objects[1]);
+        oa->Free(objects[2]);
+        PrintCounts(oa);
+
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestAllocateAsync." << endl;
+    }
+#else
+    cout << "AllocateAsync needs C++20 coroutines." << endl;
+#endif
+}
+
+void TestCompressed(void)
+{
+    ObjectAllocator* oa;
+    Student* ptrs[10];
+    try
+    {
+        bool newdel = false;
+        bool debug = false;
+        unsigned padbytes = 0;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbNone);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        config.Compressed_ = true;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        const unsigned char* base = static_cast<const unsigned char*>(oa->GetReservedBase());
+        const size_t size = oa->GetReservedSize();
+
+        //****************************************************************************
+        // every object round trips through its 32-bit reference
+        bool roundTrip = true;
+        bool inRange = true;
+        for (unsigned i = 0; i < 10; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->Allocate());
+            ptrs[i]->ID = static_cast<long>(i + 1);
+            const uint32_t reference = oa->Encode(ptrs[i]);
+            roundTrip = roundTrip && reference != 0 && oa->Decode(reference) == ptrs[i];
+            inRange = inRange && reference < size;
+        }
+        printf("Round trip: %d, references inside the reserved range: %d\n", roundTrip, inRange);
+        printf("Encode(nullptr): %u, Decode(0) is nullptr: %d\n", oa->Encode(0), oa->Decode(0) == 0);
+        PrintCounts(oa);
+
+        // ownership is one compare against the reserved range
+        Student local;
+        const unsigned char* mine = reinterpret_cast<const unsigned char*>(ptrs[9]);
+        const unsigned char* other = reinterpret_cast<const unsigned char*>(&local);
+        printf("Object in range: %d, stack variable in range: %d\n",
+            mine >= base && mine < base + size, other >= base && other < base + size);
+
+        // a reference stays valid until the object is freed, then the block's reference is reused
+        const uint32_t freed = oa->Encode(ptrs[3]);
+        oa->Free(ptrs[3]);
+        ptrs[3] = static_cast<Student*>(oa->Allocate());
+        printf("Freed reference reused: %d, ID through a reference: %ld\n",
+            oa->Encode(ptrs[3]) == freed, static_cast<Student*>(oa->Decode(oa->Encode(ptrs[7])))->ID);
+
+        for (unsigned i = 0; i < 10; i++)
+            oa->Free(ptrs[i]);
+        PrintCounts(oa);
+        delete oa;
+
+        //****************************************************************************
+        // the reserved range holds at most 4 GiB of pages, references can't go past it
+        OAConfig big(newdel, 1, 0, debug, padbytes, header, 0);
+        big.Compressed_ = true;
+        oa = new ObjectAllocator(size_t(1536) << 20, big);
+        unsigned allocated = 0;
+        void* object = 0;
+        ObjectAllocator::OA_STATUS status;
+        while ((status = oa->TryAllocateZeroed(object)) == ObjectAllocator::S_OK)
+            ++allocated;
+        printf("1.5 GiB objects allocated: %u, then %s\n", allocated, StatusName(status));
+        delete oa;
+
+        try
+        {
+            oa = new ObjectAllocator(size_t(5) << 30, big);
+            cout << "Reserved a 5 GiB page." << endl;
+            delete oa;
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_NO_MEMORY)
+                cout << "5 GiB page refused: E_NO_MEMORY" << endl;
+            else
+                cout << "Exception thrown during TestCompressed." << endl;
+        }
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestCompressed." << endl;
+    }
+}
+
+void TestPageCache(void)
+{
+    ObjectAllocator* oa;
+    ObjectAllocator* other;
+    void* ptrs[12];
+    try
+    {
+        bool newdel = false;
+        bool debug = false;
+        unsigned padbytes = 0;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbNone);
+        unsigned alignment = 0;
+
+        OAPageCache::Trim();
+        OAPageCache::SetCapacity(OAPageCache::DEFAULT_CAPACITY);
+        printf("Cached bytes: %u\n", static_cast<unsigned>(OAPageCache::GetCachedBytes()));
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        config.SharePages_ = true;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        for (unsigned i = 0; i < 12; i++)
+            ptrs[i] = oa->Allocate();
+        const void* pages[3] = {};
+        unsigned count = 0;
+        for (const GenericObject* page = static_cast<const GenericObject*>(oa->GetPageList()); page && count < 3; page = page->Next)
+            pages[count++] = page;
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // freed pages go to the cache instead of the system
+        for (unsigned i = 0; i < 12; i++)
+            oa->Free(ptrs[i]);
+        printf("Empty pages freed: %u\n", oa->FreeEmptyPages());
+        const size_t cached = OAPageCache::GetCachedBytes();
+        printf("Cached bytes: %u\n", static_cast<unsigned>(cached));
+
+        // another allocator with pages of a similar size takes one of them
+        other = new ObjectAllocator(sizeof(Student) + 2, config);
+        const void* otherPage = other->GetPageList();
+        printf("Other allocator reuses a cached page: %d\n", otherPage == pages[0] || otherPage == pages[1] || otherPage == pages[2]);
+        printf("Cached bytes: %u\n", static_cast<unsigned>(OAPageCache::GetCachedBytes()));
+
+        //****************************************************************************
+        // at the cap, freed pages go back to the system
+        OAPageCache::SetCapacity(OAPageCache::GetCachedBytes());
+        for (unsigned i = 0; i < 4; i++)
+            ptrs[i] = other->Allocate();
+        ptrs[4] = other->Allocate();
+        for (unsigned i = 0; i < 5; i++)
+            other->Free(ptrs[i]);
+        printf("Empty pages freed at the cap: %u\n", other->FreeEmptyPages());
+        printf("Cached bytes held at the cap: %d\n", OAPageCache::GetCachedBytes() == cached - cached / 3);
+        PrintCounts(other);
+
+        delete other;
+        delete oa;
+        OAPageCache::Trim();
+        OAPageCache::SetCapacity(OAPageCache::DEFAULT_CAPACITY);
+        printf("Cached bytes after Trim: %u\n", static_cast<unsigned>(OAPageCache::GetCachedBytes()));
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestPageCache." << endl;
+    }
+}
+
+// Whether every byte of an object is zero
+bool IsZeroed(const void* object, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(object);
+    for (size_t i = 0; i < size; i++)
+        if (bytes[i])
+            return false;
+    return true;
+}
+
+void TestAllocateZeroed(bool compressed)
+{
+    ObjectAllocator* oa;
+    Student* ptrs[8];
+    try
+    {
+        bool newdel = false;
+        bool debug = !compressed;
+        unsigned padbytes = compressed ? 0 : 2;
+        OAConfig::HeaderBlockInfo header(compressed ? OAConfig::hbNone : OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        config.Compressed_ = compressed;
+        oa = new ObjectAllocator(sizeof(Student), config);
+        printf("Compressed_ (untouched zero pages): %d\n", compressed);
+
+        //****************************************************************************
+        // fresh blocks come back zeroed
+        bool zeroed = true;
+        for (unsigned i = 0; i < 8; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->AllocateZeroed());
+            zeroed = zeroed && IsZeroed(ptrs[i], sizeof(Student));
+            memset(ptrs[i], 0x5A, sizeof(Student));
+        }
+        printf("Fresh blocks zeroed: %d\n", zeroed);
+
+        // recycled blocks, which held an object and its free list link, are zeroed too
+        for (unsigned i = 0; i < 8; i++)
+            oa->Free(ptrs[i]);
+        zeroed = true;
+        for (unsigned i = 0; i < 8; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->AllocateZeroed());
+            zeroed = zeroed && IsZeroed(ptrs[i], sizeof(Student));
+            memset(ptrs[i], 0x5A, sizeof(Student));
+        }
+        printf("Recycled blocks zeroed: %d\n", zeroed);
+
+        // and so are the blocks Reset hands out again
+        oa->Reset();
+        zeroed = true;
+        for (unsigned i = 0; i < 8; i++)
+        {
+            ptrs[i] = static_cast<Student*>(oa->AllocateZeroed());
+            zeroed = zeroed && IsZeroed(ptrs[i], sizeof(Student));
+        }
+        printf("Blocks zeroed after Reset: %d\n", zeroed);
+
+        // a plain Allocate still writes its pattern
+        oa->Free(ptrs[0]);
+        ptrs[0] = static_cast<Student*>(oa->Allocate());
+        printf("Allocate after AllocateZeroed zeroed: %d\n", IsZeroed(ptrs[0], sizeof(Student)));
+        PrintCounts(oa);
+        printf("Corrupted blocks: %u\n", oa->ValidatePages(ValidateCallback));
+
+        for (unsigned i = 0; i < 8; i++)
+            oa->Free(ptrs[i]);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestAllocateZeroed." << endl;
+    }
+}
+
+// A pooled type with small pages and a page limit of its own
+struct PooledStudent : Pooled<PooledStudent>
+{
+    int Age;
+    float GPA;
+    long Year;
+    long ID;
+
+    static OAConfig PoolConfig()
+    {
+        return OAConfig(false, 4, 2, true, 2, OAConfig::HeaderBlockInfo(OAConfig::hbBasic), 8);
+    }
+};
+
+// A larger type derived from a pooled one, which the pool can't hold
+struct GradStudent : PooledStudent
+{
+    long Advisor;
+};
+
+// A pooled type with a pool per thread
+struct LocalStudent : Pooled<LocalStudent, true>
+{
+    int Age;
+    float GPA;
+    long Year;
+    long ID;
+};
+
+// A pooled type that needs more alignment than a pointer's
+struct alignas(16) AlignedPooled : Pooled<AlignedPooled>
+{
+    long ID;
+};
+
+void TestPooled(void)
+{
+    try
+    {
+        //****************************************************************************
+        // new and delete go through the class's pool
+        PooledStudent* students[8];
+        for (unsigned i = 0; i < 8; i++)
+        {
+            students[i] = new PooledStudent;
+            students[i]->ID = i;
+        }
+        ObjectAllocator& pool = PooledStudent::Pool();
+        PrintCounts(&pool);
+        printf("Pool objects share pages: %d\n",
+            SamePage(&pool, students[0], students[3]) && SamePage(&pool, students[4], students[7]));
+
+        // the page limit of PoolConfig is reported as std::bad_alloc
+        try
+        {
+            PooledStudent* extra = new PooledStudent;
+            cout << "Allocated past the page limit." << endl;
+            delete extra;
+        }
+        catch (const std::bad_alloc&)
+        {
+            cout << "new past the page limit: std::bad_alloc" << endl;
+        }
+
+        // a derived type of another size uses the global operator new
+        GradStudent* grad = new GradStudent;
+        grad->Advisor = 7;
+        PrintCounts(&pool);
+        delete grad;
+
+        for (unsigned i = 0; i < 8; i++)
+            delete students[i];
+        PrintCounts(&pool);
+        printf("Corrupted blocks: %u\n", pool.ValidatePages(ValidateCallback));
+
+        //****************************************************************************
+        // with PerThread each thread gets its own pool
+        LocalStudent* mine = new LocalStudent;
+        const ObjectAllocator* mainPool = &LocalStudent::Pool();
+        bool separate = false;
+        unsigned threadInUse = 0, threadAfterDelete = 0;
+        std::thread worker([&]
+        {
+            LocalStudent* theirs[3];
+            for (unsigned i = 0; i < 3; i++)
+                theirs[i] = new LocalStudent;
+            separate = &LocalStudent::Pool() != mainPool;
+            threadInUse = LocalStudent::Pool().GetStats().ObjectsInUse_;
+            for (unsigned i = 0; i < 3; i++)
+                delete theirs[i];
+            threadAfterDelete = LocalStudent::Pool().GetStats().ObjectsInUse_;
+        });
+        worker.join();
+        printf("Thread has a pool of its own: %d\n", separate);
+        printf("Thread pool objects in use: %u, after delete: %u\n", threadInUse, threadAfterDelete);
+        printf("Main thread pool objects in use: %u\n", mainPool->GetStats().ObjectsInUse_);
+        delete mine;
+        printf("Main thread pool objects in use after delete: %u\n", mainPool->GetStats().ObjectsInUse_);
+
+        //****************************************************************************
+        // over-aligned types raise the alignment of their pool
+        AlignedPooled* aligned[6];
+        bool isAligned = true;
+        for (unsigned i = 0; i < 6; i++)
+        {
+            aligned[i] = new AlignedPooled;
+            isAligned = isAligned && reinterpret_cast<uintptr_t>(aligned[i]) % alignof(AlignedPooled) == 0;
+        }
+        printf("Alignment: %u, objects aligned: %d\n", AlignedPooled::Pool().GetConfig().Alignment_, isAligned);
+        for (unsigned i = 0; i < 6; i++)
+            delete aligned[i];
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestPooled." << endl;
+    }
+}
+
+// An element of an ObjectPool that counts its destructor calls
+struct PoolStudent
+{
+    static unsigned Destroyed;
+
+    PoolStudent(long id, int age) : Age(age), GPA(3.0f), Year(2000 + id), ID(id) {}
+    ~PoolStudent() { Destroyed++; }
+
+    int Age;
+    float GPA;
+    long Year;
+    long ID;
+};
+
+unsigned PoolStudent::Destroyed = 0;
+
+// An element that needs more alignment than a pointer's
+struct alignas(16) AlignedStudent
+{
+    long ID;
+};
+
+// Prints the IDs of the elements of a pool in iteration order
+void PrintPool(const ObjectPool<PoolStudent>& pool)
+{
+    cout << "Elements (" << pool.size() << "):";
+    for (ObjectPool<PoolStudent>::const_iterator it = pool.cbegin(); it != pool.cend(); ++it)
+        cout << " " << it->ID;
+    cout << endl;
+}
+
+void TestObjectPool(void)
+{
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbBasic);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        PoolStudent::Destroyed = 0;
+        {
+            ObjectPool<PoolStudent> pool(config);
+            printf("Empty pool: %d, begin == end: %d\n", pool.empty(), pool.begin() == pool.end());
+
+            //****************************************************************************
+            // elements are visited in page order, whatever order they were made in
+            PoolStudent* students[10];
+            for (unsigned i = 0; i < 10; i++)
+                students[i] = pool.emplace(i, 18 + i % 5);
+            PrintPool(pool);
+            PrintCounts(&pool.allocator());
+
+            // erasing by address leaves a hole that the walk skips
+            pool.erase(students[0]);
+            pool.erase(students[5]);
+            pool.erase(students[9]);
+            printf("Destroyed: %u\n", PoolStudent::Destroyed);
+            PrintPool(pool);
+
+            // erase(iterator) returns the next element, so a loop can filter in place
+            for (ObjectPool<PoolStudent>::iterator it = pool.begin(); it != pool.end();)
+            {
+                if (it->ID % 2 == 0)
+                    it = pool.erase(it);
+                else
+                    ++it;
+            }
+            printf("Destroyed: %u\n", PoolStudent::Destroyed);
+            PrintPool(pool);
+
+            // addresses stay stable, and writes through an iterator reach the element
+            for (PoolStudent& s : pool)
+                s.Age = 30;
+            printf("Stable addresses: %d, Age through pointer: %d\n", &*pool.begin() == students[3], students[3]->Age);
+
+            // new elements fill the holes
+            pool.emplace(20, 20);
+            pool.emplace(21, 21);
+            PrintPool(pool);
+            PrintCounts(&pool.allocator());
+
+            //****************************************************************************
+            // clear destroys every element and keeps the pages
+            pool.clear();
+            printf("Destroyed: %u\n", PoolStudent::Destroyed);
+            PrintPool(pool);
+            PrintCounts(&pool.allocator());
+
+            // the destructor destroys what is left
+            pool.emplace(30, 30);
+            pool.emplace(31, 31);
+            PrintPool(pool);
+        }
+        printf("Destroyed after the pool: %u\n", PoolStudent::Destroyed);
+
+        //****************************************************************************
+        // over-aligned elements raise the alignment of the pool
+        {
+            ObjectPool<AlignedStudent> pool(config);
+            bool aligned = true;
+            for (unsigned i = 0; i < 6; i++)
+                aligned = aligned && reinterpret_cast<uintptr_t>(pool.emplace()) % alignof(AlignedStudent) == 0;
+            printf("Alignment: %u, elements aligned: %d\n", pool.allocator().GetConfig().Alignment_, aligned);
+        }
+
+        // the C++ memory manager keeps no pages to iterate
+        try
+        {
+            ObjectPool<PoolStudent> pool(OAConfig(true));
+            cout << "Created a pool on the C++ memory manager." << endl;
+        }
+        catch (const OAException& e)
+        {
+            if (e.code() == OAException::E_NO_MEMORY)
+                cout << "Pool on the C++ memory manager: E_NO_MEMORY: " << e.what() << endl;
+            else
+                cout << "Exception thrown during TestObjectPool." << endl;
+        }
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestObjectPool." << endl;
+    }
+}
+
+// Reads a whole file, false if it can't be read
+bool ReadFile(const char* path, std::vector<uint8_t>& image)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file)
+        return false;
+    uint8_t chunk[4096];
+    size_t read;
+    while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+        image.insert(image.end(), chunk, chunk + read);
+    std::fclose(file);
+    return true;
+}
+
+// Copies the next record of a snapshot image, false if the image ends first
+bool ReadRecord(const std::vector<uint8_t>& image, size_t& offset, void* record, size_t size)
+{
+    if (image.size() - offset < size)
+        return false;
+    memcpy(record, image.data() + offset, size);
+    offset += size;
+    return true;
+}
+
+// Whether an address is the start of a page of an allocator
+bool IsPage(const ObjectAllocator* oa, uint64_t address)
+{
+    for (const GenericObject* page = static_cast<const GenericObject*>(oa->GetPageList()); page; page = page->Next)
+        if (reinterpret_cast<uintptr_t>(page) == address)
+            return true;
+    return false;
+}
+
+void TestSnapshot(void)
+{
+    ObjectAllocator* oa;
+    const char* path = "oa-driver-sample.snap";
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbExternal);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        void* students[3];
+        void* employees[3];
+        for (unsigned i = 0; i < 3; i++)
+            students[i] = oa->Allocate("Student");
+        for (unsigned i = 0; i < 3; i++)
+            employees[i] = oa->Allocate("Employee");
+        void* unlabeled = oa->Allocate();
+        oa->Free(students[1]);
+        oa->Free(employees[0]);
+        PrintCounts(oa);
+
+        //****************************************************************************
+        // the header holds the layout and the stats
+        printf("WriteSnapshot: %d\n", oa->WriteSnapshot(path));
+        std::vector<uint8_t> image;
+        size_t offset = 0;
+        OASnapshotHeader head;
+        if (!ReadFile(path, image) || !ReadRecord(image, offset, &head, sizeof(head)))
+        {
+            cout << "Failed to read the snapshot back." << endl;
+            std::remove(path);
+            delete oa;
+            return;
+        }
+
+        printf("Magic: %d, Version: %u, Headers: %u\n", head.magic_ == OA_SNAPSHOT_MAGIC, head.version_, head.headerType_);
+        printf("Object size: %u, Page size: %u, Data offset: %u, Stride: %u\n",
+            static_cast<unsigned>(head.objectSize_), static_cast<unsigned>(head.pageSize_),
+            static_cast<unsigned>(head.dataOffset_), static_cast<unsigned>(head.objectStride_));
+        printf("Objects per page: %u, Occupancy words: %u, Pages: %u, Labels: %u\n",
+            head.objectsPerPage_, head.occupancyWords_, head.pageCount_, head.labelCount_);
+        printf("Allocs: %u, Frees: %u, In use: %u, Free: %u, Most: %u\n",
+            head.allocations_, head.deallocations_, head.objectsInUse_, head.freeObjects_, head.mostObjects_);
+
+        //****************************************************************************
+        // each page: its record, the occupancy bitmap, the in-use flags of the headers, its live blocks
+        std::vector<uint64_t> occupancy(head.occupancyWords_);
+        std::vector<uint64_t> headerBits(head.occupancyWords_);
+        std::vector<OASnapshotBlock> blocks;
+        bool pagesKnown = true;
+        bool countsMatch = true;
+        bool flagsAgree = true;
+        bool complete = true;
+        for (uint32_t p = 0; p < head.pageCount_ && complete; p++)
+        {
+            OASnapshotPage page;
+            complete = ReadRecord(image, offset, &page, sizeof(page))
+                && ReadRecord(image, offset, occupancy.data(), occupancy.size() * sizeof(uint64_t))
+                && ReadRecord(image, offset, headerBits.data(), headerBits.size() * sizeof(uint64_t));
+            if (!complete)
+                break;
+
+            pagesKnown = pagesKnown && IsPage(oa, page.address_);
+            unsigned live = 0;
+            for (uint32_t w = 0; w < head.occupancyWords_; w++)
+            {
+                for (uint64_t bits = occupancy[w]; bits; bits &= bits - 1)
+                    live++;
+                flagsAgree = flagsAgree && occupancy[w] == headerBits[w];
+            }
+            countsMatch = countsMatch && live == page.liveCount_;
+
+            for (uint32_t b = 0; b < page.liveCount_ && complete; b++)
+            {
+                OASnapshotBlock block;
+                complete = ReadRecord(image, offset, &block, sizeof(block));
+                if (complete)
+                {
+                    countsMatch = countsMatch && (occupancy[block.index_ / 64] >> (block.index_ % 64) & 1);
+                    blocks.push_back(block);
+                }
+            }
+        }
+        printf("Pages are the allocator's: %d, Live counts match the bitmaps: %d, Header flags agree: %d\n",
+            pagesKnown, countsMatch, flagsAgree);
+
+        // then the labels, each a length and its bytes
+        std::vector<std::string> labels;
+        for (uint32_t l = 0; l < head.labelCount_ && complete; l++)
+        {
+            uint32_t length = 0;
+            complete = ReadRecord(image, offset, &length, sizeof(length)) && length <= image.size() - offset;
+            if (complete)
+            {
+                labels.push_back(std::string(reinterpret_cast<const char*>(image.data() + offset), length));
+                offset += length;
+            }
+        }
+        printf("Records complete: %d, Bytes left over: %u\n", complete, static_cast<unsigned>(image.size() - offset));
+
+        // the live blocks by allocation number (pages are in address order, which varies)
+        std::sort(blocks.begin(), blocks.end(), [](const OASnapshotBlock& a, const OASnapshotBlock& b) { return a.allocNum_ < b.allocNum_; });
+        for (const OASnapshotBlock& block : blocks)
+            printf("  #%u \"%s\"\n", block.allocNum_,
+                block.label_ == 0 || block.label_ > labels.size() ? "(no label)" : labels[block.label_ - 1].c_str());
+        std::remove(path);
+
+        //****************************************************************************
+        // a path that can't be written is reported, not thrown
+        printf("WriteSnapshot to a missing directory: %d\n", oa->WriteSnapshot("oa-driver-sample-missing/heap.snap"));
+
+        oa->Free(students[0]);
+        oa->Free(students[2]);
+        oa->Free(employees[1]);
+        oa->Free(employees[2]);
+        oa->Free(unlabeled);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestSnapshot." << endl;
+    }
+}
+
+void TestSnapshotDiff(void)
+{
+    ObjectAllocator* oa;
+    const char* before = "oa-driver-sample-before.snap";
+    const char* after = "oa-driver-sample-after.snap";
+    try
+    {
+        bool newdel = false;
+        bool debug = true;
+        unsigned padbytes = 2;
+        OAConfig::HeaderBlockInfo header(OAConfig::hbExternal);
+        unsigned alignment = 8;
+
+        OAConfig config(newdel, 4, 0, debug, padbytes, header, alignment);
+        oa = new ObjectAllocator(sizeof(Student), config);
+
+        void* objects[20];
+        unsigned count = 0;
+        for (unsigned i = 0; i < 3; i++)
+            objects[count++] = oa->Allocate("Student");
+        for (unsigned i = 0; i < 3; i++)
+            objects[count++] = oa->Allocate("Request");
+        PrintCounts(oa);
+        printf("WriteSnapshot before: %d\n", oa->WriteSnapshot(before));
+
+        //****************************************************************************
+        // requests pile up, a student is replaced (same block, new allocation number) and a cache appears
+        oa->Free(objects[0]);
+        oa->Free(objects[1]);
+        objects[0] = oa->Allocate("Student");
+        objects[1] = oa->Allocate("Cache");
+        for (unsigned i = 0; i < 5; i++)
+            objects[count++] = oa->Allocate("Request");
+        objects[count++] = oa->Allocate("Cache");
+        PrintCounts(oa);
+        printf("WriteSnapshot after: %d\n", oa->WriteSnapshot(after));
+
+        // both files are kept for oa-snapshot --diff (see output-sample-snapshot-diff-report-LP64.txt)
+        for (unsigned i = 0; i < count; i++)
+            oa->Free(objects[i]);
+        delete oa;
+    }
+    catch (const OAException& e)
+    {
+        if (SHOW_EXCEPTIONS)
+            cout << e.what() << endl;
+        else
+            cout << "Exception thrown during TestSnapshotDiff." << endl;
+    }
+}
+
+void PrintCounts(const ObjectAllocator* nm)
+{
+    OAStats stats = nm->GetStats();
+    cout << "Pages in use: " << stats.PagesInUse_;
+    cout << ", Objects in use: " << stats.ObjectsInUse_;
+    cout << ", Available objects: " << stats.FreeObjects_;
+    cout << ", Allocs: " << stats.Allocations_;
+    cout << ", Frees: " << stats.Deallocations_ << endl;
+}
+
+void PrintCounts2(const ObjectAllocator* nm)
+{
+    OAStats stats = nm->GetStats();
+    cout << "Allocs: " << stats.Allocations_;
+    cout << ", Frees: " << stats.Deallocations_ << endl;
+}
+
+void PrintConfig(const ObjectAllocator* oa)
+{
+    cout << "Object size = " << oa->GetStats().ObjectSize_;
+    cout << ", Page size = " << oa->GetStats().PageSize_;
+    cout << ", Pad bytes = " << oa->GetConfig().PadBytes_;
+    cout << ", ObjectsPerPage = " << oa->GetConfig().ObjectsPerPage_;
+    cout << ", MaxPages = " << oa->GetConfig().MaxPages_;
+    cout << ", MaxObjects = " << oa->GetConfig().ObjectsPerPage_ * oa->GetConfig().MaxPages_;
+    cout << endl;
+    cout << "Alignment = " << oa->GetConfig().Alignment_;
+    cout << ", LeftAlign = " << oa->GetConfig().LeftAlignSize_;
+    cout << ", InterAlign = " << oa->GetConfig().InterAlignSize_;
+    cout << ", HeaderBlocks = ";
+    if (oa->GetConfig().HBlockInfo_.type_ == OAConfig::hbNone)
+        cout << "None";
+    else if (oa->GetConfig().HBlockInfo_.type_ == OAConfig::hbBasic)
+        cout << "Basic";
+    else if (oa->GetConfig().HBlockInfo_.type_ == OAConfig::hbExtended)
+        cout << "Extended";
+    else if (oa->GetConfig().HBlockInfo_.type_ == OAConfig::hbExternal)
+        cout << "External";
+    cout << ", Header size = " << oa->GetConfig().HBlockInfo_.size_;
+    cout << endl;
+}
+
+void DumpPages(const ObjectAllocator* nm, unsigned width)
+{
+    const unsigned char* pages = static_cast<const unsigned char*>(nm->GetPageList());
+    const unsigned char* realpage = pages;
+
+    size_t header_size = nm->GetConfig().HBlockInfo_.size_;
+
+    while (pages)
+    {
+        unsigned count = 0;
+
+        if (SHOWREAL)
+            printf("%p\n", pages);
+        else
+            printf("XXXXXXXX\n");
+
+        // print column header
+        for (unsigned j = 0; j < width; j++)
+            printf(" %2i", j);
+        printf("\n");
+
+        // "Next page" pointer in the page
+        if (SHOWREAL)
+        {
+            for (unsigned i = 0; i < sizeof(void*); i++, count++)
+                printf(" %02X", *pages++);
+        }
+        else
+        {
+            for (unsigned j = 0; j < sizeof(void*); pages++, count++, j++)
+                printf(" %s", "XX");
+        }
+
+
+        // Left leading alignment bytes
+        if (nm->GetConfig().Alignment_ > 1)
+        {
+            // leading alignment block (if any)
+            for (unsigned j = 0; j < nm->GetConfig().LeftAlignSize_; count++, j++)
+            {
+                if (count >= width)
+                {
+                    printf("\n");
+                    count = 0;
+                }
+                printf(" %02X", *pages++);
+            }
+        }
+
+        // Dump each object and its associated info
+        for (unsigned int i = 0; i < nm->GetConfig().ObjectsPerPage_; i++)
+        {
+            // inter-block alignment (not on first block)
+            if (i > 0)
+            {
+                for (unsigned j = 0; j < nm->GetConfig().InterAlignSize_; count++, j++)
+                {
+                    if (count >= width)
+                    {
+                        printf("\n");
+                        count = 0;
+                    }
+                    printf(" %02X", *pages++);
+                }
+            }
+
+            // header block bytes
+            for (unsigned j = 0; j < header_size; count++, j++)
+            {
+                if (count >= width)
+                {
+                    printf("\n");
+                    count = 0;
+                }
+                printf(" %02X", *pages++);
+            }
+
+            // left padding
+            for (unsigned j = 0; j < nm->GetConfig().PadBytes_; count++, j++)
+            {
+                if (count >= width)
+                {
+                    printf("\n");
+                    count = 0;
+                }
+                printf(" %02X", *pages++);
+            }
+
+            // possible next pointer (zero it out)
+            for (unsigned j = 0; j < sizeof(void*); count++, pages++, j++)
+            {
+                if (count >= width)
+                {
+                    printf("\n");
+                    count = 0;
+                }
+                if (SHOWREAL)
+                    printf(" %02X", *pages);
+                else
+                    printf(" %s", "XX");
+            }
+
+            // remaining bytes
+            for (unsigned j = 0; j < nm->GetStats().ObjectSize_ - sizeof(void*); count++, j++)
+            {
+                if (count >= width)
+                {
+                    printf("\n");
+                    count = 0;
+                }
+                printf(" %02X", *pages++);
+            }
+
+            // right pad bytes
+            for (unsigned j = 0; j < nm->GetConfig().PadBytes_; count++, j++)
+            {
+                if (count >= width)
+                {
+                    printf("\n");
+                    count = 0;
+                }
+                printf(" %02X", *pages++);
+            }
+
+        }
+        printf("\n\n");
+
+        pages = reinterpret_cast<const unsigned char*>((reinterpret_cast<const GenericObject*>(realpage))->Next);
+        realpage = pages;
+    }
+}
+
+void DumpExternalHeaders(const ObjectAllocator* oa, const unsigned char* p)
+{
+    unsigned char* page = const_cast<unsigned char*>(p);
+
+    unsigned padbytes = oa->GetConfig().PadBytes_;
+    size_t header_size = oa->GetConfig().HBlockInfo_.size_;
+    unsigned leftalign = oa->GetConfig().LeftAlignSize_;
+    unsigned interalign = oa->GetConfig().InterAlignSize_;
+    unsigned count = oa->GetConfig().ObjectsPerPage_;
+    size_t offset = padbytes * 2 + header_size + interalign + oa->GetStats().ObjectSize_;
+
+    page += sizeof(void*); // the 'next' pointer
+    page += leftalign;      // the left alignment bytes (if any)
+
+      // We're now pointing at the beginning of the header block
 
     MemBlockInfo* pm = reinterpret_cast<MemBlockInfo*>(*reinterpret_cast<MemBlockInfo**>(page));
     cout << "  Label: " << (pm && pm->label ? pm->label : "") << std::endl;
@@ -2232,6 +4735,140 @@ int main(int argc, char** argv)
         TestFreeEmptyPages3();
         cout << endl;
         break;
+    case 22:
+        cout << "============================== Test handles..." << endl;
+        TestHandles();
+        cout << endl;
+        break;
+    case 23:
+        cout << "============================== Test ForEachLive..." << endl;
+        TestForEachLive();
+        cout << endl;
+        break;
+    case 24:
+        cout << "============================== Test arena Reset/Release/Mark/Rollback..." << endl;
+        TestArena();
+        cout << endl;
+        break;
+    case 25:
+        cout << "============================== Test mapped file..." << endl;
+        TestMappedFile();
+        cout << endl;
+        break;
+    case 26:
+        cout << "============================== Test shared memory across processes..." << endl;
+        TestSharedMemory();
+        cout << endl;
+        break;
+    case 27:
+        cout << "============================== Test trim idle pages..." << endl;
+        TestTrimIdlePages();
+        cout << endl;
+        break;
+    case 28:
+        cout << "============================== Test epoch-based reclamation..." << endl;
+        TestReclamation();
+        cout << endl;
+        break;
+    case 29:
+        cout << "============================== Test deferred free..." << endl;
+        TestFreeDeferred();
+        cout << endl;
+        break;
+    case 30:
+        cout << "============================== Test index links..." << endl;
+        TestIndexLinks(2);
+        TestIndexLinks(4);
+        cout << endl;
+        break;
+    case 31:
+        cout << "============================== Test lazy first page..." << endl;
+        TestLazyFirstPage();
+        cout << endl;
+        break;
+    case 32:
+        cout << "============================== Test tagged pages..." << endl;
+        TestTaggedPages();
+        cout << endl;
+        break;
+    case 33:
+        cout << "============================== Test Try* status codes..." << endl;
+        TestTryStatus(false);
+        TestTryStatus(true);
+        cout << endl;
+        break;
+    case 34:
+        cout << "============================== Test coloring..." << endl;
+        TestColoring();
+        cout << endl;
+        break;
+    case 35:
+        cout << "============================== Test allocate near..." << endl;
+        TestAllocateNear(false);
+        TestAllocateNear(true);
+        cout << endl;
+        break;
+    case 36:
+        cout << "============================== Test watermarks..." << endl;
+        TestWatermarks();
+        cout << endl;
+        break;
+    case 37:
+        cout << "============================== Test real-time..." << endl;
+        TestRealTime();
+        cout << endl;
+        break;
+    case 38:
+        cout << "============================== Test allocate wait..." << endl;
+        TestAllocateWait();
+        cout << endl;
+        break;
+    case 39:
+        cout << "============================== Test allocate async..." << endl;
+        TestAllocateAsync();
+        cout << endl;
+        break;
+    case 40:
+        cout << "============================== Test compressed references..." << endl;
+        TestCompressed();
+        cout << endl;
+        break;
+    case 41:
+        cout << "============================== Test page cache..." << endl;
+        TestPageCache();
+        cout << endl;
+        break;
+    case 42:
+        cout << "============================== Test allocate zeroed..." << endl;
+        TestAllocateZeroed(false);
+        TestAllocateZeroed(true);
+        cout << endl;
+        break;
+    case 43:
+        cout << "============================== Test pooled..." << endl;
+        TestPooled();
+        cout << endl;
+        break;
+    case 44:
+        cout << "============================== Test object pool..." << endl;
+        TestObjectPool();
+        cout << endl;
+        break;
+    case 45:
+        cout << "============================== Test snapshot..." << endl;
+        TestSnapshot();
+        cout << endl;
+        break;
+    case 46:
+        cout << "============================== Test snapshot diff..." << endl;
+        TestSnapshotDiff();
+        cout << endl;
+        break;
+    case 47:
+        cout << "============================== Test shared memory owner death..." << endl;
+        TestSharedOwnerDeath();
+        cout << endl;
+        break;
 #endif
     default:
         cout << "============================== Students..." << endl;
@@ -0,0 +1,494 @@
+/**
+ * @file    oa-malloc.cpp
+ * @author  Ho Yi Guan 
+ *          SIT     : 2001595@sit.singaporetech.edu.sg 
+ *          Digipen : Yiguan.ho@digipen.edu
+ * @brief   A malloc replacement that can be preloaded into unmodified
+ *          programs. Small requests are served from size-classed
+ *          ObjectAllocator pools through per-thread caches, everything
+ *          else goes to the C library's allocator
+ *
+ *          Build and use (glibc):
+ *            g++ -std=c++17 -O2 -fPIC -shared oa-malloc.cpp ObjectAllocator.cpp -o oa-malloc.so -lpthread -ldl
+ *            LD_PRELOAD=./oa-malloc.so ./program
+ *
+ *          Every pool is a Compressed_ allocator, so its pages lie in one
+ *          reserved range. free() finds the owner of an address in O(1)
+ *          from a table of 4 GiB granules, each naming the (at most two)
+ *          ranges that touch it; anything else belongs to the C library
+ *
+ * @date    2026-10-17
+ *
+ */
+
+#include "ObjectAllocator.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <pthread.h>
+#include <dlfcn.h>
+
+// The C library's allocator (glibc)
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void __libc_free(void* ptr);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void* __libc_valloc(size_t size);
+    void* __libc_pvalloc(size_t size);
+}
+
+namespace
+{
+
+static constexpr unsigned classSizes[] = { 16, 32, 48, 64, 80, 96, 112, 128,
+                                           160, 192, 224, 256, 320, 384, 448, 512,
+                                           640, 768, 896, 1024 };
+static constexpr size_t classCount = sizeof(classSizes) / sizeof(classSizes[0]);
+static constexpr size_t maxPooledSize = 1024;           // larger requests go to the C library
+static constexpr size_t poolAlignment = 16;             // alignment malloc promises (max_align_t)
+static constexpr size_t poolPageBytes = 64 * 1024;      // every page fills one 64 KiB frame
+static constexpr unsigned cacheDepth = 32;              // objects a thread keeps per class
+static constexpr unsigned cacheBatch = cacheDepth / 2;  // objects moved per refill/flush
+static constexpr unsigned granuleShift = 32;            // reserved ranges are at most 4 GiB
+static constexpr size_t granuleCount = size_t(1) << (47 - granuleShift); // user address space
+
+/**
+ * @brief   One pool of the replacement, guarded by its own lock
+ */
+struct SizeClass
+{
+    ObjectAllocator* pool; //!< nullptr if it could not be created
+    std::mutex lock;       //!< serializes threads refilling/flushing their caches
+    uintptr_t base;        //!< the pool's reserved range, copied for the ownership test
+    size_t size;
+};
+
+/**
+ * @brief   Objects a thread allocates from and frees to without locking.
+ *          Plain data, so it needs no dynamic TLS initialization
+ */
+struct ThreadCache
+{
+    void* objects[classCount][cacheDepth]; //!< a stack of free objects per class
+    unsigned counts[classCount];           //!< objects on each stack
+    bool busy;                             //!< inside a pool, requests go to the C library
+    bool registered;                       //!< the thread exit flush is armed
+};
+
+static SizeClass sizeClasses[classCount];
+alignas(ObjectAllocator) static unsigned char poolStorage[classCount][sizeof(ObjectAllocator)];
+static unsigned char sizeToClass[maxPooledSize / poolAlignment + 1];
+static unsigned char granuleOwners[granuleCount][2]; // class + 1 of the ranges in each granule (0 = none)
+static std::atomic<int> poolState{ 0 };              // 0 = not created, 1 = creating, 2 = ready, 3 = disabled
+static pthread_key_t threadExitKey;
+static size_t (*libcUsableSize)(void*) = nullptr;
+
+static thread_local ThreadCache threadCache __attribute__((tls_model("initial-exec")));
+
+/**
+ * @brief   Marks the calling thread as inside the replacement for the
+ *          lifetime of the guard, so the pools' own heap use goes to the
+ *          C library instead of recursing
+ */
+class BusyGuard
+{
+  public:
+    BusyGuard() { threadCache.busy = true; }
+    ~BusyGuard() { threadCache.busy = false; }
+};
+
+/**
+ * @brief   Returns the class an owned object belongs to
+ *
+ * @param   ptr
+ *          Any address
+ *
+ * @return  The class index, -1 if no pool owns the address
+ */
+static int OwnerClass(const void* ptr)
+{
+    const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+    const uintptr_t granule = address >> granuleShift;
+    if (granule >= granuleCount)
+        return -1;
+
+    for (unsigned char owner : granuleOwners[granule])
+    {
+        if (owner && address - sizeClasses[owner - 1].base < sizeClasses[owner - 1].size)
+            return owner - 1;
+    }
+    return -1;
+}
+
+/**
+ * @brief   Frees count objects from the top of a class's cache
+ *
+ * @param   c
+ *          The class index
+ *
+ * @param   count
+ *          How many objects to return to the pool
+ */
+static void FlushCache(unsigned c, unsigned count)
+{
+    BusyGuard busy;
+    unsigned& top = threadCache.counts[c];
+    count = std::min(count, top);
+    top -= count;
+
+    std::lock_guard<std::mutex> guard(sizeClasses[c].lock);
+    sizeClasses[c].pool->FreeBatch(threadCache.objects[c] + top, count);
+}
+
+/**
+ * @brief   Flushes every cache of a thread that exits (pthread key destructor)
+ */
+static void ThreadExit(void*)
+{
+    threadCache.registered = false;
+    for (unsigned c = 0; c < classCount; ++c)
+    {
+        if (threadCache.counts[c])
+            FlushCache(c, threadCache.counts[c]);
+    }
+}
+
+/**
+ * @brief   Arms the thread exit flush the first time a thread caches objects
+ */
+static void RegisterThread()
+{
+    BusyGuard busy;
+    threadCache.registered = true;
+    pthread_setspecific(threadExitKey, &threadCache);
+}
+
+/**
+ * @brief   Takes cacheBatch objects from a class's pool, returning one
+ *          and caching the rest
+ *
+ * @param   c
+ *          The class index
+ *
+ * @return  A zero-filled object, nullptr if the pool is exhausted
+ */
+static void* RefillCache(unsigned c)
+{
+    if (!threadCache.registered)
+        RegisterThread();
+
+    BusyGuard busy;
+    std::lock_guard<std::mutex> guard(sizeClasses[c].lock);
+
+    //zeroed objects of fresh pages are never written, so untouched memory stays untouched
+    void* object = nullptr;
+    if (sizeClasses[c].pool->TryAllocateZeroed(object) != ObjectAllocator::S_OK)
+        return nullptr;
+
+    unsigned& top = threadCache.counts[c];
+    while (top < cacheBatch)
+    {
+        void* cached = nullptr;
+        if (sizeClasses[c].pool->TryAllocateZeroed(cached) != ObjectAllocator::S_OK)
+            break;
+        threadCache.objects[c][top++] = cached;
+    }
+    return object;
+}
+
+static void ForkPrepare()
+{
+    for (SizeClass& sizeClass : sizeClasses)
+        sizeClass.lock.lock();
+}
+
+static void ForkRelease()
+{
+    for (SizeClass& sizeClass : sizeClasses)
+        sizeClass.lock.unlock();
+}
+
+/**
+ * @brief   Creates the pools and the ownership table. A class whose
+ *          range can't be reserved or recorded is left without a pool
+ *          and its sizes go to the C library
+ */
+static void CreatePools()
+{
+    BusyGuard busy;
+
+    libcUsableSize = reinterpret_cast<size_t (*)(void*)>(dlsym(RTLD_NEXT, "malloc_usable_size"));
+
+    if (pthread_key_create(&threadExitKey, ThreadExit) != 0)
+    {
+        poolState.store(3, std::memory_order_release);
+        return;
+    }
+    pthread_atfork(ForkPrepare, ForkRelease, ForkRelease);
+
+    for (unsigned c = 0, size = 0; size <= maxPooledSize; size += poolAlignment)
+    {
+        while (classSizes[c] < size)
+            ++c;
+        sizeToClass[size / poolAlignment] = static_cast<unsigned char>(c);
+    }
+
+    for (unsigned c = 0; c < classCount; ++c)
+    {
+        OAConfig config(false, static_cast<unsigned>((poolPageBytes - 2 * poolAlignment) / classSizes[c]), 0,
+            false, 0, OAConfig::HeaderBlockInfo(), poolAlignment);
+        config.Compressed_ = true;
+        config.LazyFirstPage_ = true;
+
+        ObjectAllocator* pool = nullptr;
+        try
+        {
+            pool = new (poolStorage[c]) ObjectAllocator(classSizes[c], config);
+        }
+        catch (const OAException&)
+        {
+            continue;
+        }
+
+        const uintptr_t base = reinterpret_cast<uintptr_t>(pool->GetReservedBase());
+        const size_t size = pool->GetReservedSize();
+
+        //every granule the range touches must have room for it
+        bool recorded = (base + size - 1) >> granuleShift < granuleCount;
+        for (uintptr_t g = base >> granuleShift; recorded && g <= (base + size - 1) >> granuleShift; ++g)
+            recorded = !granuleOwners[g][0] || !granuleOwners[g][1];
+        if (!recorded)
+        {
+            pool->~ObjectAllocator();
+            continue;
+        }
+        for (uintptr_t g = base >> granuleShift; g <= (base + size - 1) >> granuleShift; ++g)
+            granuleOwners[g][granuleOwners[g][0] ? 1 : 0] = static_cast<unsigned char>(c + 1);
+
+        sizeClasses[c].base = base;
+        sizeClasses[c].size = size;
+        sizeClasses[c].pool = pool;
+    }
+
+    poolState.store(2, std::memory_order_release);
+}
+
+/**
+ * @brief   Whether requests can be served from the pools. The first
+ *          caller creates them, callers racing it use the C library
+ *          meanwhile
+ *
+ * @return  true once the pools exist
+ */
+static bool PoolsReady()
+{
+    int state = poolState.load(std::memory_order_acquire);
+    if (state == 2)
+        return true;
+    if (state != 0 || !poolState.compare_exchange_strong(state, 1))
+        return false;
+
+    CreatePools();
+    return poolState.load(std::memory_order_acquire) == 2;
+}
+
+/**
+ * @brief   Allocates from the pool of a small size
+ *
+ * @param   size
+ *          The requested size, at most maxPooledSize
+ *
+ * @return  The object, nullptr if it must come from the C library instead
+ */
+static void* PoolAllocate(size_t size)
+{
+    if (threadCache.busy || !PoolsReady())
+        return nullptr;
+
+    const unsigned c = sizeToClass[(size + poolAlignment - 1) / poolAlignment];
+    if (!sizeClasses[c].pool)
+        return nullptr;
+
+    unsigned& top = threadCache.counts[c];
+    if (top)
+        return threadCache.objects[c][--top];
+    return RefillCache(c);
+}
+
+/**
+ * @brief   Frees an object of a pool into the thread's cache
+ *
+ * @param   ptr
+ *          The object
+ *
+ * @param   c
+ *          The class that owns it
+ */
+static void PoolFree(void* ptr, unsigned c)
+{
+    //only reachable when a pool itself frees one of its objects, which it doesn't
+    if (threadCache.busy)
+    {
+        std::lock_guard<std::mutex> guard(sizeClasses[c].lock);
+        sizeClasses[c].pool->TryFree(ptr);
+        return;
+    }
+
+    if (!threadCache.registered)
+        RegisterThread();
+
+    unsigned& top = threadCache.counts[c];
+    if (top == cacheDepth)
+        FlushCache(c, cacheBatch);
+    threadCache.objects[c][top++] = ptr;
+}
+
+/**
+ * @brief   Allocates with an alignment, pooled when malloc's alignment is enough
+ */
+static void* AlignedAllocate(size_t alignment, size_t size)
+{
+    if (alignment <= poolAlignment && size <= maxPooledSize)
+    {
+        if (void* object = PoolAllocate(size))
+            return object;
+    }
+    return __libc_memalign(alignment, size);
+}
+
+} // namespace
+
+extern "C"
+{
+
+void* malloc(size_t size)
+{
+    if (size <= maxPooledSize)
+    {
+        if (void* object = PoolAllocate(size))
+            return object;
+    }
+    return __libc_malloc(size);
+}
+
+void free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    const int c = OwnerClass(ptr);
+    if (c < 0)
+        __libc_free(ptr);
+    else
+        PoolFree(ptr, static_cast<unsigned>(c));
+}
+
+void* calloc(size_t count, size_t size)
+{
+    size_t total;
+    if (__builtin_mul_overflow(count, size, &total))
+    {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    if (total <= maxPooledSize)
+    {
+        //cached objects may have been used, objects taken from a pool are zero
+        const bool cached = !threadCache.busy && poolState.load(std::memory_order_acquire) == 2
+            && threadCache.counts[sizeToClass[(total + poolAlignment - 1) / poolAlignment]];
+        if (void* object = PoolAllocate(total))
+        {
+            if (cached)
+                std::memset(object, 0, total);
+            return object;
+        }
+    }
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if (!ptr)
+        return malloc(size);
+
+    const int c = OwnerClass(ptr);
+    if (c < 0)
+        return __libc_realloc(ptr, size);
+
+    if (size == 0)
+    {
+        free(ptr);
+        return nullptr;
+    }
+
+    //stays put while the size keeps its class
+    const size_t objectSize = classSizes[c];
+    if (size <= objectSize && (c == 0 || size > classSizes[c - 1]))
+        return ptr;
+
+    void* object = malloc(size);
+    if (object)
+    {
+        std::memcpy(object, ptr, std::min(size, objectSize));
+        free(ptr);
+    }
+    return object;
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void*) != 0)
+        return EINVAL;
+
+    void* object = AlignedAllocate(alignment, size);
+    if (!object)
+        return ENOMEM;
+    *memptr = object;
+    return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    return AlignedAllocate(alignment, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    return AlignedAllocate(alignment, size);
+}
+
+void* valloc(size_t size)
+{
+    return __libc_valloc(size);
+}
+
+void* pvalloc(size_t size)
+{
+    return __libc_pvalloc(size);
+}
+
+size_t malloc_usable_size(void* ptr)
+{
+    if (!ptr)
+        return 0;
+
+    const int c = OwnerClass(ptr);
+    if (c >= 0)
+        return classSizes[c];
+
+    if (!libcUsableSize)
+    {
+        BusyGuard busy;
+        libcUsableSize = reinterpret_cast<size_t (*)(void*)>(dlsym(RTLD_NEXT, "malloc_usable_size"));
+    }
+    return libcUsableSize ? libcUsableSize(ptr) : 0;
+}
+
+} // extern "C"
@@ -0,0 +1,457 @@
+/**
+ * @file    oa-snapshot.cpp
+ * @author  Ho Yi Guan 
+ *          SIT     : 2001595@sit.singaporetech.edu.sg 
+ *          Digipen : Yiguan.ho@digipen.edu
+ * @brief   Offline analyzer for the heap snapshots written by
+ *          ObjectAllocator::WriteSnapshot. Reports occupancy,
+ *          fragmentation, live blocks by label (leaks) and the live
+ *          blocks with the lowest and highest allocation numbers.
+ *          The diff mode compares two snapshots of the same allocator
+ *          and reports what grew between them
+ *
+ *          Build and use:
+ *            g++ -std=c++17 -O2 oa-snapshot.cpp -o oa-snapshot
+ *            ./oa-snapshot heap.snap [top]
+ *            ./oa-snapshot --diff before.snap after.snap [top]
+ *
+ *          Case 46 of driver-sample writes two snapshots to diff, the
+ *          expected outputs are data/output-sample-snapshot-diff-LP64.txt
+ *          and data/output-sample-snapshot-diff-report-LP64.txt:
+ *            ./driver-sample 46
+ *            ./oa-snapshot --diff oa-driver-sample-before.snap oa-driver-sample-after.snap
+ *
+ * @date    2026-10-17
+ *
+ */
+
+#include "ObjectAllocator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+
+/**
+ * @brief   A live block of a snapshot
+ */
+struct LiveBlock
+{
+    uint64_t address;  //!< where the object was
+    uint32_t allocNum; //!< allocation number from the header
+    uint32_t label;    //!< index of its label + 1 (0 = no label)
+};
+
+/**
+ * @brief   A snapshot file, read back
+ */
+struct Snapshot
+{
+    OASnapshotHeader header;          //!< layout and stats
+    std::vector<uint64_t> pages;      //!< page addresses in address order
+    std::vector<uint32_t> pageLive;   //!< live blocks on each page
+    std::vector<LiveBlock> blocks;    //!< live blocks in address order
+    std::vector<std::string> labels;  //!< label table
+    uint64_t headerMismatches = 0;    //!< header flags that disagree with the bitmap
+};
+
+/**
+ * @brief   A range of allocation numbers that gained live objects
+ */
+struct GainedRange
+{
+    uint32_t low;  //!< lowest allocation number of the range
+    uint32_t high; //!< highest allocation number of the range
+    size_t count;  //!< live objects that came from the range
+};
+
+/**
+ * @brief   Reads the records of a snapshot image in order
+ */
+class SnapshotReader
+{
+  public:
+    SnapshotReader(const std::vector<uint8_t>& image) : image_(image), offset_(0) {}
+
+    /**
+     * @brief   Copies the next record
+     *
+     * @param   record
+     *          Receives the bytes
+     *
+     * @param   size
+     *          Size of the record in bytes
+     *
+     * @return  false if the image ends first
+     */
+    bool Read(void* record, size_t size)
+    {
+        if (image_.size() - offset_ < size)
+            return false;
+        memcpy(record, image_.data() + offset_, size);
+        offset_ += size;
+        return true;
+    }
+
+  private:
+    const std::vector<uint8_t>& image_; //!< the whole file
+    size_t offset_;                     //!< the next record
+};
+
+// Support functions
+bool LoadFile(const char* path, std::vector<uint8_t>& image);
+bool LoadSnapshot(const char* path, Snapshot& snapshot);
+const char* HeaderName(uint32_t type);
+const char* LabelName(const std::vector<std::string>& labels, uint32_t label);
+void PrintBlocks(const char* title, const std::vector<LiveBlock>& blocks, const std::vector<std::string>& labels, size_t top);
+
+void Report(Snapshot& snapshot, size_t top);                             // one snapshot
+void Diff(const Snapshot& before, const Snapshot& after, size_t top);    // growth from before to after
+
+bool LoadFile(const char* path, std::vector<uint8_t>& image)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file)
+        return false;
+
+    uint8_t chunk[1 << 16];
+    size_t read;
+    while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+        image.insert(image.end(), chunk, chunk + read);
+
+    const bool ok = !std::ferror(file);
+    std::fclose(file);
+    return ok;
+}
+
+bool LoadSnapshot(const char* path, Snapshot& snapshot)
+{
+    std::vector<uint8_t> image;
+    if (!LoadFile(path, image))
+    {
+        printf("Failed to read %s\n", path);
+        return false;
+    }
+
+    SnapshotReader reader(image);
+    OASnapshotHeader& header = snapshot.header;
+    if (!reader.Read(&header, sizeof(header)) || header.magic_ != OA_SNAPSHOT_MAGIC)
+    {
+        printf("%s is not a heap snapshot\n", path);
+        return false;
+    }
+    if (header.version_ != OA_SNAPSHOT_VERSION)
+    {
+        printf("%s is version %u, expected %u\n", path, header.version_, OA_SNAPSHOT_VERSION);
+        return false;
+    }
+
+    //the counts size the buffers below, so they must fit in the rest of the file first
+    const size_t remaining = image.size() - sizeof(header);
+    const size_t bitmapBytes = static_cast<size_t>(header.occupancyWords_) * sizeof(uint64_t);
+    if (header.occupancyWords_ != (static_cast<uint64_t>(header.objectsPerPage_) + 63) / 64
+        || header.pageCount_ > remaining / (sizeof(OASnapshotPage) + 2 * bitmapBytes)
+        || header.objectsInUse_ > remaining / sizeof(OASnapshotBlock))
+    {
+        printf("%s is corrupted (counts too large for the file)\n", path);
+        return false;
+    }
+
+    std::vector<uint64_t> occupancy(header.occupancyWords_);
+    std::vector<uint64_t> headerBits(header.occupancyWords_);
+
+    snapshot.pages.reserve(header.pageCount_);
+    snapshot.pageLive.reserve(header.pageCount_);
+    snapshot.blocks.reserve(header.objectsInUse_);
+
+    for (uint32_t p = 0; p < header.pageCount_; ++p)
+    {
+        OASnapshotPage page;
+        if (!reader.Read(&page, sizeof(page)) || !reader.Read(occupancy.data(), bitmapBytes)
+            || !reader.Read(headerBits.data(), bitmapBytes))
+        {
+            printf("%s is truncated (page %u)\n", path, p);
+            return false;
+        }
+        if (page.liveCount_ > header.objectsPerPage_)
+        {
+            printf("%s is corrupted (page %u)\n", path, p);
+            return false;
+        }
+
+        //headers that disagree with the occupancy bitmap were overwritten
+        if (header.headerType_ != OAConfig::hbNone)
+        {
+            for (uint32_t w = 0; w < header.occupancyWords_; ++w)
+                for (uint64_t bits = occupancy[w] ^ headerBits[w]; bits; bits &= bits - 1)
+                    ++snapshot.headerMismatches;
+        }
+
+        for (uint32_t b = 0; b < page.liveCount_; ++b)
+        {
+            OASnapshotBlock block;
+            if (!reader.Read(&block, sizeof(block)))
+            {
+                printf("%s is truncated (page %u)\n", path, p);
+                return false;
+            }
+            snapshot.blocks.push_back({ page.address_ + header.dataOffset_ + block.index_ * header.objectStride_, block.allocNum_, block.label_ });
+        }
+
+        snapshot.pages.push_back(page.address_);
+        snapshot.pageLive.push_back(page.liveCount_);
+    }
+
+    for (uint32_t l = 0; l < header.labelCount_; ++l)
+    {
+        uint32_t length;
+        if (!reader.Read(&length, sizeof(length)) || length > image.size())
+        {
+            printf("%s is truncated (labels)\n", path);
+            return false;
+        }
+        std::string label(length, '\0');
+        if (!reader.Read(&label[0], length))
+        {
+            printf("%s is truncated (labels)\n", path);
+            return false;
+        }
+        snapshot.labels.push_back(label);
+    }
+    return true;
+}
+
+const char* HeaderName(uint32_t type)
+{
+    switch (type)
+    {
+    case OAConfig::hbNone:     return "none";
+    case OAConfig::hbBasic:    return "basic";
+    case OAConfig::hbExtended: return "extended";
+    case OAConfig::hbExternal: return "external";
+    default:                   return "unknown";
+    }
+}
+
+const char* LabelName(const std::vector<std::string>& labels, uint32_t label)
+{
+    return label == 0 || label > labels.size() ? "(no label)" : labels[label - 1].c_str();
+}
+
+void PrintBlocks(const char* title, const std::vector<LiveBlock>& blocks, const std::vector<std::string>& labels, size_t top)
+{
+    printf("\n%s\n", title);
+    for (size_t i = 0; i < blocks.size() && i < top; ++i)
+        printf("  #%-10u 0x%016llx  %s\n", blocks[i].allocNum,
+            static_cast<unsigned long long>(blocks[i].address), LabelName(labels, blocks[i].label));
+}
+
+void Report(Snapshot& snapshot, size_t top)
+{
+    const OASnapshotHeader& header = snapshot.header;
+
+    //fill buckets: empty, 1-25%, 26-50%, 51-75%, 76-99%, full
+    static const char* fillNames[] = { "empty", "1-25%", "26-50%", "51-75%", "76-99%", "full" };
+    unsigned fillCounts[6] = {};
+    uint64_t strandedFree = 0; //free blocks on pages that also hold live ones
+    for (uint32_t liveCount : snapshot.pageLive)
+    {
+        if (liveCount != 0 && liveCount != header.objectsPerPage_)
+            strandedFree += header.objectsPerPage_ - liveCount;
+
+        const unsigned fill = liveCount == 0 ? 0
+            : liveCount == header.objectsPerPage_ ? 5
+            : 1 + std::min(3u, static_cast<unsigned>((liveCount * 4 - 1) / header.objectsPerPage_));
+        ++fillCounts[fill];
+    }
+
+    const uint64_t total = static_cast<uint64_t>(header.pageCount_) * header.objectsPerPage_;
+    const uint64_t live = snapshot.blocks.size();
+    const uint64_t free = total - live;
+    const uint64_t pageBytes = header.pageCount_ * header.pageSize_;
+
+    printf("object size: %llu  page size: %llu  objects/page: %u  headers: %s\n",
+        static_cast<unsigned long long>(header.objectSize_), static_cast<unsigned long long>(header.pageSize_),
+        header.objectsPerPage_, HeaderName(header.headerType_));
+    printf("stats: allocations %u  deallocations %u  in use %u  free %u  most %u\n",
+        header.allocations_, header.deallocations_, header.objectsInUse_, header.freeObjects_, header.mostObjects_);
+
+    printf("\noccupancy: %u pages  %llu blocks  %llu live (%.1f%%)  %llu free\n", header.pageCount_,
+        static_cast<unsigned long long>(total), static_cast<unsigned long long>(live),
+        total ? 100.0 * live / total : 0.0, static_cast<unsigned long long>(free));
+    for (unsigned f = 0; f < 6; ++f)
+        printf("  %-7s %u pages\n", fillNames[f], fillCounts[f]);
+    printf("overhead: %llu bytes (%.1f%% of page memory)\n", static_cast<unsigned long long>(header.overheadBytes_),
+        pageBytes ? 100.0 * header.overheadBytes_ / pageBytes : 0.0);
+
+    printf("\nfragmentation: %llu free blocks on partly used pages (%.1f%% of free), %u empty pages (%llu bytes) reclaimable\n",
+        static_cast<unsigned long long>(strandedFree), free ? 100.0 * strandedFree / free : 0.0,
+        fillCounts[0], static_cast<unsigned long long>(fillCounts[0] * header.pageSize_));
+    if (header.headerType_ != OAConfig::hbNone)
+        printf("header mismatches: %llu\n", static_cast<unsigned long long>(snapshot.headerMismatches));
+
+    //live blocks by label, the usual suspects for leaks
+    std::map<uint32_t, uint64_t> byLabel;
+    for (const LiveBlock& block : snapshot.blocks)
+        ++byLabel[block.label];
+    std::vector<std::pair<uint64_t, uint32_t>> ranked;
+    for (const std::pair<const uint32_t, uint64_t>& entry : byLabel)
+        ranked.push_back({ entry.second, entry.first });
+    std::sort(ranked.rbegin(), ranked.rend());
+
+    printf("\nlive blocks by label:\n");
+    for (size_t i = 0; i < ranked.size() && i < top; ++i)
+        printf("  %10llu blocks  %12llu bytes  %s\n", static_cast<unsigned long long>(ranked[i].first),
+            static_cast<unsigned long long>(ranked[i].first * header.objectSize_), LabelName(snapshot.labels, ranked[i].second));
+
+    if (header.headerType_ != OAConfig::hbNone)
+    {
+        std::vector<LiveBlock>& blocks = snapshot.blocks;
+        std::sort(blocks.begin(), blocks.end(), [](const LiveBlock& a, const LiveBlock& b) { return a.allocNum < b.allocNum; });
+        PrintBlocks("oldest live allocations:", blocks, snapshot.labels, top);
+        std::reverse(blocks.begin(), blocks.end());
+        PrintBlocks("newest live allocations:", blocks, snapshot.labels, top);
+    }
+}
+
+void Diff(const Snapshot& before, const Snapshot& after, size_t top)
+{
+    if (before.header.objectSize_ != after.header.objectSize_ || before.header.pageSize_ != after.header.pageSize_)
+        printf("warning: the snapshots have different layouts, they may not be of the same allocator\n");
+    if (after.header.allocations_ < before.header.allocations_)
+        printf("warning: the second snapshot was taken first\n");
+
+    //pages: both lists are in address order, one merge finds the added and removed ones
+    uint64_t pagesAdded = 0;
+    uint64_t pagesRemoved = 0;
+    for (size_t b = 0, a = 0; b < before.pages.size() || a < after.pages.size();)
+    {
+        if (a == after.pages.size() || (b < before.pages.size() && before.pages[b] < after.pages[a]))
+            ++pagesRemoved, ++b;
+        else if (b == before.pages.size() || after.pages[a] < before.pages[b])
+            ++pagesAdded, ++a;
+        else
+            ++b, ++a;
+    }
+
+    //labels of the earlier snapshot, as ids of the later one (new ids for labels it lacks)
+    std::vector<std::string> labels = after.labels;
+    std::unordered_map<std::string, uint32_t> labelIds;
+    for (uint32_t l = 0; l < labels.size(); ++l)
+        labelIds.emplace(labels[l], l + 1);
+    std::vector<uint32_t> beforeLabels(before.labels.size() + 1, 0);
+    for (uint32_t l = 0; l < before.labels.size(); ++l)
+    {
+        auto inserted = labelIds.emplace(before.labels[l], static_cast<uint32_t>(labels.size() + 1));
+        if (inserted.second)
+            labels.push_back(before.labels[l]);
+        beforeLabels[l + 1] = inserted.first->second;
+    }
+
+    //blocks: both lists are in address (page, block index) order, a block lives on if it
+    //is at the same address with the same allocation number
+    std::vector<int64_t> labelGrowth(labels.size() + 1, 0);
+    std::vector<uint32_t> gained; //allocation numbers of the blocks that became live
+    uint64_t freed = 0;
+    const std::vector<LiveBlock>& old = before.blocks;
+    const std::vector<LiveBlock>& now = after.blocks;
+    for (size_t b = 0, a = 0; b < old.size() || a < now.size();)
+    {
+        if (a == now.size() || (b < old.size() && old[b].address < now[a].address))
+        {
+            --labelGrowth[beforeLabels[old[b].label]];
+            ++freed, ++b;
+        }
+        else if (b == old.size() || now[a].address < old[b].address)
+        {
+            ++labelGrowth[now[a].label];
+            gained.push_back(now[a].allocNum);
+            ++a;
+        }
+        else if (old[b].allocNum != now[a].allocNum)
+        {
+            //freed and allocated again in between
+            --labelGrowth[beforeLabels[old[b].label]];
+            ++labelGrowth[now[a].label];
+            gained.push_back(now[a].allocNum);
+            ++freed, ++b, ++a;
+        }
+        else
+            ++b, ++a;
+    }
+
+    printf("pages: %zu -> %zu  (%llu added, %llu removed, %+lld bytes)\n", before.pages.size(), after.pages.size(),
+        static_cast<unsigned long long>(pagesAdded), static_cast<unsigned long long>(pagesRemoved),
+        (static_cast<long long>(after.pages.size()) - static_cast<long long>(before.pages.size())) * static_cast<long long>(after.header.pageSize_));
+    printf("live objects: %zu -> %zu  (%zu became live, %llu were freed)\n", old.size(), now.size(),
+        gained.size(), static_cast<unsigned long long>(freed));
+    printf("allocations between the snapshots: %lld\n",
+        static_cast<long long>(after.header.allocations_) - static_cast<long long>(before.header.allocations_));
+
+    std::vector<std::pair<int64_t, uint32_t>> ranked;
+    for (uint32_t l = 0; l < labelGrowth.size(); ++l)
+        if (labelGrowth[l] > 0)
+            ranked.push_back({ labelGrowth[l], l });
+    std::sort(ranked.rbegin(), ranked.rend());
+
+    printf("\nlabels that gained live objects:\n");
+    for (size_t i = 0; i < ranked.size() && i < top; ++i)
+        printf("  %+10lld blocks  %+12lld bytes  %s\n", static_cast<long long>(ranked[i].first),
+            static_cast<long long>(ranked[i].first * static_cast<int64_t>(after.header.objectSize_)), LabelName(labels, ranked[i].second));
+
+    if (after.header.headerType_ == OAConfig::hbNone || gained.empty())
+        return;
+
+    //ranges of allocation numbers the new live objects came from, top ranges by count.
+    //Numbers at most 1/64 of the span apart share a range, so a burst that had a few of
+    //its objects freed in between still reads as one range
+    std::sort(gained.begin(), gained.end());
+    const uint32_t gap = std::max<uint32_t>(1, (gained.back() - gained.front()) / 64);
+    std::vector<GainedRange> ranges;
+    for (size_t i = 0; i < gained.size();)
+    {
+        size_t j = i + 1;
+        while (j < gained.size() && gained[j] - gained[j - 1] <= gap)
+            ++j;
+        ranges.push_back({ gained[i], gained[j - 1], j - i });
+        i = j;
+    }
+    //ranges of equal count stay in ascending order
+    std::stable_sort(ranges.begin(), ranges.end(), [](const GainedRange& a, const GainedRange& b) { return a.count > b.count; });
+
+    printf("\nallocation numbers that gained live objects:\n");
+    for (size_t i = 0; i < ranges.size() && i < top; ++i)
+        printf("  #%-10llu - #%-10llu %10zu blocks\n", static_cast<unsigned long long>(ranges[i].low),
+            static_cast<unsigned long long>(ranges[i].high), ranges[i].count);
+}
+
+int main(int argc, char** argv)
+{
+    const bool diff = argc > 1 && strcmp(argv[1], "--diff") == 0;
+    if (argc < (diff ? 4 : 2))
+    {
+        printf("usage: %s snapshot [top]\n       %s --diff before after [top]\n", argv[0], argv[0]);
+        return 1;
+    }
+    const int topArg = diff ? 4 : 2;
+    const size_t top = argc > topArg ? static_cast<size_t>(std::atoi(argv[topArg])) : 10;
+
+    if (!diff)
+    {
+        Snapshot snapshot;
+        if (!LoadSnapshot(argv[1], snapshot))
+            return 1;
+        Report(snapshot, top);
+        return 0;
+    }
+
+    Snapshot before;
+    Snapshot after;
+    if (!LoadSnapshot(argv[2], before) || !LoadSnapshot(argv[3], after))
+        return 1;
+    Diff(before, after, top);
+    return 0;
+}